@@ -0,0 +1,189 @@
+/* --------------------  Level Filter Replay (START)  ----------------------
+Replays raw HX710B traces through main/level_filter.h on the host and reports
+how much noise each filter setting removes and how much lag it adds.
+
+Build:  g++ -std=c++17 -O2 -I../main level_filter_replay.cpp -o level_filter_replay
+Usage:  ./level_filter_replay [trace.log ...]
+
+A trace is the serial log of a run with LEVEL_TRACE_SERIAL set to 1 in
+program.cpp: lines "LVL,<millis>,<raw counts>", anything else is skipped.
+Recorded traces have no ground truth, so a centred (zero-lag) moving
+average stands in for it. Without arguments a synthetic fill trace (ramp,
+slosh, sensor noise and spikes) with known truth is replayed instead.
+-------------------------------------------------------------------------- */
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+#include "level_filter.h"
+
+struct Trace {
+  std::string name;
+  std::vector<uint32_t> timestamp;  // millis()
+  std::vector<int32_t> raw;         // Raw counts
+  std::vector<double> truth;        // Reference level in counts
+};
+
+struct Preset {
+  const char *name;
+  LevelFilterConfig config;
+};
+
+static const Preset presets[] = {
+  {"raw",              {1, LEVEL_FILTER_NONE, 0, 0, 0}},
+  {"median5",          {5, LEVEL_FILTER_NONE, 0, 0, 0}},
+  {"median5+ema/4",    {5, LEVEL_FILTER_EMA, 2, 0, 0}},
+  {"median5+ema/8",    {5, LEVEL_FILTER_EMA, 3, 0, 0}},
+  {"median5+kalman",   {5, LEVEL_FILTER_KALMAN, 0, 1000000, 25000000}},
+  {"median3+kalman",   {3, LEVEL_FILTER_KALMAN, 0, 1000000, 25000000}},
+};
+
+static bool loadTrace(const char *path, Trace &trace)
+{
+  FILE *file = fopen(path, "r");
+  if (file == NULL)
+  {
+    return false;
+  }
+  char line[128];
+  while (fgets(line, sizeof(line), file))
+  {
+    unsigned long ms;
+    long raw;
+    if (sscanf(line, "LVL,%lu,%ld", &ms, &raw) == 2)
+    {
+      trace.timestamp.push_back((uint32_t)ms);
+      trace.raw.push_back((int32_t)raw);
+    }
+  }
+  fclose(file);
+  trace.name = path;
+
+  // Centred moving average as the zero-lag reference
+  const int half = 5;
+  int n = trace.raw.size();
+  for (int i = 0; i < n; i++)
+  {
+    double total = 0;
+    int used = 0;
+    for (int j = i - half; j <= i + half; j++)
+    {
+      if (j >= 0 && j < n)
+      {
+        total += trace.raw[j];
+        used++;
+      }
+    }
+    trace.truth.push_back(total / used);
+  }
+  return n > 0;
+}
+
+// 4-minute fill at 10 Hz: idle, linear rise, settle, with slosh, noise and spikes
+static Trace syntheticTrace()
+{
+  Trace trace;
+  trace.name = "synthetic fill (no recording given)";
+  std::mt19937 rng(1906);
+  std::normal_distribution<double> noise(0, 150);
+  std::uniform_real_distribution<double> unit(0, 1);
+  const double countsPerLitre = 27.4 * 3100;
+  for (int i = 0; i < 2400; i++)
+  {
+    double t = i / 10.0;
+    double litres = t < 20 ? 0 : t < 200 ? (t - 20) * 0.1 : 18.0;
+    double slosh = t >= 20 && t < 200 ? 0.15 * sin(t * 2.1) : 0;
+    double truth = litres * countsPerLitre;
+    double raw = truth + slosh * countsPerLitre + noise(rng);
+    if (unit(rng) < 0.01)
+    {
+      raw += (unit(rng) < 0.5 ? -1 : 1) * 4 * countsPerLitre;
+    }
+    trace.timestamp.push_back(i * 100);
+    trace.raw.push_back((int32_t)raw);
+    trace.truth.push_back(truth);
+  }
+  return trace;
+}
+
+static double rmsError(const std::vector<double> &a, const std::vector<double> &b, int shift)
+{
+  double total = 0;
+  int used = 0;
+  for (size_t i = shift; i < a.size(); i++)
+  {
+    double d = a[i] - b[i - shift];
+    total += d * d;
+    used++;
+  }
+  return used ? sqrt(total / used) : 0;
+}
+
+static void replay(const Trace &trace)
+{
+  int n = trace.raw.size();
+  double periodMs = n > 1 ? (trace.timestamp[n - 1] - trace.timestamp[0]) / (double)(n - 1) : 100;
+  printf("\n%s: %d samples, %.1f ms/sample\n", trace.name.c_str(), n, periodMs);
+  printf("%-16s %12s %10s %12s %10s %12s\n", "filter", "rms (cnt)", "reduction", "lag (samp)", "lag (ms)", "worst (cnt)");
+
+  double rawRms = 0;
+  for (const Preset &preset : presets)
+  {
+    LevelFilter filter;
+    levelFilterInit(filter, preset.config);
+    std::vector<double> out(n);
+    for (int i = 0; i < n; i++)
+    {
+      out[i] = levelFilterUpdate(filter, trace.raw[i]);
+    }
+
+    // Lag: the delay that best lines the output up with the reference
+    int lag = 0;
+    double best = rmsError(out, trace.truth, 0);
+    for (int shift = 1; shift <= 40 && shift < n; shift++)
+    {
+      double e = rmsError(out, trace.truth, shift);
+      if (e < best)
+      {
+        best = e;
+        lag = shift;
+      }
+    }
+    double rms = rmsError(out, trace.truth, 0);
+    if (rawRms == 0)
+    {
+      rawRms = rms;
+    }
+    double worst = 0;
+    for (int i = 0; i < n; i++)
+    {
+      worst = fmax(worst, fabs(out[i] - trace.truth[i]));
+    }
+    printf("%-16s %12.1f %8.1f dB %12d %10.0f %12.0f\n", preset.name, rms,
+           20 * log10(rawRms / fmax(rms, 1e-9)), lag, lag * periodMs, worst);
+  }
+}
+
+int main(int argc, char **argv)
+{
+  if (argc < 2)
+  {
+    replay(syntheticTrace());
+    return 0;
+  }
+  for (int i = 1; i < argc; i++)
+  {
+    Trace trace;
+    if (!loadTrace(argv[i], trace))
+    {
+      fprintf(stderr, "%s: no LVL samples\n", argv[i]);
+      return 1;
+    }
+    replay(trace);
+  }
+  return 0;
+}
+/* --------------------  Level Filter Replay (END)  ---------------------- */
@@ -0,0 +1,257 @@
+/* --------------------  Arduino Core, Host Build (START)  ----------------------
+The part of the Arduino-ESP32 core that program.cpp uses, for the Linux
+simulation. Types and helpers (String, Print, HardwareSerial, EspClass) are
+implemented here; pins, time and the chip come from sim_hal.cpp, which maps
+them onto the simulation kernel and the machine model.
+-------------------------------------------------------------------------- */
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <string>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
+
+using std::max;
+using std::min;
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+#define HIGH 0x1
+#define LOW 0x0
+
+#define INPUT 0x01
+#define OUTPUT 0x03
+#define INPUT_PULLUP 0x05
+
+#define RISING 0x01
+#define FALLING 0x02
+#define CHANGE 0x03
+
+#define DEC 10
+#define HEX 16
+
+#define IRAM_ATTR
+#define DRAM_ATTR
+#define PROGMEM
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+class String
+{
+public:
+  String() {}
+  String(const char *text) : text(text ? text : "") {}
+  String(const std::string &text) : text(text) {}
+  String(char c) : text(1, c) {}
+  String(int value, unsigned char base = DEC) : text(format(base == HEX ? "%x" : "%d", value)) {}
+  String(unsigned int value, unsigned char base = DEC) : text(format(base == HEX ? "%x" : "%u", value)) {}
+  String(long value, unsigned char base = DEC) : text(format(base == HEX ? "%lx" : "%ld", value)) {}
+  String(unsigned long value, unsigned char base = DEC) : text(format(base == HEX ? "%lx" : "%lu", value)) {}
+  String(long long value) : text(format("%lld", value)) {}
+  String(unsigned long long value) : text(format("%llu", value)) {}
+  String(float value, unsigned int decimals = 2) : text(format("%.*f", decimals, (double)value)) {}
+  String(double value, unsigned int decimals = 2) : text(format("%.*f", decimals, value)) {}
+
+  const char *c_str() const { return text.c_str(); }
+  unsigned int length() const { return text.size(); }
+  void reserve(unsigned int size) { text.reserve(size); }
+
+  char operator[](unsigned int index) const { return index < text.size() ? text[index] : 0; }
+  bool operator==(const String &other) const { return text == other.text; }
+  bool operator==(const char *other) const { return text == (other ? other : ""); }
+  bool operator!=(const String &other) const { return text != other.text; }
+  bool operator!=(const char *other) const { return !(*this == other); }
+
+  String &operator+=(const String &other) { text += other.text; return *this; }
+  String &operator+=(const char *other) { text += other ? other : ""; return *this; }
+  String &operator+=(char c) { text += c; return *this; }
+  String &operator+=(int value) { return *this += String(value); }
+  String &operator+=(unsigned int value) { return *this += String(value); }
+  String &operator+=(long value) { return *this += String(value); }
+  String &operator+=(unsigned long value) { return *this += String(value); }
+  String &operator+=(float value) { return *this += String(value); }
+  String &operator+=(double value) { return *this += String(value); }
+
+  int indexOf(const String &what, unsigned int from = 0) const
+  {
+    size_t at = text.find(what.text, from);
+    return at == std::string::npos ? -1 : (int)at;
+  }
+  int indexOf(char c, unsigned int from = 0) const { return indexOf(String(c), from); }
+  bool startsWith(const String &prefix) const { return text.compare(0, prefix.text.size(), prefix.text) == 0; }
+  bool endsWith(const String &suffix) const
+  {
+    return text.size() >= suffix.text.size() &&
+           text.compare(text.size() - suffix.text.size(), suffix.text.size(), suffix.text) == 0;
+  }
+  String substring(unsigned int from) const { return from < text.size() ? String(text.substr(from)) : String(); }
+  String substring(unsigned int from, unsigned int to) const
+  {
+    if (from > to)
+      std::swap(from, to);
+    return from < text.size() ? String(text.substr(from, to - from)) : String();
+  }
+
+  void trim()
+  {
+    size_t first = text.find_first_not_of(" \t\r\n");
+    size_t last = text.find_last_not_of(" \t\r\n");
+    text = first == std::string::npos ? "" : text.substr(first, last - first + 1);
+  }
+  void toLowerCase() { std::transform(text.begin(), text.end(), text.begin(), ::tolower); }
+  void toUpperCase() { std::transform(text.begin(), text.end(), text.begin(), ::toupper); }
+  long toInt() const { return atol(text.c_str()); }
+  float toFloat() const { return atof(text.c_str()); }
+
+private:
+  std::string text;
+
+  static std::string format(const char *fmt, ...)
+  {
+    char buf[64];
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+    return buf;
+  }
+};
+
+inline String operator+(const String &a, const String &b) { String sum(a); sum += b; return sum; }
+inline String operator+(const String &a, const char *b) { String sum(a); sum += b; return sum; }
+inline String operator+(const char *a, const String &b) { String sum(a); sum += b; return sum; }
+inline String operator+(const String &a, char b) { String sum(a); sum += b; return sum; }
+inline String operator+(const String &a, int b) { String sum(a); sum += b; return sum; }
+inline String operator+(const String &a, unsigned int b) { String sum(a); sum += b; return sum; }
+inline String operator+(const String &a, long b) { String sum(a); sum += b; return sum; }
+inline String operator+(const String &a, unsigned long b) { String sum(a); sum += b; return sum; }
+inline String operator+(const String &a, float b) { String sum(a); sum += b; return sum; }
+inline String operator+(const String &a, double b) { String sum(a); sum += b; return sum; }
+
+class IPAddress
+{
+public:
+  IPAddress() {}
+  IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : octets{a, b, c, d} {}
+  String toString() const
+  {
+    char buf[16];
+    snprintf(buf, sizeof(buf), "%u.%u.%u.%u", octets[0], octets[1], octets[2], octets[3]);
+    return buf;
+  }
+
+private:
+  uint8_t octets[4] = {0, 0, 0, 0};
+};
+
+class Print
+{
+public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t *buf, size_t size)
+  {
+    size_t n = 0;
+    while (size--)
+      n += write(*buf++);
+    return n;
+  }
+  size_t write(const char *text) { return write((const uint8_t *)text, strlen(text)); }
+
+  size_t print(const char *text) { return write(text); }
+  size_t print(const String &text) { return write(text.c_str()); }
+  size_t print(char c) { return write((uint8_t)c); }
+  size_t print(int value, int base = DEC) { return print(String(value, base)); }
+  size_t print(unsigned int value, int base = DEC) { return print(String(value, base)); }
+  size_t print(long value, int base = DEC) { return print(String(value, base)); }
+  size_t print(unsigned long value, int base = DEC) { return print(String(value, base)); }
+  size_t print(double value, int decimals = 2) { return print(String(value, decimals)); }
+  size_t print(const IPAddress &ip) { return print(ip.toString()); }
+
+  size_t println() { return write("\r\n"); }
+  template <typename T>
+  size_t println(const T &value) { return print(value) + println(); }
+  template <typename T>
+  size_t println(const T &value, int format) { return print(value, format) + println(); }
+
+  size_t printf(const char *fmt, ...) __attribute__((format(printf, 2, 3)))
+  {
+    char buf[256];
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+    return write((const uint8_t *)buf, n < (int)sizeof(buf) ? n : sizeof(buf) - 1);
+  }
+};
+
+class Stream : public Print
+{
+public:
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int peek() = 0;
+  virtual void flush() {}
+  void setTimeout(unsigned long ms) { timeout = ms; }
+  unsigned long getTimeout() { return timeout; }
+
+protected:
+  unsigned long timeout = 1000;
+};
+
+// Serial output is collected into lines and handed to the simulation (sim_hal.h)
+class HardwareSerial : public Stream
+{
+public:
+  void begin(unsigned long baud) { (void)baud; }
+  size_t write(uint8_t c) override;
+  using Print::write;
+  int available() override { return 0; }
+  int read() override { return -1; }
+  int peek() override { return -1; }
+
+private:
+  std::string line;
+};
+extern HardwareSerial Serial;
+
+class EspClass
+{
+public:
+  uint32_t getCycleCount();
+  uint32_t getCpuFreqMHz() { return 240; }
+  uint32_t getFlashChipSize() { return 4 * 1024 * 1024; }
+  uint32_t getFlashChipSpeed() { return 80000000; }
+  uint32_t getSketchSize() { return 1024 * 1024; }
+  uint32_t getFreeSketchSpace() { return 1310720; }
+  String getSketchMD5() { return "00000000000000000000000000000000"; }
+  uint32_t getHeapSize() { return 320 * 1024; }
+  uint32_t getFreeHeap() { return 200 * 1024; }
+  const char *getChipModel() { return "ESP32 (host simulation)"; }
+  uint8_t getChipRevision() { return 0; }
+};
+extern EspClass ESP;
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+void analogWrite(uint8_t pin, int value);
+inline int digitalPinToInterrupt(uint8_t pin) { return pin; }
+void attachInterrupt(uint8_t pin, void (*isr)(void), int mode);
+void detachInterrupt(uint8_t pin);
+
+unsigned long millis();
+unsigned long micros();
+void delay(uint32_t ms);
+/* --------------------  Arduino Core, Host Build (END)  ---------------------- */
@@ -0,0 +1,2 @@
+// Host stand-in: only the Telegram library parses JSON, and its host build does not
+#pragma once
@@ -0,0 +1,16 @@
+// Host stand-in for ElegantOTA: no firmware updates in the simulation
+#pragma once
+#include <WebServer.h>
+
+class ElegantOTAClass
+{
+public:
+  void begin(WebServer *server) { (void)server; }
+  void setAuth(const char *user, const char *password) { (void)user; (void)password; }
+  void clearAuth() {}
+  void onStart(void (*callback)()) { (void)callback; }
+  void onProgress(void (*callback)(size_t current, size_t final)) { (void)callback; }
+  void onEnd(void (*callback)(bool success)) { (void)callback; }
+  void loop() {}
+};
+extern ElegantOTAClass ElegantOTA;
@@ -0,0 +1,24 @@
+// Host stand-in for the HX711 library: conversions come from the machine model's level sensor (sim_hal.cpp)
+#pragma once
+#include <Arduino.h>
+
+class HX711
+{
+public:
+  void begin(uint8_t dout, uint8_t sck, uint8_t gain = 128);
+  bool is_ready();
+  long read();
+  long read_average(uint8_t times = 10);
+  double get_value(uint8_t times = 1) { return read_average(times) - offset; }
+  float get_units(uint8_t times = 1) { return get_value(times) / scale; }
+  void tare(uint8_t times = 10) { offset = read_average(times); }
+  void set_scale(float value = 1.f) { scale = value; }
+  float get_scale() { return scale; }
+  void set_offset(long value = 0) { offset = value; }
+  long get_offset() { return offset; }
+
+private:
+  float scale = 1;
+  long offset = 0;
+  uint64_t lastReadUs = 0;
+};
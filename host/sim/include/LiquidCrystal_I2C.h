@@ -0,0 +1,16 @@
+// Host stand-in for the I2C character LCD: writes land on the simulated glass (sim_hal.h)
+#pragma once
+#include <Arduino.h>
+
+class LiquidCrystal_I2C : public Print
+{
+public:
+  LiquidCrystal_I2C(uint8_t address, uint8_t cols, uint8_t rows);
+  void init();
+  void clear();
+  void setCursor(uint8_t col, uint8_t row);
+  void backlight();
+  void noBacklight();
+  size_t write(uint8_t c) override;
+  using Print::write;
+};
@@ -0,0 +1,40 @@
+// Host stand-in for Preferences: NVS namespaces kept in memory for the life of the process (sim_hal.cpp)
+#pragma once
+#include <Arduino.h>
+
+class Preferences
+{
+public:
+  bool begin(const char *name, bool readOnly = false);
+  void end();
+  bool clear();
+  bool remove(const char *key);
+
+  uint16_t getUShort(const char *key, uint16_t defaultValue = 0) { return get(key, defaultValue); }
+  size_t putUShort(const char *key, uint16_t value) { return put(key, value); }
+  int32_t getInt(const char *key, int32_t defaultValue = 0) { return get(key, defaultValue); }
+  size_t putInt(const char *key, int32_t value) { return put(key, value); }
+  uint32_t getUInt(const char *key, uint32_t defaultValue = 0) { return get(key, defaultValue); }
+  size_t putUInt(const char *key, uint32_t value) { return put(key, value); }
+  int32_t getLong(const char *key, int32_t defaultValue = 0) { return get(key, defaultValue); }
+  size_t putLong(const char *key, int32_t value) { return put(key, value); }
+  float getFloat(const char *key, float defaultValue = NAN) { return get(key, defaultValue); }
+  size_t putFloat(const char *key, float value) { return put(key, value); }
+
+private:
+  std::string space;
+  bool open = false;
+  bool readOnly = true;
+
+  bool load(const char *key, void *value, size_t size);
+  size_t store(const char *key, const void *value, size_t size);
+
+  template <typename T>
+  T get(const char *key, T defaultValue)
+  {
+    T value;
+    return load(key, &value, sizeof(value)) ? value : defaultValue;
+  }
+  template <typename T>
+  size_t put(const char *key, T value) { return store(key, &value, sizeof(value)); }
+};
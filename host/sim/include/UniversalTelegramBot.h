@@ -0,0 +1,34 @@
+// Host stand-in for UniversalTelegramBot: talks to the simulated chat instead of the Bot API (sim_hal.h)
+#pragma once
+#include <Arduino.h>
+#include <Client.h>
+
+#define TELEGRAM_CERTIFICATE_ROOT ""
+#define HANDLE_MESSAGES 1
+
+struct telegramMessage
+{
+  String text;
+  String chat_id;
+  String chat_title;
+  String from_id;
+  String from_name;
+  String date;
+  String type;
+  int update_id;
+  int message_id;
+};
+
+class UniversalTelegramBot
+{
+public:
+  UniversalTelegramBot(const String &token, Client &client);
+  bool sendMessage(const String &chat_id, const String &text, const String &parse_mode = "", int message_id = 0);
+  int getUpdates(long offset);
+
+  telegramMessage messages[HANDLE_MESSAGES];
+  long last_message_received = 0;
+  int last_sent_message_id = 0;
+  unsigned int longPoll = 0;
+  unsigned int waitForResponse = 1500;
+};
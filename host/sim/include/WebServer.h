@@ -0,0 +1,14 @@
+// Host stand-in for the OTA web server: routes are accepted and never requested
+#pragma once
+#include <Arduino.h>
+#include <functional>
+
+class WebServer
+{
+public:
+  explicit WebServer(int port) { (void)port; }
+  void on(const char *uri, std::function<void()> handler) { (void)uri; (void)handler; }
+  void send(int code, const char *contentType, const String &content) { (void)code; (void)contentType; (void)content; }
+  void begin() {}
+  void handleClient() {}
+};
@@ -0,0 +1,24 @@
+// Host stand-in for the WiFi station; the link state is set by the simulation (sim_hal.h)
+#pragma once
+#include <Arduino.h>
+#include <WiFiClient.h>
+
+#define WIFI_STA 1
+
+typedef enum
+{
+  WL_IDLE_STATUS = 0,
+  WL_CONNECTED = 3,
+  WL_DISCONNECTED = 6,
+} wl_status_t;
+
+class WiFiClass
+{
+public:
+  bool mode(int mode) { (void)mode; return true; }
+  wl_status_t begin(const char *ssid, const char *password);
+  wl_status_t status();
+  IPAddress localIP();
+  int8_t RSSI();
+};
+extern WiFiClass WiFi;
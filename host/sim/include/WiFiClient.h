@@ -0,0 +1,19 @@
+// Host stand-in for WiFiClient: no sockets in the simulation
+#pragma once
+#include <Client.h>
+
+class WiFiClient : public Client
+{
+public:
+  int connect(IPAddress ip, uint16_t port) override { (void)ip; (void)port; return 0; }
+  int connect(const char *host, uint16_t port) override { (void)host; (void)port; return 0; }
+  size_t write(uint8_t c) override { (void)c; return 0; }
+  size_t write(const uint8_t *buf, size_t size) override { (void)buf; (void)size; return 0; }
+  int available() override { return 0; }
+  int read() override { return -1; }
+  int read(uint8_t *buf, size_t size) override { (void)buf; (void)size; return -1; }
+  int peek() override { return -1; }
+  void stop() override {}
+  uint8_t connected() override { return 0; }
+  operator bool() override { return false; }
+};
@@ -0,0 +1,3 @@
+// Host stand-in: the LCD is simulated above the I2C layer (LiquidCrystal_I2C.h)
+#pragma once
+#include <Arduino.h>
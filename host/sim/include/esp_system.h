@@ -0,0 +1,4 @@
+// Host stand-in for esp_system.h: a restart ends the simulation (sim_hal.cpp)
+#pragma once
+
+void esp_restart();
@@ -0,0 +1,30 @@
+// Host stand-in for esp_tls: the simulation has no network, so connects fail (sim_hal.cpp)
+#pragma once
+#include <stddef.h>
+#include <sys/types.h>
+#include "esp_timer.h"
+
+#define ESP_TLS_ERR_SSL_WANT_READ -0x6900
+#define ESP_TLS_ERR_SSL_WANT_WRITE -0x6880
+#define CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS 1
+
+typedef struct esp_tls esp_tls_t;
+typedef struct esp_tls_client_session esp_tls_client_session_t;
+
+typedef struct
+{
+  const unsigned char *cacert_buf;
+  unsigned int cacert_bytes;
+  int timeout_ms;
+  esp_tls_client_session_t *client_session;
+} esp_tls_cfg_t;
+
+esp_tls_t *esp_tls_init();
+int esp_tls_conn_new_sync(const char *host, int hostLen, int port, const esp_tls_cfg_t *cfg, esp_tls_t *tls);
+ssize_t esp_tls_conn_write(esp_tls_t *tls, const void *data, size_t len);
+ssize_t esp_tls_conn_read(esp_tls_t *tls, void *data, size_t len);
+int esp_tls_conn_destroy(esp_tls_t *tls);
+ssize_t esp_tls_get_bytes_avail(esp_tls_t *tls);
+esp_err_t esp_tls_get_conn_sockfd(esp_tls_t *tls, int *sockfd);
+esp_tls_client_session_t *esp_tls_get_client_session(esp_tls_t *tls);
+void esp_tls_free_client_session(esp_tls_client_session_t *session);
@@ -0,0 +1,9 @@
+// Host stand-in for FreeRTOS semaphores: as in FreeRTOS, a mutex is a one-item queue
+#pragma once
+#include "queue.h"
+
+typedef QueueHandle_t SemaphoreHandle_t;
+
+SemaphoreHandle_t xSemaphoreCreateMutex();
+#define xSemaphoreTake(semaphore, ticks) xQueueReceive((semaphore), NULL, (ticks))
+#define xSemaphoreGive(semaphore) xQueueSend((semaphore), NULL, 0)
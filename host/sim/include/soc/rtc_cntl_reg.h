@@ -0,0 +1,2 @@
+// Host stand-in: no RTC registers on the host
+#pragma once
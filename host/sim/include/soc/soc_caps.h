@@ -0,0 +1,3 @@
+// Host stand-in for the ESP32 capability flags the firmware tests
+#pragma once
+#define SOC_LEDC_SUPPORT_FADE_STOP 1
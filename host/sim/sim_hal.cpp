@@ -0,0 +1,746 @@
+/* --------------------  Simulation HAL (START)  ----------------------
+Host implementations of the Arduino core and ESP-IDF drivers behind
+program.cpp. See sim_hal.h.
+-------------------------------------------------------------------------- */
+#include <Arduino.h>
+#include <HX711.h>
+#include <LiquidCrystal_I2C.h>
+#include <Preferences.h>
+#include <UniversalTelegramBot.h>
+#include <WiFi.h>
+#include <ElegantOTA.h>
+#include "esp_system.h"
+#include "esp_tls.h"
+#include "driver/ledc.h"
+#include "driver/pulse_cnt.h"
+#include <deque>
+#include <map>
+#include <vector>
+#include "sim_kernel.h"
+#include "sim_hal.h"
+
+HardwareSerial Serial;
+EspClass ESP;
+WiFiClass WiFi;
+ElegantOTAClass ElegantOTA;
+
+/* --------------------  Time  ---------------------- */
+unsigned long millis()
+{
+  simClockRead();
+  return simNowUs() / 1000;
+}
+
+unsigned long micros()
+{
+  simClockRead();
+  return simNowUs();
+}
+
+void delay(uint32_t ms)
+{
+  vTaskDelay(pdMS_TO_TICKS(ms));
+}
+
+uint32_t EspClass::getCycleCount()
+{
+  simClockRead();
+  return (uint32_t)(simNowUs() * getCpuFreqMHz());
+}
+
+void esp_restart()
+{
+  fprintf(stderr, "esp_restart() at %.3f s\n", simNowUs() / 1e6);
+  exit(3);
+}
+
+/* --------------------  GPIO  ---------------------- */
+struct PinIsr {
+  void (*isr)();
+  int mode;
+};
+
+static uint8_t pinLevels[SIM_PIN_COUNT];
+static uint8_t pinModes[SIM_PIN_COUNT];
+static uint8_t analogDuty[SIM_PIN_COUNT];
+static PinIsr pinIsrs[SIM_PIN_COUNT];
+static void (*pinWriteListener)(uint8_t, uint8_t) = NULL;
+static void (*outputChangingListener)() = NULL;
+
+// Lets the machine model run up to this moment on the outputs as they were
+static void outputChanging()
+{
+  if (outputChangingListener != NULL)
+    outputChangingListener();
+}
+
+struct PulseCounter {
+  int gpio;                         // Edge input, -1 before pcnt_new_channel
+  int count;
+  bool running;
+};
+static PulseCounter pulseCounter = {-1, 0, false};
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+  if (pin >= SIM_PIN_COUNT)
+    return;
+  pinModes[pin] = mode;
+  if (mode == INPUT_PULLUP)
+    pinLevels[pin] = HIGH;
+}
+
+void digitalWrite(uint8_t pin, uint8_t value)
+{
+  if (pin >= SIM_PIN_COUNT)
+    return;
+  value = value ? HIGH : LOW;
+  if (pinLevels[pin] == value)
+    return;
+  outputChanging();
+  pinLevels[pin] = value;
+  if (pinWriteListener != NULL)
+    pinWriteListener(pin, value);
+}
+
+int digitalRead(uint8_t pin)
+{
+  return pin < SIM_PIN_COUNT ? pinLevels[pin] : LOW;
+}
+
+void analogWrite(uint8_t pin, int value)
+{
+  if (pin >= SIM_PIN_COUNT)
+    return;
+  outputChanging();
+  analogDuty[pin] = constrain(value, 0, 255);
+}
+
+void attachInterrupt(uint8_t pin, void (*isr)(void), int mode)
+{
+  if (pin < SIM_PIN_COUNT)
+    pinIsrs[pin] = {isr, mode};
+}
+
+void detachInterrupt(uint8_t pin)
+{
+  if (pin < SIM_PIN_COUNT)
+    pinIsrs[pin] = {NULL, 0};
+}
+
+void simPinDrive(uint8_t pin, uint8_t level)
+{
+  if (pin >= SIM_PIN_COUNT || pinLevels[pin] == level)
+    return;
+  pinLevels[pin] = level;
+  if (level == HIGH && pulseCounter.running && pulseCounter.gpio == pin)
+    pulseCounter.count++;
+  const PinIsr &handler = pinIsrs[pin];
+  if (handler.isr != NULL &&
+      (handler.mode == CHANGE || (handler.mode == RISING && level == HIGH) || (handler.mode == FALLING && level == LOW)))
+    simIsr(handler.isr);
+}
+
+uint8_t simPinLevel(uint8_t pin)
+{
+  return pin < SIM_PIN_COUNT ? pinLevels[pin] : LOW;
+}
+
+void simOnPinWrite(void (*listener)(uint8_t pin, uint8_t level))
+{
+  pinWriteListener = listener;
+}
+
+void simOnOutputChanging(void (*listener)())
+{
+  outputChangingListener = listener;
+}
+
+/* --------------------  LEDC  ---------------------- */
+struct LedcChannel {
+  int gpio;                         // -1 until configured
+  uint32_t duty;                    // Steady duty, or the fade's start
+  uint32_t pendingDuty;             // ledc_set_duty() until ledc_update_duty()
+  uint32_t fadeTarget;
+  uint32_t fadeMs;
+  uint64_t fadeStartUs;
+  uint64_t fadeEndUs;
+  bool fading;
+  ledc_cb_t fadeCallback;
+  void *fadeArg;
+  esp_timer_handle_t fadeTimer;
+};
+static LedcChannel ledcChannels[LEDC_CHANNEL_MAX];
+
+static uint32_t ledcDutyNow(const LedcChannel &channel)
+{
+  if (!channel.fading || channel.fadeEndUs <= channel.fadeStartUs)
+    return channel.duty;
+  uint64_t now = simNowUs();
+  if (now >= channel.fadeEndUs)
+    return channel.fadeTarget;
+  double t = (double)(now - channel.fadeStartUs) / (channel.fadeEndUs - channel.fadeStartUs);
+  return (uint32_t)(channel.duty + ((double)channel.fadeTarget - channel.duty) * t + 0.5);
+}
+
+static void ledcFadeEnd(void *arg)
+{
+  LedcChannel &channel = *(LedcChannel *)arg;
+  channel.duty = channel.fadeTarget;
+  channel.fading = false;
+  if (channel.fadeCallback != NULL)
+  {
+    ledc_cb_param_t param = {LEDC_FADE_END_EVT, LEDC_LOW_SPEED_MODE,
+                             (uint32_t)(&channel - ledcChannels), channel.duty};
+    channel.fadeCallback(&param, channel.fadeArg);
+  }
+}
+
+static void ledcFadeCancel(LedcChannel &channel)
+{
+  if (!channel.fading)
+    return;
+  channel.duty = ledcDutyNow(channel);
+  channel.fading = false;
+  esp_timer_stop(channel.fadeTimer);
+}
+
+esp_err_t ledc_timer_config(const ledc_timer_config_t *config)
+{
+  (void)config;
+  return ESP_OK;
+}
+
+esp_err_t ledc_channel_config(const ledc_channel_config_t *config)
+{
+  LedcChannel &channel = ledcChannels[config->channel];
+  channel.gpio = config->gpio_num;
+  channel.duty = channel.pendingDuty = config->duty;
+  if (channel.fadeTimer == NULL)
+  {
+    const esp_timer_create_args_t args = {ledcFadeEnd, &channel, ESP_TIMER_ISR, "ledc_fade", false};
+    esp_timer_create(&args, &channel.fadeTimer);
+  }
+  return ESP_OK;
+}
+
+esp_err_t ledc_fade_func_install(int intrAllocFlags)
+{
+  (void)intrAllocFlags;
+  return ESP_OK;
+}
+
+esp_err_t ledc_cb_register(ledc_mode_t mode, ledc_channel_t channel, ledc_cbs_t *callbacks, void *userArg)
+{
+  (void)mode;
+  ledcChannels[channel].fadeCallback = callbacks->fade_cb;
+  ledcChannels[channel].fadeArg = userArg;
+  return ESP_OK;
+}
+
+esp_err_t ledc_set_duty(ledc_mode_t mode, ledc_channel_t channel, uint32_t duty)
+{
+  (void)mode;
+  ledcChannels[channel].pendingDuty = duty;
+  return ESP_OK;
+}
+
+esp_err_t ledc_update_duty(ledc_mode_t mode, ledc_channel_t channel)
+{
+  (void)mode;
+  LedcChannel &state = ledcChannels[channel];
+  outputChanging();
+  ledcFadeCancel(state);
+  state.duty = state.pendingDuty;
+  return ESP_OK;
+}
+
+uint32_t ledc_get_duty(ledc_mode_t mode, ledc_channel_t channel)
+{
+  (void)mode;
+  return ledcDutyNow(ledcChannels[channel]);
+}
+
+esp_err_t ledc_set_fade_with_time(ledc_mode_t mode, ledc_channel_t channel, uint32_t targetDuty, int maxFadeTimeMs)
+{
+  (void)mode;
+  ledcChannels[channel].fadeTarget = targetDuty;
+  ledcChannels[channel].fadeMs = maxFadeTimeMs > 0 ? maxFadeTimeMs : 0;
+  return ESP_OK;
+}
+
+esp_err_t ledc_fade_start(ledc_mode_t mode, ledc_channel_t channel, ledc_fade_mode_t fadeMode)
+{
+  (void)mode;
+  LedcChannel &state = ledcChannels[channel];
+  uint32_t target = state.fadeTarget;
+  outputChanging();
+  ledcFadeCancel(state);
+  state.fadeTarget = target;
+  state.fadeStartUs = simNowUs();
+  state.fadeEndUs = state.fadeStartUs + state.fadeMs * 1000ULL;
+  state.fading = true;
+  esp_timer_start_once(state.fadeTimer, state.fadeMs * 1000ULL);
+  if (fadeMode == LEDC_FADE_WAIT_DONE)
+  {
+    while (state.fading)
+      vTaskDelay(1);
+  }
+  return ESP_OK;
+}
+
+esp_err_t ledc_fade_stop(ledc_mode_t mode, ledc_channel_t channel)
+{
+  (void)mode;
+  outputChanging();
+  ledcFadeCancel(ledcChannels[channel]);
+  return ESP_OK;
+}
+
+uint8_t simPwmDuty(uint8_t pin)
+{
+  for (const LedcChannel &channel : ledcChannels)
+  {
+    if (channel.gpio == pin && channel.fadeTimer != NULL)
+      return ledcDutyNow(channel);
+  }
+  return pin < SIM_PIN_COUNT ? analogDuty[pin] : 0;
+}
+
+/* --------------------  Pulse Counter  ---------------------- */
+// One unit, counting rising edges; accum_count means the count never wraps
+esp_err_t pcnt_new_unit(const pcnt_unit_config_t *config, pcnt_unit_handle_t *unit)
+{
+  (void)config;
+  *unit = (pcnt_unit_handle_t)&pulseCounter;
+  return ESP_OK;
+}
+
+esp_err_t pcnt_unit_set_glitch_filter(pcnt_unit_handle_t unit, const pcnt_glitch_filter_config_t *config)
+{
+  (void)unit;
+  (void)config;
+  return ESP_OK;
+}
+
+esp_err_t pcnt_new_channel(pcnt_unit_handle_t unit, const pcnt_chan_config_t *config, pcnt_channel_handle_t *channel)
+{
+  (void)unit;
+  pulseCounter.gpio = config->edge_gpio_num;
+  *channel = (pcnt_channel_handle_t)&pulseCounter;
+  return ESP_OK;
+}
+
+esp_err_t pcnt_channel_set_edge_action(pcnt_channel_handle_t channel, pcnt_channel_edge_action_t rising,
+                                       pcnt_channel_edge_action_t falling)
+{
+  (void)channel;
+  (void)rising;
+  (void)falling;
+  return ESP_OK;
+}
+
+esp_err_t pcnt_unit_add_watch_point(pcnt_unit_handle_t unit, int count)
+{
+  (void)unit;
+  (void)count;
+  return ESP_OK;
+}
+
+esp_err_t pcnt_unit_enable(pcnt_unit_handle_t unit)
+{
+  (void)unit;
+  return ESP_OK;
+}
+
+esp_err_t pcnt_unit_clear_count(pcnt_unit_handle_t unit)
+{
+  (void)unit;
+  pulseCounter.count = 0;
+  return ESP_OK;
+}
+
+esp_err_t pcnt_unit_start(pcnt_unit_handle_t unit)
+{
+  (void)unit;
+  pulseCounter.running = true;
+  return ESP_OK;
+}
+
+esp_err_t pcnt_unit_get_count(pcnt_unit_handle_t unit, int *count)
+{
+  (void)unit;
+  *count = pulseCounter.count;
+  return ESP_OK;
+}
+
+/* --------------------  HX711  ---------------------- */
+static int32_t (*levelSource)() = NULL;
+static bool levelDead = false;
+
+void simLevelSource(int32_t (*source)())
+{
+  levelSource = source;
+}
+
+void simLevelDead(bool dead)
+{
+  levelDead = dead;
+}
+
+void HX711::begin(uint8_t dout, uint8_t sck, uint8_t gain)
+{
+  (void)dout;
+  (void)sck;
+  (void)gain;
+}
+
+// DOUT goes low once a conversion has finished since the last read
+bool HX711::is_ready()
+{
+  if (levelDead)
+    return false;
+  return simNowUs() / SIM_HX711_PERIOD_US > lastReadUs / SIM_HX711_PERIOD_US;
+}
+
+long HX711::read()
+{
+  lastReadUs = simNowUs();
+  return levelSource != NULL ? levelSource() : 0;
+}
+
+long HX711::read_average(uint8_t times)
+{
+  (void)times;
+  return read();
+}
+
+/* --------------------  LCD  ---------------------- */
+static SimLcd lcdGlass;
+static uint8_t lcdCol = 0;
+static uint8_t lcdRow = 0;
+
+LiquidCrystal_I2C::LiquidCrystal_I2C(uint8_t address, uint8_t cols, uint8_t rows)
+{
+  (void)address;
+  (void)cols;
+  (void)rows;
+  memset(lcdGlass.cells, ' ', sizeof(lcdGlass.cells));
+}
+
+void LiquidCrystal_I2C::init()
+{
+  clear();
+  lcdGlass.backlight = false;
+}
+
+void LiquidCrystal_I2C::clear()
+{
+  memset(lcdGlass.cells, ' ', sizeof(lcdGlass.cells));
+  lcdCol = lcdRow = 0;
+  lcdGlass.version++;
+}
+
+void LiquidCrystal_I2C::setCursor(uint8_t col, uint8_t row)
+{
+  lcdCol = col;
+  lcdRow = row;
+}
+
+void LiquidCrystal_I2C::backlight()
+{
+  lcdGlass.backlight = true;
+  lcdGlass.version++;
+}
+
+void LiquidCrystal_I2C::noBacklight()
+{
+  lcdGlass.backlight = false;
+  lcdGlass.version++;
+}
+
+size_t LiquidCrystal_I2C::write(uint8_t c)
+{
+  if (lcdRow < SIM_LCD_ROWS && lcdCol < SIM_LCD_COLS)
+  {
+    lcdGlass.cells[lcdRow][lcdCol] = c;
+    lcdGlass.version++;
+  }
+  lcdCol++;
+  return 1;
+}
+
+const SimLcd &simLcd()
+{
+  return lcdGlass;
+}
+
+std::string simLcdRow(uint8_t row)
+{
+  return row < SIM_LCD_ROWS ? std::string(lcdGlass.cells[row], SIM_LCD_COLS) : std::string();
+}
+
+/* --------------------  WiFi  ---------------------- */
+static bool wifiUp = true;
+
+void simWifiSet(bool up)
+{
+  wifiUp = up;
+}
+
+wl_status_t WiFiClass::begin(const char *ssid, const char *password)
+{
+  (void)ssid;
+  (void)password;
+  return status();
+}
+
+wl_status_t WiFiClass::status()
+{
+  return wifiUp ? WL_CONNECTED : WL_DISCONNECTED;
+}
+
+IPAddress WiFiClass::localIP()
+{
+  return wifiUp ? IPAddress(192, 168, 1, 50) : IPAddress();
+}
+
+int8_t WiFiClass::RSSI()
+{
+  return wifiUp ? -55 : 0;
+}
+
+/* --------------------  Telegram  ---------------------- */
+struct ChatUpdate {
+  long updateId;
+  std::string chatId;
+  std::string text;
+};
+
+static std::deque<ChatUpdate> chatInbox;
+static long chatUpdateId = 0;
+static int chatMessageId = 0;
+static uint32_t chatSent = 0;
+static void (*chatListener)(const SimChatMessage &) = NULL;
+static void (*chatSending)() = NULL;
+
+void simTelegramInject(const char *chatId, const char *text)
+{
+  chatInbox.push_back({++chatUpdateId, chatId, text});
+  simWake(&chatInbox);
+}
+
+void simOnTelegramSend(void (*listener)(const SimChatMessage &message))
+{
+  chatListener = listener;
+}
+
+void simOnTelegramSending(void (*listener)())
+{
+  chatSending = listener;
+}
+
+uint32_t simTelegramSent()
+{
+  return chatSent;
+}
+
+UniversalTelegramBot::UniversalTelegramBot(const String &token, Client &client)
+{
+  (void)token;
+  (void)client;
+}
+
+bool UniversalTelegramBot::sendMessage(const String &chat_id, const String &text, const String &parse_mode, int message_id)
+{
+  (void)chat_id;
+  (void)parse_mode;
+  if (chatSending != NULL)
+    chatSending();
+  vTaskDelay(pdMS_TO_TICKS(SIM_TELEGRAM_LATENCY_MS));
+  if (!wifiUp)
+    return false;
+  int id = message_id != 0 ? message_id : ++chatMessageId;
+  last_sent_message_id = id;
+  chatSent++;
+  if (chatListener != NULL)
+    chatListener({simNowUs(), text.c_str(), id, message_id != 0});
+  return true;
+}
+
+// Long poll: held until a command arrives or longPoll seconds pass
+int UniversalTelegramBot::getUpdates(long offset)
+{
+  while (!chatInbox.empty() && chatInbox.front().updateId < offset)
+    chatInbox.pop_front();
+  uint64_t deadline = simNowUs() + (longPoll ? longPoll * 1000000ULL : waitForResponse * 1000ULL);
+  while (wifiUp && chatInbox.empty() && simWait(&chatInbox, deadline))
+  {
+  }
+  vTaskDelay(pdMS_TO_TICKS(SIM_TELEGRAM_LATENCY_MS));
+  if (!wifiUp || chatInbox.empty())
+    return 0;
+  const ChatUpdate &update = chatInbox.front();
+  telegramMessage &message = messages[0];
+  message = telegramMessage();
+  message.text = update.text;
+  message.chat_id = update.chatId;
+  message.from_id = update.chatId;
+  message.type = "message";
+  message.update_id = update.updateId;
+  last_message_received = update.updateId;
+  return 1;
+}
+
+/* --------------------  Network  ---------------------- */
+// Only the Telegram library would use these, and its host build does not
+esp_tls_t *esp_tls_init()
+{
+  return NULL;
+}
+
+int esp_tls_conn_new_sync(const char *host, int hostLen, int port, const esp_tls_cfg_t *cfg, esp_tls_t *tls)
+{
+  (void)host;
+  (void)hostLen;
+  (void)port;
+  (void)cfg;
+  (void)tls;
+  return -1;
+}
+
+ssize_t esp_tls_conn_write(esp_tls_t *tls, const void *data, size_t len)
+{
+  (void)tls;
+  (void)data;
+  (void)len;
+  return -1;
+}
+
+ssize_t esp_tls_conn_read(esp_tls_t *tls, void *data, size_t len)
+{
+  (void)tls;
+  (void)data;
+  (void)len;
+  return 0;
+}
+
+int esp_tls_conn_destroy(esp_tls_t *tls)
+{
+  (void)tls;
+  return 0;
+}
+
+ssize_t esp_tls_get_bytes_avail(esp_tls_t *tls)
+{
+  (void)tls;
+  return 0;
+}
+
+esp_err_t esp_tls_get_conn_sockfd(esp_tls_t *tls, int *sockfd)
+{
+  (void)tls;
+  *sockfd = -1;
+  return ESP_FAIL;
+}
+
+esp_tls_client_session_t *esp_tls_get_client_session(esp_tls_t *tls)
+{
+  (void)tls;
+  return NULL;
+}
+
+void esp_tls_free_client_session(esp_tls_client_session_t *session)
+{
+  (void)session;
+}
+
+/* --------------------  Preferences  ---------------------- */
+static std::map<std::string, std::vector<uint8_t>> nvs;
+
+bool Preferences::begin(const char *name, bool readOnly)
+{
+  space = name;
+  open = true;
+  this->readOnly = readOnly;
+  return true;
+}
+
+void Preferences::end()
+{
+  open = false;
+}
+
+bool Preferences::clear()
+{
+  if (!open || readOnly)
+    return false;
+  std::string prefix = space + "/";
+  for (auto it = nvs.begin(); it != nvs.end();)
+    it = it->first.compare(0, prefix.size(), prefix) == 0 ? nvs.erase(it) : std::next(it);
+  return true;
+}
+
+bool Preferences::remove(const char *key)
+{
+  return open && !readOnly && nvs.erase(space + "/" + key) > 0;
+}
+
+bool Preferences::load(const char *key, void *value, size_t size)
+{
+  auto it = nvs.find(space + "/" + key);
+  if (!open || it == nvs.end() || it->second.size() != size)
+    return false;
+  memcpy(value, it->second.data(), size);
+  return true;
+}
+
+size_t Preferences::store(const char *key, const void *value, size_t size)
+{
+  if (!open || readOnly)
+    return 0;
+  const uint8_t *bytes = (const uint8_t *)value;
+  nvs[space + "/" + key].assign(bytes, bytes + size);
+  return size;
+}
+
+/* --------------------  Serial  ---------------------- */
+static void (*serialListener)(const char *) = NULL;
+
+void simOnSerialLine(void (*listener)(const char *line))
+{
+  serialListener = listener;
+}
+
+size_t HardwareSerial::write(uint8_t c)
+{
+  if (c == '\n')
+  {
+    if (serialListener != NULL)
+      serialListener(line.c_str());
+    line.clear();
+  }
+  else if (c != '\r')
+  {
+    line += (char)c;
+  }
+  return 1;
+}
+
+/* --------------------  Boot  ---------------------- */
+void setup();
+void loop();
+
+static void loopTask(void *parameter)
+{
+  (void)parameter;
+  setup();
+  for (;;)
+    loop();
+}
+
+void simBoot()
+{
+  xTaskCreatePinnedToCore(loopTask, "loopTask", 8192, NULL, 1, NULL, 1);
+}
+/* --------------------  Simulation HAL (END)  ---------------------- */
@@ -0,0 +1,68 @@
+/* --------------------  Simulation HAL (START)  ----------------------
+Host backend of the hardware program.cpp talks to. The firmware keeps
+calling the Arduino and ESP-IDF APIs (digitalWrite, LEDC, PCNT, HX711,
+LiquidCrystal_I2C, UniversalTelegramBot, Preferences); on the ESP32 those
+are the real core and libraries, here sim_hal.cpp implements them against
+the simulation kernel. This header is the other side: what the machine
+model and the simulation driver see of the same hardware.
+
+  - pins: outputs latched by the firmware, inputs driven by the machine
+    (edges run the attached ISRs and feed the pulse counter); time only
+    moves between events, so the machine is told just before an output
+    changes and can bring itself up to that moment first
+  - the HX710B level sensor reads its counts from a source function, or
+    falls silent
+  - the 16x2 LCD glass, as the I2C writes left it
+  - a Telegram chat: messages the firmware sent, commands typed into it
+-------------------------------------------------------------------------- */
+#pragma once
+#include <Arduino.h>
+#include <string>
+
+#define SIM_PIN_COUNT 40            // ESP32 GPIO numbers 0..39
+#define SIM_LCD_COLS 16
+#define SIM_LCD_ROWS 2
+#define SIM_HX711_PERIOD_US 100000  // HX710B conversion period (10 Hz)
+#define SIM_TELEGRAM_LATENCY_MS 250 // Bot API round trip
+
+// Pins
+void simPinDrive(uint8_t pin, uint8_t level);        // Machine side: set an input, running ISRs and PCNT
+uint8_t simPinLevel(uint8_t pin);                    // Output latch or driven input level
+uint8_t simPwmDuty(uint8_t pin);                     // LEDC duty on the pin now, fades interpolated
+void simOnPinWrite(void (*listener)(uint8_t pin, uint8_t level)); // Called on every output change
+void simOnOutputChanging(void (*listener)());       // Called just before an output latch or LEDC duty changes
+
+// Level sensor
+void simLevelSource(int32_t (*source)());            // Raw HX710B counts for the next conversion
+void simLevelDead(bool dead);                        // DOUT held high: no conversion is ever ready
+
+// LCD
+struct SimLcd {
+  char cells[SIM_LCD_ROWS][SIM_LCD_COLS];
+  bool backlight;
+  uint32_t version;                 // Bumped on every write to the glass
+};
+const SimLcd &simLcd();
+std::string simLcdRow(uint8_t row);
+
+// Telegram chat
+struct SimChatMessage {
+  uint64_t atUs;                    // Virtual time the Bot API call completed
+  std::string text;
+  int messageId;
+  bool edit;                        // Edited an earlier message rather than posting
+};
+void simTelegramInject(const char *chatId, const char *text); // A user command, seen by the next getUpdates
+void simOnTelegramSend(void (*listener)(const SimChatMessage &message));
+void simOnTelegramSending(void (*listener)());       // A sendMessage call has just gone out
+uint32_t simTelegramSent();                          // Bot API sendMessage calls that succeeded
+
+// WiFi link, up at boot
+void simWifiSet(bool up);
+
+// Serial monitor, one call per line
+void simOnSerialLine(void (*listener)(const char *line));
+
+// Arduino app_main: start loopTask, which runs setup() and then loop() forever
+void simBoot();
+/* --------------------  Simulation HAL (END)  ---------------------- */
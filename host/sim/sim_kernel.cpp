@@ -0,0 +1,486 @@
+/* --------------------  Simulation Kernel (START)  ----------------------
+FreeRTOS tasks, queues, mutexes and notifications plus esp_timer on top of
+virtual time. See sim_kernel.h for the scheduling model.
+-------------------------------------------------------------------------- */
+#include <ucontext.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <deque>
+#include <string>
+#include <vector>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
+#include "sim_kernel.h"
+
+#define SIM_STACK_FILL 0xA5          // Stack paint for the high-water mark
+
+struct SimTask
+{
+  std::string name;
+  TaskFunction_t function;
+  void *parameter;
+  UBaseType_t priority;
+  ucontext_t context;
+  std::vector<uint8_t> stack;
+  bool ready;                        // Runnable (suspended tasks stay ready but are skipped)
+  bool suspended;
+  bool timedOut;                     // Last wait ended on its deadline
+  const void *waitOn;                // Object blocked on, NULL for a plain delay
+  uint64_t wakeAt;                   // Deadline of the current wait
+  uint64_t readyOrder;               // FIFO order among ready tasks of equal priority
+  uint32_t notifyValue;
+  uint32_t clockReads;               // Clock reads since the task last blocked
+};
+
+struct SimQueue
+{
+  size_t itemSize;
+  size_t length;
+  std::deque<std::vector<uint8_t>> items;
+};
+
+struct esp_timer
+{
+  esp_timer_cb_t callback;
+  void *arg;
+  std::string name;
+  uint64_t periodUs;                 // 0 = one-shot
+  uint64_t dueAt;
+  bool active;
+};
+
+static uint64_t nowUs = 0;
+static std::vector<SimTask *> tasks;
+static std::vector<esp_timer *> timers;
+static std::vector<SimStepHook> stepHooks;
+static uint64_t hooksDueAt = 0;      // Earliest time a step hook asked to run again
+static uint64_t maxStepUs = SIM_NEVER;
+static uint64_t steps = 0;
+static SimTask *running = NULL;
+static ucontext_t kernelContext;
+static uint64_t readyCounter = 0;
+static int isrDepth = 0;
+
+/* --------------------  Scheduling  ---------------------- */
+static void makeReady(SimTask *task)
+{
+  task->ready = true;
+  task->waitOn = NULL;
+  task->wakeAt = SIM_NEVER;
+  task->readyOrder = readyCounter++;
+}
+
+static void switchToKernel(SimTask *task)
+{
+  task->clockReads = 0;
+  swapcontext(&task->context, &kernelContext);
+}
+
+// The running task stays ready but lets equal and higher priorities go first
+static void yieldRunning()
+{
+  if (running == NULL || isrDepth > 0)
+    return;
+  running->readyOrder = readyCounter++;
+  switchToKernel(running);
+}
+
+static void taskEntry()
+{
+  SimTask *task = running;
+  task->function(task->parameter);
+  // FreeRTOS tasks must not return: park it for good
+  task->ready = false;
+  task->waitOn = task;
+  task->wakeAt = SIM_NEVER;
+  switchToKernel(task);
+}
+
+static SimTask *pickReady()
+{
+  SimTask *best = NULL;
+  for (SimTask *task : tasks)
+  {
+    if (!task->ready || task->suspended)
+      continue;
+    if (best == NULL || task->priority > best->priority ||
+        (task->priority == best->priority && task->readyOrder < best->readyOrder))
+      best = task;
+  }
+  return best;
+}
+
+// Nothing changes before the earliest deadline, so that is where time goes next
+static uint64_t nextEvent(uint64_t untilUs)
+{
+  uint64_t next = std::min(untilUs, hooksDueAt);
+  for (const esp_timer *timer : timers)
+  {
+    if (timer->active)
+      next = std::min(next, timer->dueAt);
+  }
+  for (const SimTask *task : tasks)
+  {
+    if (!task->ready)
+      next = std::min(next, task->wakeAt);
+  }
+  if (maxStepUs != SIM_NEVER)
+    next = std::min(next, nowUs + maxStepUs);
+  return std::max(next, nowUs + 1);
+}
+
+static void advance(uint64_t toUs)
+{
+  nowUs = toUs;
+  isrDepth++;
+  for (size_t i = 0; i < timers.size(); i++)
+  {
+    esp_timer *timer = timers[i];
+    while (timer->active && timer->dueAt <= nowUs)
+    {
+      if (timer->periodUs != 0)
+        timer->dueAt += timer->periodUs;
+      else
+        timer->active = false;
+      timer->callback(timer->arg);
+    }
+  }
+  hooksDueAt = SIM_NEVER;
+  for (SimStepHook hook : stepHooks)
+    hooksDueAt = std::min(hooksDueAt, hook(nowUs));
+  isrDepth--;
+  steps++;
+
+  for (SimTask *task : tasks)
+  {
+    if (!task->ready && task->wakeAt <= nowUs)
+    {
+      makeReady(task);
+      task->timedOut = true;
+    }
+  }
+}
+
+uint64_t simNowUs()
+{
+  return nowUs;
+}
+
+bool simInIsr()
+{
+  return running == NULL || isrDepth > 0;
+}
+
+void simClockRead()
+{
+  if (running != NULL && isrDepth == 0 && ++running->clockReads >= SIM_SPIN_READS)
+    simWait(NULL, nowUs + SIM_TICK_US);
+}
+
+bool simWait(const void *object, uint64_t deadlineUs)
+{
+  SimTask *task = running;
+  if (task == NULL || isrDepth > 0 || deadlineUs <= nowUs)
+    return false;
+  task->ready = false;
+  task->waitOn = object;
+  task->wakeAt = deadlineUs;
+  task->timedOut = false;
+  switchToKernel(task);
+  return !task->timedOut;
+}
+
+void simWake(const void *object)
+{
+  if (object == NULL)
+    return;
+  bool preempt = false;
+  for (SimTask *task : tasks)
+  {
+    if (!task->ready && task->waitOn == object)
+    {
+      makeReady(task);
+      task->timedOut = false;
+      if (running != NULL && task->priority > running->priority)
+        preempt = true;
+    }
+  }
+  if (preempt)
+    yieldRunning();
+}
+
+void simIsr(void (*isr)())
+{
+  isrDepth++;
+  isr();
+  isrDepth--;
+}
+
+void simOnStep(SimStepHook hook)
+{
+  stepHooks.push_back(hook);
+  hooksDueAt = nowUs;
+}
+
+void simMaxStep(uint64_t us)
+{
+  maxStepUs = us != 0 ? us : SIM_NEVER;
+}
+
+uint64_t simSteps()
+{
+  return steps;
+}
+
+bool simRun(uint64_t untilUs, bool (*done)())
+{
+  while (done == NULL || !done())
+  {
+    SimTask *task = pickReady();
+    if (task != NULL)
+    {
+      running = task;
+      swapcontext(&kernelContext, &task->context);
+      running = NULL;
+      continue;
+    }
+    if (nowUs >= untilUs)
+      return false;
+    advance(nextEvent(untilUs));
+  }
+  return true;
+}
+
+static uint64_t deadlineAfter(TickType_t ticks)
+{
+  return ticks == portMAX_DELAY ? SIM_NEVER : nowUs + (uint64_t)ticks * 1000 * portTICK_PERIOD_MS;
+}
+
+/* --------------------  Tasks  ---------------------- */
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char *name, uint32_t stackDepth,
+                                   void *parameter, UBaseType_t priority, TaskHandle_t *created, BaseType_t core)
+{
+  (void)stackDepth;
+  (void)core;
+  SimTask *task = new SimTask();
+  task->name = name;
+  task->function = function;
+  task->parameter = parameter;
+  task->priority = priority;
+  task->stack.assign(SIM_STACK_BYTES, SIM_STACK_FILL);
+  getcontext(&task->context);
+  task->context.uc_stack.ss_sp = task->stack.data();
+  task->context.uc_stack.ss_size = task->stack.size();
+  task->context.uc_link = NULL;
+  makecontext(&task->context, taskEntry, 0);
+  makeReady(task);
+  tasks.push_back(task);
+  if (created != NULL)
+    *created = task;
+  if (running != NULL && isrDepth == 0 && priority > running->priority)
+    yieldRunning();
+  return pdPASS;
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+  if (ticks == 0)
+    yieldRunning();
+  else
+    simWait(NULL, deadlineAfter(ticks));
+}
+
+void vTaskDelayUntil(TickType_t *previousWake, TickType_t increment)
+{
+  TickType_t now = xTaskGetTickCount();
+  *previousWake += increment;
+  int32_t ahead = (int32_t)(*previousWake - now);
+  if (ahead > 0)
+    simWait(NULL, deadlineAfter(ahead));
+  else
+    yieldRunning();
+}
+
+TickType_t xTaskGetTickCount()
+{
+  return (TickType_t)(nowUs / (1000 * portTICK_PERIOD_MS));
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle()
+{
+  return running;
+}
+
+void vTaskSuspend(TaskHandle_t task)
+{
+  if (task == NULL)
+    task = running;
+  task->suspended = true;
+  if (task == running && isrDepth == 0)
+    switchToKernel(task);
+}
+
+void vTaskResume(TaskHandle_t task)
+{
+  task->suspended = false;
+  if (running != NULL && isrDepth == 0 && task->ready && task->priority > running->priority)
+    yieldRunning();
+}
+
+// Bytes of the host stack never touched; the ESP32 figure differs, the trend does not
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task)
+{
+  if (task == NULL)
+    task = running;
+  size_t untouched = 0;
+  while (untouched < task->stack.size() && task->stack[untouched] == SIM_STACK_FILL)
+    untouched++;
+  return untouched;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t ticks)
+{
+  SimTask *task = running;
+  uint64_t deadline = deadlineAfter(ticks);
+  while (task->notifyValue == 0 && simWait(&task->notifyValue, deadline))
+  {
+  }
+  uint32_t value = task->notifyValue;
+  if (value != 0)
+    task->notifyValue = clearOnExit ? 0 : value - 1;
+  return value;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+  task->notifyValue++;
+  simWake(&task->notifyValue);
+  return pdPASS;
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t *higherPriorityTaskWoken)
+{
+  bool waiting = !task->ready && task->waitOn == &task->notifyValue;
+  task->notifyValue++;
+  simWake(&task->notifyValue);
+  if (higherPriorityTaskWoken != NULL && waiting)
+    *higherPriorityTaskWoken = pdTRUE;
+}
+
+/* --------------------  Queues and Mutexes  ---------------------- */
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize)
+{
+  SimQueue *queue = new SimQueue();
+  queue->itemSize = itemSize;
+  queue->length = length;
+  return queue;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex()
+{
+  // A taken mutex is an empty queue; give posts the token back
+  SemaphoreHandle_t mutex = xQueueCreate(1, 0);
+  xQueueSend(mutex, NULL, 0);
+  return mutex;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks)
+{
+  uint64_t deadline = deadlineAfter(ticks);
+  while (queue->items.size() >= queue->length)
+  {
+    if (!simWait(&queue->length, deadline))
+      return errQUEUE_FULL;
+  }
+  const uint8_t *bytes = (const uint8_t *)item;
+  queue->items.emplace_back(bytes, bytes + queue->itemSize);
+  simWake(&queue->items);
+  return pdPASS;
+}
+
+BaseType_t xQueueSendFromISR(QueueHandle_t queue, const void *item, BaseType_t *higherPriorityTaskWoken)
+{
+  BaseType_t sent = xQueueSend(queue, item, 0);
+  if (sent == pdPASS && higherPriorityTaskWoken != NULL)
+    *higherPriorityTaskWoken = pdTRUE;
+  return sent;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks)
+{
+  uint64_t deadline = deadlineAfter(ticks);
+  while (queue->items.empty())
+  {
+    if (!simWait(&queue->items, deadline))
+      return pdFALSE;
+  }
+  if (queue->itemSize != 0)
+    memcpy(item, queue->items.front().data(), queue->itemSize);
+  queue->items.pop_front();
+  simWake(&queue->length);
+  return pdTRUE;
+}
+
+BaseType_t xQueueReset(QueueHandle_t queue)
+{
+  queue->items.clear();
+  simWake(&queue->length);
+  return pdPASS;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue)
+{
+  return queue->items.size();
+}
+
+/* --------------------  esp_timer  ---------------------- */
+esp_err_t esp_timer_create(const esp_timer_create_args_t *args, esp_timer_handle_t *timer)
+{
+  esp_timer *created = new esp_timer();
+  created->callback = args->callback;
+  created->arg = args->arg;
+  created->name = args->name ? args->name : "";
+  timers.push_back(created);
+  *timer = created;
+  return ESP_OK;
+}
+
+static esp_err_t timerStart(esp_timer_handle_t timer, uint64_t delayUs, uint64_t periodUs)
+{
+  if (timer->active)
+    return ESP_ERR_INVALID_STATE;
+  timer->active = true;
+  timer->periodUs = periodUs;
+  timer->dueAt = nowUs + delayUs;
+  return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeoutUs)
+{
+  return timerStart(timer, timeoutUs, 0);
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t periodUs)
+{
+  return timerStart(timer, periodUs, periodUs);
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer)
+{
+  if (!timer->active)
+    return ESP_ERR_INVALID_STATE;
+  timer->active = false;
+  return ESP_OK;
+}
+
+int64_t esp_timer_get_time()
+{
+  simClockRead();
+  return nowUs;
+}
+/* --------------------  Simulation Kernel (END)  ---------------------- */
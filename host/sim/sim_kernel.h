@@ -0,0 +1,55 @@
+/* --------------------  Simulation Kernel (START)  ----------------------
+Virtual time and a cooperative FreeRTOS, so the firmware's tasks run
+unchanged on Linux. Each task is a ucontext coroutine with its own stack
+and exactly one runs at a time: the highest-priority ready task keeps the
+CPU until it blocks (a delay, a queue, a notification or a mutex) or wakes
+a task of higher priority.
+
+Time is discrete-event: when every task is blocked nothing can happen
+before the next deadline, so the kernel jumps straight to the earliest of
+the task timeouts, the esp_timer due times and the time the step hooks
+asked for. There it fires due esp_timers, runs the step hooks (the machine
+model, the simulated operator) and wakes tasks whose timeout has passed.
+millis(), micros(), delay(), vTaskDelay() and esp_timer all read and wait
+on this one clock, so a 45 minute program runs in a fraction of a second.
+simMaxStep() caps the jump, down to SIM_TICK_US for the fixed one-tick
+stepping of a real FreeRTOS tick interrupt, to check a result does not
+depend on the stepping.
+
+Timer callbacks, GPIO ISRs and tick hooks run in ISR context on the
+kernel's own stack: calls that would block fail at once instead, as they do
+in an ISR on the chip. esp_timer callbacks may not block on the chip either
+(the firmware only uses non-blocking calls in them), so the difference from
+the real ESP_TIMER_TASK dispatch does not show.
+
+A task that polls the clock without ever blocking would stop virtual time
+for good; after SIM_SPIN_READS clock reads it is put to sleep for a tick,
+standing in for the CPU time the loop burns (busy-waits are the one case
+that still advances one tick at a time).
+-------------------------------------------------------------------------- */
+#pragma once
+#include <stdint.h>
+
+#define SIM_TICK_US 1000            // One FreeRTOS tick
+#define SIM_NEVER UINT64_MAX        // No deadline
+#define SIM_SPIN_READS 1000         // Clock reads without blocking that count as a busy-wait
+#define SIM_STACK_BYTES (256 * 1024) // Host stack per task (the firmware's ESP32 sizes are far too small here)
+
+// Runs after every time step; returns the latest time it must run next (SIM_NEVER: no need)
+typedef uint64_t (*SimStepHook)(uint64_t nowUs);
+
+uint64_t simNowUs();                                 // Virtual time since boot
+bool simInIsr();                                     // Running a timer callback, GPIO ISR or tick hook
+void simClockRead();                                 // Busy-wait guard, called by the clock getters
+
+// Task side: block the running task until simWake(object) or deadlineUs.
+// False on timeout, or at once from ISR context or with a deadline already passed.
+bool simWait(const void *object, uint64_t deadlineUs);
+void simWake(const void *object);                    // Ready every task waiting on object
+void simIsr(void (*isr)());                          // Call isr in ISR context (GPIO interrupts)
+
+void simOnStep(SimStepHook hook);                    // Run hook at every time step, after the timers
+void simMaxStep(uint64_t us);                        // Longest jump of virtual time (default SIM_NEVER)
+bool simRun(uint64_t untilUs, bool (*done)());       // Schedule until done() (true) or untilUs (false)
+uint64_t simSteps();                                 // Time steps taken so far
+/* --------------------  Simulation Kernel (END)  ---------------------- */
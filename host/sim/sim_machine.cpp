@@ -0,0 +1,272 @@
+/* --------------------  Machine Model (START)  ----------------------
+See sim_machine.h. Units: litres, seconds, rpm.
+-------------------------------------------------------------------------- */
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <random>
+#include "sim_kernel.h"
+#include "sim_hal.h"
+#include "sim_machine.h"
+
+#define WASH_RPM_PER_DUTY 0.6       // Pulsator gearing: duty 200 -> 120 rpm
+#define WASH_TAU_S 0.35             // Pulsator spin-up time constant in water
+#define WASH_COAST_TAU_S 0.6        // Pulsator coast-down, dragged by the water
+#define SPIN_TAU_S 2.0              // Empty drum spin-up time constant
+#define SPIN_COAST_TAU_S 6.0        // Drum coast-down
+#define SPIN_TAU_PER_KG 0.1         // Extra inertia per kg of wet load (fraction)
+#define STOP_RPM 1.0                // Below this the drum is at rest
+#define SOAK_TAU_S 90.0             // Laundry soaking up water, standing
+#define SOAK_AGITATED_TAU_S 20.0    // ... and while agitated
+#define EXTRACT_TAU_S 15.0          // Laundry giving water up above its spin equilibrium
+#define EXTRACT_FULL_RPM 800.0      // Speed at which extraction reaches its floor
+#define EXTRACT_FLOOR 0.35          // Water a fully spun load still holds (fraction of soaked)
+#define SLOSH_HZ 0.8                // Surface wave under agitation
+#define SLOSH_FRACTION 0.02         // Slosh amplitude per litre at agitation speed
+#define MODEL_STEP_US 20000         // Longest step while the drum moves or is driven
+
+static const MachineConfig defaults = {
+  0.12f,  // inflowLps: 7.2 L/min
+  400,    // hoseDrainMs
+  0.06f,  // drainCoeff: 40 L drains in about 3.5 minutes
+  3.0f,   // loadKg
+  1.5f,   // absorbLPerKg
+  0.03f,  // unbalance: the load's own share of the ripple, well inside the threshold
+  0.03f,  // levelNoiseL
+  1,      // seed
+};
+
+// Spin clutch: inverter duty to drum rpm (dead band, then the V/f curve under load)
+static const float spinCurve[][2] = {{20, 0}, {35, 95}, {42, 390}, {50, 610}, {80, 900}, {255, 1000}};
+
+static const uint8_t relayPins[6] = {MACHINE_INV_PW, MACHINE_DM_WASH, MACHINE_DM_SPIN,
+                                     MACHINE_IV, MACHINE_CO1, MACHINE_CO2};
+
+static MachineConfig config;
+static MachineState state;
+static std::mt19937 rng;
+static std::normal_distribution<double> noise(0, 1);
+static double velocity = 0;         // Signed drum speed (rpm)
+static uint64_t lastUs = 0;
+static bool faults[MACHINE_FAULTS];
+static int32_t stuckRaw = 0;        // FAULT_LEVEL_STUCK: the counts the sensor keeps giving
+
+const MachineConfig &machineDefaults()
+{
+  return defaults;
+}
+
+const MachineState &machineState()
+{
+  return state;
+}
+
+static double spinRpm(uint8_t duty)
+{
+  const int points = sizeof(spinCurve) / sizeof(spinCurve[0]);
+  if (duty <= spinCurve[0][0])
+    return 0;
+  for (int i = 1; i < points; i++)
+  {
+    if (duty <= spinCurve[i][0])
+    {
+      double t = (duty - spinCurve[i - 1][0]) / (spinCurve[i][0] - spinCurve[i - 1][0]);
+      return spinCurve[i - 1][1] + t * (spinCurve[i][1] - spinCurve[i - 1][1]);
+    }
+  }
+  return spinCurve[points - 1][1];
+}
+
+static void onPinWrite(uint8_t pin, uint8_t level)
+{
+  for (int i = 0; i < 6; i++)
+  {
+    if (relayPins[i] == pin)
+      state.relaySwitches[i]++;
+  }
+  if ((pin == MACHINE_CO1 || pin == MACHINE_CO2) &&
+      simPinLevel(MACHINE_INV_PW) == HIGH && simPwmDuty(MACHINE_CTR_SIG) > 0)
+    state.changeoverUnderLoad++;
+  if (pin == MACHINE_IV && level == LOW)
+    state.ivClosedUs = simNowUs();
+}
+
+static bool drumDriven()
+{
+  bool co1 = simPinLevel(MACHINE_CO1) == HIGH;
+  bool co2 = simPinLevel(MACHINE_CO2) == HIGH;
+  return simPinLevel(MACHINE_INV_PW) == HIGH && co1 == co2 && simPwmDuty(MACHINE_CTR_SIG) > 0;
+}
+
+static double turnRate()
+{
+  return state.rpm * (1 + config.unbalance * sin(2 * M_PI * state.turns)) / 60;
+}
+
+static void stepDrum(double dt)
+{
+  bool spinGear = simPinLevel(MACHINE_DM_SPIN) == HIGH;
+  uint8_t duty = simPwmDuty(MACHINE_CTR_SIG);
+
+  // CO1 and CO2 swap two motor phases together; one without the other leaves it unpowered
+  bool driven = drumDriven();
+  double target = 0;
+  double tau = spinGear ? SPIN_COAST_TAU_S : WASH_COAST_TAU_S;
+  if (driven)
+  {
+    state.direction = simPinLevel(MACHINE_CO1) == HIGH ? -1 : 1;
+    target = state.direction * (spinGear ? spinRpm(duty) : duty * WASH_RPM_PER_DUTY);
+    tau = spinGear ? SPIN_TAU_S * (1 + SPIN_TAU_PER_KG * (config.loadKg + state.heldL)) : WASH_TAU_S;
+  }
+  velocity += (target - velocity) * (1 - exp(-dt / tau));
+  if ((!driven && fabs(velocity) < STOP_RPM) || faults[FAULT_ROTOR_LOCKED])
+    velocity = 0;
+  state.rpm = fabs(velocity);
+  if (state.rpm > state.peakRpm)
+    state.peakRpm = state.rpm;
+
+  // The heavy side slows the drum on the way up and speeds it on the way down
+  double halfPulsesBefore = floor(state.turns * MACHINE_PULSES_PER_REV * 2);
+  state.turns += turnRate() * dt;
+  double halfPulsesAfter = floor(state.turns * MACHINE_PULSES_PER_REV * 2);
+  for (double half = halfPulsesBefore + 1; half <= halfPulsesAfter; half++)
+  {
+    bool rising = fmod(half, 2) == 0;
+    simPinDrive(MACHINE_FB_SIG, rising ? HIGH : LOW);
+    if (rising)
+      state.pulses++;
+  }
+}
+
+static void stepWater(uint64_t fromUs, uint64_t toUs)
+{
+  double dt = (toUs - fromUs) / 1e6;
+  bool spinGear = simPinLevel(MACHINE_DM_SPIN) == HIGH;
+
+  // Inflow runs while IV is open and for the hose's tail after it closes
+  uint64_t inflowEnd = simPinLevel(MACHINE_IV) == HIGH ? toUs
+                     : state.ivClosedUs != 0 ? std::min<uint64_t>(toUs, state.ivClosedUs + config.hoseDrainMs * 1000ULL) : 0;
+  if (faults[FAULT_VALVE_STUCK_OPEN])
+    inflowEnd = toUs;
+  if (faults[FAULT_VALVE_STUCK_CLOSED])
+    inflowEnd = 0;
+  if (inflowEnd > fromUs)
+  {
+    double in = config.inflowLps * (inflowEnd - fromUs) / 1e6;
+    state.tubL += in;
+    state.inletL += in;
+  }
+
+  if (spinGear && state.tubL > 0 && !faults[FAULT_DRAIN_STALL])
+  {
+    double out = fmin(state.tubL, config.drainCoeff * sqrt(state.tubL) * dt);
+    state.tubL -= out;
+    state.drainedL += out;
+  }
+
+  double soaked = config.loadKg * config.absorbLPerKg;
+  if (!spinGear && state.heldL < soaked && state.tubL > 0)
+  {
+    double tau = state.rpm > 10 ? SOAK_AGITATED_TAU_S : SOAK_TAU_S;
+    double take = fmin(state.tubL, (soaked - state.heldL) * (1 - exp(-dt / tau)));
+    state.tubL -= take;
+    state.heldL += take;
+  }
+  if (spinGear)
+  {
+    double keep = soaked * fmax(EXTRACT_FLOOR, 1 - state.rpm / EXTRACT_FULL_RPM);
+    if (state.heldL > keep)
+    {
+      double release = (state.heldL - keep) * (1 - exp(-dt / EXTRACT_TAU_S));
+      state.heldL -= release;
+      state.tubL += release;
+    }
+  }
+}
+
+// Brings the model up to nowUs in steps short enough for its first-order
+// updates; the outputs are the ones latched since the last call
+static void catchUp(uint64_t nowUs)
+{
+  while (lastUs < nowUs)
+  {
+    uint64_t to = std::min(nowUs, lastUs + MODEL_STEP_US);
+    stepWater(lastUs, to);
+    stepDrum((to - lastUs) / 1e6);
+    lastUs = to;
+  }
+}
+
+static void onOutputChanging()
+{
+  catchUp(simNowUs());
+}
+
+static int32_t levelRaw()
+{
+  catchUp(simNowUs());
+  if (faults[FAULT_LEVEL_STUCK])
+    return stuckRaw;
+  double seconds = simNowUs() / 1e6;
+  double sigma = faults[FAULT_LEVEL_NOISY] ? std::max(config.levelNoiseL, MACHINE_NOISY_LEVEL_L) : config.levelNoiseL;
+  double litres = state.tubL + sigma * noise(rng);
+  if (simPinLevel(MACHINE_DM_SPIN) == LOW && state.rpm > 5)
+    litres += SLOSH_FRACTION * state.tubL * (state.rpm / 120) * sin(2 * M_PI * SLOSH_HZ * seconds);
+  return (int32_t)lround((litres + MACHINE_LEVEL_OFFSET) * MACHINE_LEVEL_MULTIPLIER * MACHINE_HX711_SCALE);
+}
+
+// Between outputs changing and level reads nothing needs the model, except
+// FB_SIG: while the drum turns the next step lands on its next edge
+static uint64_t machineStep(uint64_t nowUs)
+{
+  catchUp(nowUs);
+  if ((!drumDriven() && state.rpm == 0) || faults[FAULT_ROTOR_LOCKED])
+    return SIM_NEVER;
+  uint64_t next = nowUs + MODEL_STEP_US;
+  double rate = turnRate();
+  if (rate > 0)
+  {
+    double halves = state.turns * MACHINE_PULSES_PER_REV * 2;
+    double toEdgeS = (floor(halves) + 1 - halves) / (MACHINE_PULSES_PER_REV * 2) / rate;
+    next = std::min(next, nowUs + (uint64_t)ceil(toEdgeS * 1e6));
+  }
+  return next;
+}
+
+void machineButton(uint8_t pin, bool pressed)
+{
+  simPinDrive(pin, pressed ? LOW : HIGH);
+}
+
+void machineFault(MachineFault fault, bool active)
+{
+  catchUp(simNowUs());
+  if (fault == FAULT_LEVEL_STUCK && active && !faults[fault])
+    stuckRaw = levelRaw();
+  faults[fault] = active;
+}
+
+bool machineFaulty(MachineFault fault)
+{
+  return faults[fault];
+}
+
+void machineBegin(const MachineConfig &machineConfig)
+{
+  config = machineConfig;
+  state = MachineState();
+  state.direction = 1;
+  rng.seed(config.seed);
+  velocity = 0;
+  lastUs = simNowUs();
+  memset(faults, 0, sizeof(faults));
+
+  const uint8_t buttons[] = {MACHINE_WASH_BTN, MACHINE_RINSE_BTN, MACHINE_SPIN_BTN, MACHINE_COMP_BTN, MACHINE_HALT_BTN};
+  for (uint8_t pin : buttons)
+    simPinDrive(pin, HIGH);
+  simOnPinWrite(onPinWrite);
+  simOnOutputChanging(onOutputChanging);
+  simLevelSource(levelRaw);
+  simOnStep(machineStep);
+}
+/* --------------------  Machine Model (END)  ---------------------- */
@@ -0,0 +1,96 @@
+/* --------------------  Machine Model (START)  ----------------------
+The plant behind the firmware's pins. It is brought up to the current time
+whenever an output is about to change, the level sensor is read, or a
+time step lands; while the drum turns it asks for a step at every FB_SIG
+edge, otherwise it costs nothing while the firmware waits:
+
+  - tub water: IV inflow from mains (plus the hose still draining for a
+    moment after the valve closes) and the drain valve, which the drain
+    motor pulls open in its spin position (DM_SPIN); outflow falls with
+    the head, so a drain tails off the way a real one does
+  - laundry that soaks up water while it is wet and gives it back to the
+    sump as the spin speed rises
+  - the drum: inverter on INV_PW, speed set by the CTR_SIG duty through the
+    pulsator gearing in wash and direct drive once DM_SPIN engages the spin
+    clutch; first-order inertia that grows with the wet load, coast-down
+    when the drive is cut, direction from the CO1/CO2 changeover pair
+  - FB_SIG: DRUM_PULSES_PER_REV pulses per revolution, with a once-per-rev
+    speed ripple from an uneven load
+  - the HX710B: tub water as raw counts through the firmware's calibration,
+    with slosh while agitating and sensor noise
+  - buttons, pressed and released by the simulation driver
+  - faults the driver injects into the plant (machineFault): a valve stuck
+    either way, a stalled drain pump, a jammed drum, a level sensor stuck
+    on one reading or drowned in noise
+
+Pin numbers and calibration mirror section 1 of program.cpp.
+-------------------------------------------------------------------------- */
+#pragma once
+#include <stdint.h>
+
+// program.cpp pins
+#define MACHINE_FB_SIG 5
+#define MACHINE_CTR_SIG 18
+#define MACHINE_INV_PW 32
+#define MACHINE_DM_WASH 25
+#define MACHINE_DM_SPIN 27
+#define MACHINE_IV 14
+#define MACHINE_CO1 26
+#define MACHINE_CO2 33
+#define MACHINE_WASH_BTN 2
+#define MACHINE_RINSE_BTN 0
+#define MACHINE_SPIN_BTN 35
+#define MACHINE_COMP_BTN 12
+#define MACHINE_HALT_BTN 34
+
+// program.cpp calibration: litres = raw / scale / multiplier - offset
+#define MACHINE_HX711_SCALE 3100
+#define MACHINE_LEVEL_MULTIPLIER 27
+#define MACHINE_LEVEL_OFFSET 10
+#define MACHINE_PULSES_PER_REV 2
+
+#define MACHINE_NOISY_LEVEL_L 1.5f  // FAULT_LEVEL_NOISY sensor noise (litres rms)
+
+struct MachineConfig {
+  float inflowLps;                  // IV open at mains pressure (L/s)
+  uint32_t hoseDrainMs;             // Inflow carrying on after IV closes
+  float drainCoeff;                 // Outflow = drainCoeff * sqrt(litres) (L/s)
+  float loadKg;                     // Dry laundry
+  float absorbLPerKg;               // Water a kilogram of laundry holds when soaked
+  float unbalance;                  // Once-per-rev speed ripple from an uneven load (fraction)
+  float levelNoiseL;                // HX710B noise (litres rms)
+  uint32_t seed;                    // Noise seed, for repeatable runs
+};
+
+struct MachineState {
+  double tubL;                      // Free water the level sensor sees
+  double heldL;                     // Water soaked up by the laundry
+  double inletL;                    // Total through IV
+  double drainedL;                  // Total through the drain valve
+  double rpm;                       // Drum speed (magnitude)
+  int direction;                    // +1 forward (CO1/CO2 off), -1 reverse (both on)
+  double turns;                     // Revolutions since boot, drives FB_SIG
+  double peakRpm;
+  uint32_t pulses;                  // FB_SIG rising edges
+  uint64_t ivClosedUs;              // When IV last closed (hose still draining)
+  uint32_t relaySwitches[6];        // INV_PW, DM_WASH, DM_SPIN, IV, CO1, CO2
+  uint32_t changeoverUnderLoad;     // CO1/CO2 switched with the inverter driving
+};
+
+enum MachineFault : uint8_t {
+  FAULT_VALVE_STUCK_OPEN,           // IV passes water whatever its coil does
+  FAULT_VALVE_STUCK_CLOSED,         // ... or none at all
+  FAULT_DRAIN_STALL,                // Drain pump stalled or outlet blocked: no outflow
+  FAULT_ROTOR_LOCKED,               // Drum jammed: no rotation, no FB_SIG pulses
+  FAULT_LEVEL_STUCK,                // HX710B repeats the counts it had when the fault struck
+  FAULT_LEVEL_NOISY,                // HX710B noise raised to MACHINE_NOISY_LEVEL_L
+  MACHINE_FAULTS
+};
+
+const MachineConfig &machineDefaults();
+void machineBegin(const MachineConfig &config); // Hooks the model into the HAL and the kernel steps
+const MachineState &machineState();
+void machineButton(uint8_t pin, bool pressed);  // Operator: hold a button down or let go
+void machineFault(MachineFault fault, bool active); // Break (or mend) part of the plant from now on
+bool machineFaulty(MachineFault fault);
+/* --------------------  Machine Model (END)  ---------------------- */
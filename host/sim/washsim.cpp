@@ -0,0 +1,871 @@
+/* --------------------  Wash Simulator (START)  ----------------------
+Runs program.cpp on the host against the machine model: boots the firmware,
+presses a program button the way a user would, answers the balance prompt
+and reports what the cycle did. Virtual time skips from event to event, so
+a Complete program takes well under a second and a batch of thousands of
+cycles, or a sweep of one machine parameter, is a regression run.
+
+Usage:  washsim [options] [wash|rinse|spin|complete]     (default complete)
+  --load KG        dry laundry (default 3)
+  --unbalance F    once-per-rev speed ripple of the load (default 0.03)
+  --seed N         sensor noise seed (default 1)
+  --limit MIN      give up after this much virtual time per program (default 180)
+  --cmd SEC:TEXT   type TEXT into the Telegram chat SEC seconds after boot
+  --lcd            print every new LCD frame
+  --telegram       print every message the firmware sends
+  --serial         print the serial monitor
+  --max-step MS    cap each jump of virtual time (1 = fixed FreeRTOS ticks)
+  --repeat N       run the program N times in a row on one boot
+  --ping SEC       every SEC while a program runs, send a command the
+                   firmware always answers (for the command_reply probe)
+  --trace FILE     write the firmware's actuator trace ("ACT,..." serial
+                   lines) to FILE, for trace_diff against host/golden
+
+Built as washbench (LATENCY_PROBES=1), the firmware times its control
+paths and the run ends with their p50 / p99 / max in virtual time. That
+is scheduling latency: tick periods, debounce, queue hops and polls, with
+no CPU time, so a structural regression shows up as a number here.
+
+Fault injection: break part of the machine while the program runs and
+time how the firmware copes. A fault strikes when its trigger first
+happens after the program starts: start, fill (IV opens), drain (DM_SPIN
+engages), drive (the inverter is driven), send (a Telegram call is in
+flight) or a number of seconds. It stays until the end of the run.
+  --fault F[@T]    inject fault F (table below) at trigger T, by default the
+                   moment it hurts most
+  --faults         every fault under every program, in parallel; per run the
+                   time from the fault to the firmware's first notice of it
+                   (a "Fault" screen, a fault or feedback-unavailable
+                   message) and to a safe state, on stdout as CSV and on
+                   stderr as a table
+    valve-open     IV stuck open (@fill)      safe: drum stopped, drain open
+    valve-closed   IV stuck closed (@start)
+    pump-stall     no drain outflow (@drain)
+    level-dead     HX710B never ready (@fill)
+    level-stuck    HX710B frozen on one reading (@fill)
+    level-noisy    HX710B noise raised to 1.5 L rms (@start)
+    wifi-drop      link lost for 60 s mid-send (@send)
+                                              safe: a message delivered again
+    rotor-locked   drum jammed (@drive)
+  Safe, unless noted: the program stopped, the inverter off, IV closed and
+  the drum at rest, from then to the end of the run. A fault whose
+  trigger never comes is not injected.
+
+Batch runs, one forked process per cycle (the firmware's globals start
+fresh in each), one CSV line per cycle on stdout and a summary on stderr:
+  --runs N         cycles per setting, seeds N consecutive from --seed
+  --sweep P=A:B:S  repeat for machine parameter P from A to B in steps of S
+                   (load, unbalance, inflow, drain, absorb, noise)
+  --jobs N         cycles in parallel (default: one per CPU)
+
+Exit status 0 when every program ran to completion (or, with a fault, to
+a stop), 1 when one did not.
+-------------------------------------------------------------------------- */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "sim_kernel.h"
+#include "sim_hal.h"
+#include "sim_machine.h"
+
+namespace firmware
+{
+#include "credentials.h"            // CHAT_ID: the chat the firmware answers
+}
+
+#define BOOT_SETTLE_MS 6000         // Splash screen and WiFi before the user walks up
+#define PRESS_MS 300                // How long a button is held
+#define PROMPT_REACTION_MS 3000     // User reading "Press Start" and checking the load
+#define FLUSH_MS 10000              // Outbox still sending after the cycle ends
+#define PING_COMMAND "/engineering" // Refused while a program runs, with a reply
+#define WIFI_DROP_MS 60000          // wifi-drop: how long the link stays down
+
+extern bool programRunning;         // program.cpp: a cycle is active
+
+struct Program {
+  const char *name;
+  uint8_t button;
+};
+
+static const Program programs[] = {
+  {"wash", MACHINE_WASH_BTN},
+  {"rinse", MACHINE_RINSE_BTN},
+  {"spin", MACHINE_SPIN_BTN},
+  {"complete", MACHINE_COMP_BTN},
+};
+
+// Machine parameters --sweep can vary
+struct SweepParam {
+  const char *name;
+  float MachineConfig::*field;
+};
+
+static const SweepParam sweepParams[] = {
+  {"load", &MachineConfig::loadKg},
+  {"unbalance", &MachineConfig::unbalance},
+  {"inflow", &MachineConfig::inflowLps},
+  {"drain", &MachineConfig::drainCoeff},
+  {"absorb", &MachineConfig::absorbLPerKg},
+  {"noise", &MachineConfig::levelNoiseL},
+};
+
+enum FaultTrigger : uint8_t {
+  AT_START,
+  AT_FILL,
+  AT_DRAIN,
+  AT_DRIVE,
+  AT_SEND,
+  AT_SECONDS,
+};
+
+static const char *const triggerNames[] = {"start", "fill", "drain", "drive", "send", "seconds"};
+
+// The HX710B and the WiFi link live in the HAL, the rest in the machine model
+enum HalFault : uint8_t {
+  HAL_LEVEL_DEAD = MACHINE_FAULTS,
+  HAL_WIFI_DROP,
+};
+
+struct Fault {
+  const char *name;
+  uint8_t kind;                     // MachineFault or HalFault
+  FaultTrigger trigger;             // When it strikes unless --fault says otherwise
+};
+
+static const Fault faults[] = {
+  {"valve-open", FAULT_VALVE_STUCK_OPEN, AT_FILL},
+  {"valve-closed", FAULT_VALVE_STUCK_CLOSED, AT_START},
+  {"pump-stall", FAULT_DRAIN_STALL, AT_DRAIN},
+  {"level-dead", HAL_LEVEL_DEAD, AT_FILL},
+  {"level-stuck", FAULT_LEVEL_STUCK, AT_FILL},
+  {"level-noisy", FAULT_LEVEL_NOISY, AT_START},
+  {"wifi-drop", HAL_WIFI_DROP, AT_SEND},
+  {"rotor-locked", FAULT_ROTOR_LOCKED, AT_DRIVE},
+};
+
+struct FaultPlan {
+  const Fault *fault;               // NULL: none
+  FaultTrigger trigger;
+  uint64_t afterUs;                 // AT_SECONDS: program time
+};
+
+struct Press {
+  uint8_t pin;
+  uint64_t downAt;
+  uint64_t upAt;
+  bool down;
+};
+
+struct Command {
+  uint64_t atUs;
+  std::string text;
+};
+
+// What one cycle did; a forked run sends it back to the batch as is
+struct RunResult {
+  bool started;
+  bool completed;
+  double cycleMin;
+  double wallS;
+  double inletL;
+  double drainedL;
+  double heldL;
+  double peakRpm;
+  uint32_t changeoverUnderLoad;
+  uint32_t balancePrompts;
+  uint32_t messages;
+  uint64_t steps;
+  uint32_t programs;                // Programs completed (--repeat)
+  bool faultStop;                   // The firmware stopped the program on a fault
+  double injectS;                   // Program time the fault struck (-1: its trigger never came)
+  double detectS;                   // Fault to the firmware's first notice of it (-1: none)
+  double safeS;                     // Fault to a safe state (-1: never reached)
+  char notice[64];                  // That notice
+};
+
+// "LATENCY,<path>,<samples>,<p50>,<p99>,<max>" from the firmware's serial
+struct LatencyLine {
+  std::string path;
+  unsigned samples, p50, p99, maxUs;
+};
+
+static std::vector<Press> presses;
+static std::vector<Command> commands;
+static bool printLcd = false;
+static bool printTelegram = false;
+static bool printSerial = false;
+static uint64_t startedUs = 0;
+static uint64_t finishedUs = 0;
+static uint32_t lcdVersion = 0;
+static std::string lcdShown[SIM_LCD_ROWS];
+static uint32_t balancePrompts = 0;
+static const Program *running = NULL;
+static uint32_t repeats = 1;
+static uint32_t programsDone = 0;
+static bool waitingForStart = false; // --repeat: button pressed, program not started yet
+static uint64_t pingUs = 0;
+static uint64_t nextPingUs = 0;
+static std::vector<LatencyLine> latencies;
+static FILE *traceFile = NULL;
+static FaultPlan faultPlan = {};
+static uint64_t faultUs = 0;        // When the fault struck (0: not yet)
+static uint64_t detectedUs = 0;
+static uint64_t safeUs = 0;         // Safe since (0: not safe now)
+static uint64_t wifiBackUs = 0;     // wifi-drop: the link comes back
+static bool faultStop = false;      // A fault screen came up
+static std::string notice;
+
+static void stamp(uint64_t us)
+{
+  unsigned long ms = us / 1000;
+  printf("[%3lu:%02lu.%03lu] ", ms / 60000, ms / 1000 % 60, ms % 1000);
+}
+
+static void press(uint8_t pin, uint64_t atUs)
+{
+  presses.push_back({pin, atUs, atUs + PRESS_MS * 1000ULL, false});
+}
+
+static void noticed(uint64_t atUs, const std::string &text)
+{
+  if (faultUs == 0 || detectedUs != 0)
+    return;
+  detectedUs = atUs;
+  notice = text.substr(0, text.find('\n'));
+}
+
+static void onTelegram(const SimChatMessage &message)
+{
+  if (strcasestr(message.text.c_str(), "fault") || strcasestr(message.text.c_str(), "unavailable"))
+    noticed(message.atUs, message.text);
+  // wifi-drop is over once the firmware gets a message through again
+  if (faultPlan.fault != NULL && faultPlan.fault->kind == HAL_WIFI_DROP && faultUs != 0 && safeUs == 0 &&
+      message.atUs >= wifiBackUs)
+    safeUs = message.atUs;
+  if (!printTelegram)
+    return;
+  stamp(message.atUs);
+  printf("%s ", message.edit ? "TG~" : "TG>");
+  for (char c : message.text)
+    fputs(c == '\n' ? "\n               " : std::string(1, c).c_str(), stdout);
+  printf("\n");
+}
+
+static void onSerial(const char *line)
+{
+  char path[32];
+  LatencyLine latency;
+  if (sscanf(line, "LATENCY,%31[^,],%u,%u,%u,%u", path, &latency.samples, &latency.p50, &latency.p99,
+             &latency.maxUs) == 5)
+  {
+    // Cumulative since boot: the last report of a path wins
+    latency.path = path;
+    auto same = std::find_if(latencies.begin(), latencies.end(),
+                             [&](const LatencyLine &l) { return l.path == latency.path; });
+    if (same != latencies.end())
+      *same = latency;
+    else
+      latencies.push_back(latency);
+  }
+  if (traceFile != NULL && !strncmp(line, "ACT,", 4))
+    fprintf(traceFile, "%s\n", line);
+  if (!printSerial)
+    return;
+  stamp(simNowUs());
+  printf("SER %s\n", line);
+}
+
+// An eye on the LCD: print new frames, answer the balance prompt
+static void watchLcd(uint64_t nowUs)
+{
+  if (simLcd().version == lcdVersion)
+    return;
+  lcdVersion = simLcd().version;
+  std::string rows[SIM_LCD_ROWS] = {simLcdRow(0), simLcdRow(1)};
+  if (rows[0] == lcdShown[0] && rows[1] == lcdShown[1])
+    return;
+  if (rows[0].compare(0, 11, "Press Start") == 0 && lcdShown[0].compare(0, 11, "Press Start") != 0)
+  {
+    balancePrompts++;
+    press(MACHINE_HALT_BTN, nowUs + PROMPT_REACTION_MS * 1000ULL);
+  }
+  // Only cycleFault() screens read "<what> Fault"
+  if (rows[0].find("Fault") != std::string::npos)
+  {
+    faultStop = true;
+    noticed(nowUs, rows[0] + "|" + rows[1]);
+  }
+  lcdShown[0] = rows[0];
+  lcdShown[1] = rows[1];
+  if (printLcd)
+  {
+    stamp(nowUs);
+    printf("LCD |%s|%s|\n", rows[0].c_str(), rows[1].c_str());
+  }
+}
+
+static void injectFault(uint64_t nowUs)
+{
+  faultUs = nowUs;
+  uint8_t kind = faultPlan.fault->kind;
+  if (kind == HAL_LEVEL_DEAD)
+    simLevelDead(true);
+  else if (kind == HAL_WIFI_DROP)
+  {
+    simWifiSet(false);
+    wifiBackUs = nowUs + WIFI_DROP_MS * 1000ULL;
+  }
+  else
+    machineFault((MachineFault)kind, true);
+}
+
+// A sendMessage call is out: wifi-drop strikes before it gets an answer
+static void onTelegramSending()
+{
+  if (faultPlan.fault != NULL && faultUs == 0 && faultPlan.trigger == AT_SEND && programRunning)
+    injectFault(simNowUs());
+}
+
+static bool faultTriggered(uint64_t nowUs)
+{
+  switch (faultPlan.trigger)
+  {
+  case AT_START:
+    return true;
+  case AT_FILL:
+    return simPinLevel(MACHINE_IV) == HIGH;
+  case AT_DRAIN:
+    return simPinLevel(MACHINE_DM_SPIN) == HIGH;
+  case AT_DRIVE:
+    return simPinLevel(MACHINE_INV_PW) == HIGH && simPwmDuty(MACHINE_CTR_SIG) > 0;
+  case AT_SECONDS:
+    return nowUs >= startedUs + faultPlan.afterUs;
+  default:
+    return false;
+  }
+}
+
+static bool machineSafe()
+{
+  const MachineState &machine = machineState();
+  bool drumIdle = simPinLevel(MACHINE_INV_PW) == LOW && machine.rpm == 0;
+  // Water keeps coming in: the best left is an open drain
+  if (machineFaulty(FAULT_VALVE_STUCK_OPEN))
+    return drumIdle && simPinLevel(MACHINE_DM_SPIN) == HIGH;
+  return !programRunning && drumIdle && simPinLevel(MACHINE_IV) == LOW;
+}
+
+// The fault plan: strike on the trigger, then watch for the safe state
+static uint64_t faultStep(uint64_t nowUs)
+{
+  if (faultPlan.fault == NULL || startedUs == 0)
+    return SIM_NEVER;
+  if (faultUs == 0)
+  {
+    if (programRunning && faultTriggered(nowUs))
+      injectFault(nowUs);
+    return faultPlan.trigger == AT_SECONDS && faultUs == 0 ? startedUs + faultPlan.afterUs : SIM_NEVER;
+  }
+  if (faultPlan.fault->kind == HAL_WIFI_DROP)
+  {
+    if (nowUs < wifiBackUs)
+      return wifiBackUs;
+    simWifiSet(true);
+    return SIM_NEVER;
+  }
+  // Safe from the moment the machine went safe and stayed so
+  if (!machineSafe())
+    safeUs = 0;
+  else if (safeUs == 0)
+    safeUs = nowUs;
+  return SIM_NEVER;
+}
+
+// The user: buttons and chat commands at their times
+static uint64_t operatorStep(uint64_t nowUs)
+{
+  watchLcd(nowUs);
+  uint64_t next = faultStep(nowUs);
+  for (Press &p : presses)
+  {
+    if (!p.down && nowUs >= p.downAt && nowUs < p.upAt)
+    {
+      machineButton(p.pin, true);
+      p.down = true;
+    }
+    else if (p.down && nowUs >= p.upAt)
+    {
+      machineButton(p.pin, false);
+      p.down = false;
+      p.downAt = p.upAt = SIM_NEVER;
+    }
+    next = std::min(next, p.down ? p.upAt : p.downAt);
+  }
+  for (Command &c : commands)
+  {
+    if (c.atUs <= nowUs)
+    {
+      simTelegramInject(CHAT_ID, c.text.c_str());
+      c.atUs = SIM_NEVER;
+    }
+    next = std::min(next, c.atUs);
+  }
+  if (pingUs != 0)
+  {
+    if (nowUs >= nextPingUs)
+    {
+      if (programRunning)
+        simTelegramInject(CHAT_ID, PING_COMMAND);
+      nextPingUs = nowUs + pingUs;
+    }
+    next = std::min(next, nextPingUs);
+  }
+  return next;
+}
+
+static bool cycleOver()
+{
+  uint64_t now = simNowUs();
+  if (programRunning)
+    waitingForStart = false;
+  if (startedUs == 0 && programRunning)
+    startedUs = now;
+  if (startedUs != 0 && finishedUs == 0 && !programRunning && !waitingForStart)
+  {
+    finishedUs = now;
+    programsDone++;
+  }
+  if (finishedUs == 0 || now < finishedUs + FLUSH_MS * 1000ULL)
+    return false;
+  if (programsDone >= repeats)
+    return true;
+  // Same program again; the cycle time covers all of them
+  press(running->button, now);
+  finishedUs = 0;
+  waitingForStart = true;
+  return false;
+}
+
+static RunResult runCycle(const MachineConfig &config, const Program &program, double limitMin)
+{
+  machineBegin(config);
+  simOnStep(operatorStep);
+  simOnTelegramSend(onTelegram);
+  simOnTelegramSending(onTelegramSending);
+  simOnSerialLine(onSerial);
+  simBoot();
+  running = &program;
+  press(program.button, BOOT_SETTLE_MS * 1000ULL);
+
+  clock_t wallStart = clock();
+  RunResult result = {};
+  result.completed = simRun((uint64_t)(limitMin * repeats * 60e6), cycleOver);
+  result.wallS = (double)(clock() - wallStart) / CLOCKS_PER_SEC;
+
+  const MachineState &machine = machineState();
+  result.started = startedUs != 0;
+  result.cycleMin = ((finishedUs ? finishedUs : simNowUs()) - startedUs) / 60e6;
+  result.inletL = machine.inletL;
+  result.drainedL = machine.drainedL;
+  result.heldL = machine.heldL;
+  result.peakRpm = machine.peakRpm;
+  result.changeoverUnderLoad = machine.changeoverUnderLoad;
+  result.balancePrompts = balancePrompts;
+  result.messages = simTelegramSent();
+  result.steps = simSteps();
+  result.programs = programsDone;
+  result.faultStop = faultStop;
+  result.injectS = faultUs ? (faultUs - startedUs) / 1e6 : -1;
+  result.detectS = detectedUs ? (detectedUs - faultUs) / 1e6 : -1;
+  result.safeS = safeUs ? (safeUs - faultUs) / 1e6 : -1;
+  snprintf(result.notice, sizeof(result.notice), "%s", notice.c_str());
+  return result;
+}
+
+static std::string faultDelay(double seconds)
+{
+  char text[24];
+  snprintf(text, sizeof(text), seconds < 0 ? "never" : "after %.1f s", seconds);
+  return text;
+}
+
+static void report(const Program &program, const RunResult &result)
+{
+  const MachineState &machine = machineState();
+  printf("\n%s program%s: %s after %.1f min of virtual time (%.2f s wall, %llu time steps)\n", program.name,
+         repeats > 1 ? (" x" + std::to_string(result.programs)).c_str() : "",
+         result.completed ? "completed" : result.started ? "still running" : "never started",
+         result.cycleMin, result.wallS, (unsigned long long)result.steps);
+  printf("Water:    %.1f L in, %.1f L drained, %.2f L left in the tub, %.2f L held by the laundry\n",
+         machine.inletL, machine.drainedL, machine.tubL, machine.heldL);
+  printf("Drum:     peak %.0f rpm, %u FB_SIG pulses, %u changeovers under load\n",
+         machine.peakRpm, machine.pulses, machine.changeoverUnderLoad);
+  printf("Relays:   INV_PW %u, DM_WASH %u, DM_SPIN %u, IV %u, CO1 %u, CO2 %u switchings\n",
+         machine.relaySwitches[0], machine.relaySwitches[1], machine.relaySwitches[2],
+         machine.relaySwitches[3], machine.relaySwitches[4], machine.relaySwitches[5]);
+  printf("Operator: %u balance prompts answered\n", result.balancePrompts);
+  printf("Telegram: %u messages sent\n", result.messages);
+  printf("LCD:      |%s|%s|\n", simLcdRow(0).c_str(), simLcdRow(1).c_str());
+  if (faultPlan.fault != NULL)
+  {
+    printf("Fault:    %s ", faultPlan.fault->name);
+    if (result.injectS < 0)
+      printf("never struck, its trigger did not come\n");
+    else
+      printf("at %.1f s into the program: noticed %s, safe %s%s\n", result.injectS,
+             faultDelay(result.detectS).c_str(), faultDelay(result.safeS).c_str(),
+             result.faultStop ? ", program stopped" : "");
+    if (result.notice[0])
+      printf("          \"%s\"\n", result.notice);
+  }
+  if (latencies.empty())
+    return;
+  printf("Latency:  %-14s %7s %10s %10s %10s\n", "path", "samples", "p50 ms", "p99 ms", "max ms");
+  for (const LatencyLine &l : latencies)
+    printf("          %-14s %7u %10.1f %10.1f %10.1f\n", l.path.c_str(), l.samples, l.p50 / 1e3, l.p99 / 1e3,
+           l.maxUs / 1e3);
+}
+
+/* --------------------  Batch  ---------------------- */
+struct BatchRun {
+  MachineConfig config;
+  size_t setting;                   // Index of the swept value
+  const Program *program;
+  FaultPlan plan;
+  RunResult result;
+  pid_t pid;
+  int pipe;
+};
+
+static void batchStart(BatchRun &run, double limitMin)
+{
+  int fds[2];
+  if (pipe(fds) != 0)
+  {
+    perror("pipe");
+    exit(2);
+  }
+  fflush(stdout);
+  run.pid = fork();
+  if (run.pid < 0)
+  {
+    perror("fork");
+    exit(2);
+  }
+  if (run.pid == 0)
+  {
+    close(fds[0]);
+    faultPlan = run.plan;
+    RunResult result = runCycle(run.config, *run.program, limitMin);
+    ssize_t written = write(fds[1], &result, sizeof(result));
+    _exit(written == (ssize_t)sizeof(result) ? 0 : 1);
+  }
+  close(fds[1]);
+  run.pipe = fds[0];
+}
+
+// A run that died (esp_restart, a crash) counts as not completed
+static void batchCollect(BatchRun &run)
+{
+  if (read(run.pipe, &run.result, sizeof(run.result)) != (ssize_t)sizeof(run.result))
+    run.result = RunResult();
+  close(run.pipe);
+  waitpid(run.pid, NULL, 0);
+}
+
+// Runs every cycle, jobs at a time; returns the wall time taken
+static double batchRunAll(std::vector<BatchRun> &runs, double limitMin, int jobs)
+{
+  struct timespec wallStart, wallEnd;
+  clock_gettime(CLOCK_MONOTONIC, &wallStart);
+  size_t next = 0;
+  size_t done = 0;
+  while (done < runs.size())
+  {
+    // Runs finish in the order they start, near enough, so reap the oldest
+    while (next < runs.size() && next - done < (size_t)jobs)
+      batchStart(runs[next++], limitMin);
+    batchCollect(runs[done++]);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &wallEnd);
+  return (wallEnd.tv_sec - wallStart.tv_sec) + (wallEnd.tv_nsec - wallStart.tv_nsec) / 1e9;
+}
+
+static bool runBatch(std::vector<BatchRun> &runs, const Program &program, double limitMin,
+                     const std::vector<float> &values, const SweepParam *sweep, int jobs)
+{
+  double wallS = batchRunAll(runs, limitMin, jobs);
+
+  printf("run,program,seed,load_kg,unbalance,inflow_lps,drain_coeff,absorb_l_per_kg,noise_l,"
+         "completed,cycle_min,inlet_l,drained_l,held_l,peak_rpm,changeovers_under_load,balance_prompts,messages,steps\n");
+  for (size_t i = 0; i < runs.size(); i++)
+  {
+    const MachineConfig &c = runs[i].config;
+    const RunResult &r = runs[i].result;
+    printf("%zu,%s,%u,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%d,%.2f,%.2f,%.2f,%.2f,%.0f,%u,%u,%u,%llu\n",
+           i, program.name, c.seed, c.loadKg, c.unbalance, c.inflowLps, c.drainCoeff, c.absorbLPerKg,
+           c.levelNoiseL, r.completed, r.cycleMin, r.inletL, r.drainedL, r.heldL, r.peakRpm,
+           r.changeoverUnderLoad, r.balancePrompts, r.messages, (unsigned long long)r.steps);
+  }
+
+  bool allCompleted = true;
+  fprintf(stderr, "%zu %s cycles in %.1f s wall (%.0f cycles/s, %d jobs)\n", runs.size(), program.name,
+          wallS, runs.size() / wallS, jobs);
+  fprintf(stderr, "%-10s %9s %9s %9s %9s %9s %9s\n", sweep ? sweep->name : "", "completed", "min",
+          "mean", "max", "prompts", "drained");
+  for (size_t setting = 0; setting < values.size(); setting++)
+  {
+    uint32_t count = 0, completed = 0, prompts = 0;
+    double minMin = 1e9, maxMin = 0, sumMin = 0, drained = 0;
+    for (const BatchRun &run : runs)
+    {
+      if (run.setting != setting)
+        continue;
+      count++;
+      prompts += run.result.balancePrompts;
+      drained += run.result.drainedL;
+      if (!run.result.completed)
+        continue;
+      completed++;
+      sumMin += run.result.cycleMin;
+      minMin = std::min(minMin, run.result.cycleMin);
+      maxMin = std::max(maxMin, run.result.cycleMin);
+    }
+    allCompleted = allCompleted && completed == count;
+    char label[16] = "all";
+    if (sweep != NULL)
+      snprintf(label, sizeof(label), "%g", values[setting]);
+    fprintf(stderr, "%-10s %4u/%-4u %9.1f %9.1f %9.1f %9.2f %8.1fL\n", label, completed, count,
+            completed ? minMin : 0, completed ? sumMin / completed : 0, maxMin,
+            (double)prompts / count, drained / count);
+  }
+  return allCompleted;
+}
+
+// Every fault under every program: detection and safe-state times
+static bool runFaultBench(const MachineConfig &config, double limitMin, int jobs)
+{
+  std::vector<BatchRun> runs;
+  for (const Fault &fault : faults)
+  {
+    for (const Program &program : programs)
+      runs.push_back({config, 0, &program, {&fault, fault.trigger, 0}, {}, 0, -1});
+  }
+  double wallS = batchRunAll(runs, limitMin, jobs);
+
+  printf("fault,program,trigger,injected_s,detect_s,safe_s,fault_stop,completed,cycle_min,notice\n");
+  for (const BatchRun &run : runs)
+  {
+    const RunResult &r = run.result;
+    printf("%s,%s,%s,%.2f,%.2f,%.2f,%d,%d,%.2f,\"%s\"\n", run.plan.fault->name, run.program->name,
+           triggerNames[run.plan.trigger], r.injectS, r.detectS, r.safeS, r.faultStop, r.completed, r.cycleMin,
+           r.notice);
+  }
+
+  // One cell per run: seconds to the first notice / to safe, "-" for never
+  bool allEnded = true;
+  fprintf(stderr, "%zu fault runs in %.1f s wall; seconds from the fault to its first notice / to a safe state\n",
+          runs.size(), wallS);
+  fprintf(stderr, "%-14s", "");
+  for (const Program &program : programs)
+    fprintf(stderr, " %17s", program.name);
+  fprintf(stderr, "\n");
+  for (size_t i = 0; i < runs.size(); i++)
+  {
+    const BatchRun &run = runs[i];
+    const RunResult &r = run.result;
+    if (run.program == &programs[0])
+      fprintf(stderr, "%-14s", run.plan.fault->name);
+    char cell[32];
+    if (!r.completed)
+      snprintf(cell, sizeof(cell), "hung");
+    else if (r.injectS < 0)
+      snprintf(cell, sizeof(cell), "n/a");
+    else
+    {
+      char detect[12] = "-", safe[12] = "-";
+      if (r.detectS >= 0)
+        snprintf(detect, sizeof(detect), "%.1f", r.detectS);
+      if (r.safeS >= 0)
+        snprintf(safe, sizeof(safe), "%.1f", r.safeS);
+      snprintf(cell, sizeof(cell), "%s / %s", detect, safe);
+    }
+    fprintf(stderr, " %17s", cell);
+    if (run.program == &programs[sizeof(programs) / sizeof(programs[0]) - 1])
+      fprintf(stderr, "\n");
+    allEnded = allEnded && r.completed;
+  }
+  return allEnded;
+}
+
+static void usage()
+{
+  fprintf(stderr, "usage: washsim [--load KG] [--unbalance F] [--seed N] [--limit MIN] [--cmd SEC:TEXT]\n"
+                  "               [--lcd] [--telegram] [--serial] [--trace FILE] [--max-step MS] [--repeat N]\n"
+                  "               [--ping SEC] [--fault F[@T]] [--faults] [--runs N] [--sweep P=A:B:S]\n"
+                  "               [--jobs N] [wash|rinse|spin|complete]\n");
+  exit(2);
+}
+
+// "NAME" or "NAME@TRIGGER", the trigger a name or seconds into the program
+static bool parseFault(const char *spec, FaultPlan &plan)
+{
+  const char *at = strchr(spec, '@');
+  size_t nameLength = at ? (size_t)(at - spec) : strlen(spec);
+  plan.fault = NULL;
+  for (const Fault &fault : faults)
+  {
+    if (strlen(fault.name) == nameLength && !strncmp(spec, fault.name, nameLength))
+      plan.fault = &fault;
+  }
+  if (plan.fault == NULL)
+    return false;
+  plan.trigger = plan.fault->trigger;
+  if (at == NULL)
+    return true;
+  for (int t = AT_START; t < AT_SECONDS; t++)
+  {
+    if (!strcmp(at + 1, triggerNames[t]))
+    {
+      plan.trigger = (FaultTrigger)t;
+      return true;
+    }
+  }
+  char *end;
+  double seconds = strtod(at + 1, &end);
+  if (end == at + 1 || *end != 0 || seconds < 0)
+    return false;
+  plan.trigger = AT_SECONDS;
+  plan.afterUs = (uint64_t)(seconds * 1e6);
+  return true;
+}
+
+int main(int argc, char **argv)
+{
+  MachineConfig config = machineDefaults();
+  const Program *program = &programs[3];
+  double limitMin = 180;
+  int runsPerSetting = 0;
+  int jobs = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  const SweepParam *sweep = NULL;
+  float sweepFrom = 0, sweepTo = 0, sweepStep = 0;
+  bool faultBench = false;
+  for (int i = 1; i < argc; i++)
+  {
+    const char *arg = argv[i];
+    bool hasValue = i + 1 < argc;
+    if (!strcmp(arg, "--load") && hasValue)
+      config.loadKg = atof(argv[++i]);
+    else if (!strcmp(arg, "--unbalance") && hasValue)
+      config.unbalance = atof(argv[++i]);
+    else if (!strcmp(arg, "--seed") && hasValue)
+      config.seed = strtoul(argv[++i], NULL, 10);
+    else if (!strcmp(arg, "--limit") && hasValue)
+      limitMin = atof(argv[++i]);
+    else if (!strcmp(arg, "--cmd") && hasValue)
+    {
+      const char *spec = argv[++i];
+      const char *colon = strchr(spec, ':');
+      if (colon == NULL)
+        usage();
+      commands.push_back({(uint64_t)(atof(spec) * 1e6), colon + 1});
+    }
+    else if (!strcmp(arg, "--lcd"))
+      printLcd = true;
+    else if (!strcmp(arg, "--telegram"))
+      printTelegram = true;
+    else if (!strcmp(arg, "--serial"))
+      printSerial = true;
+    else if (!strcmp(arg, "--repeat") && hasValue)
+      repeats = std::max(1, atoi(argv[++i]));
+    else if (!strcmp(arg, "--ping") && hasValue)
+      pingUs = (uint64_t)(atof(argv[++i]) * 1e6);
+    else if (!strcmp(arg, "--trace") && hasValue)
+    {
+      traceFile = fopen(argv[++i], "w");
+      if (traceFile == NULL)
+      {
+        perror(argv[i]);
+        return 2;
+      }
+    }
+    else if (!strcmp(arg, "--max-step") && hasValue)
+      simMaxStep((uint64_t)(atof(argv[++i]) * 1000));
+    else if (!strcmp(arg, "--fault") && hasValue)
+    {
+      if (!parseFault(argv[++i], faultPlan))
+        usage();
+    }
+    else if (!strcmp(arg, "--faults"))
+      faultBench = true;
+    else if (!strcmp(arg, "--runs") && hasValue)
+      runsPerSetting = atoi(argv[++i]);
+    else if (!strcmp(arg, "--jobs") && hasValue)
+      jobs = std::max(1, atoi(argv[++i]));
+    else if (!strcmp(arg, "--sweep") && hasValue)
+    {
+      const char *spec = argv[++i];
+      const char *equals = strchr(spec, '=');
+      if (equals == NULL || sscanf(equals + 1, "%f:%f:%f", &sweepFrom, &sweepTo, &sweepStep) != 3 || sweepStep <= 0)
+        usage();
+      for (const SweepParam &param : sweepParams)
+      {
+        if (!strncmp(spec, param.name, equals - spec) && strlen(param.name) == (size_t)(equals - spec))
+          sweep = &param;
+      }
+      if (sweep == NULL)
+        usage();
+    }
+    else
+    {
+      program = NULL;
+      for (const Program &p : programs)
+      {
+        if (!strcmp(arg, p.name))
+          program = &p;
+      }
+      if (program == NULL)
+        usage();
+    }
+  }
+
+  if (faultBench)
+    return runFaultBench(config, limitMin, jobs) ? 0 : 1;
+  if (runsPerSetting == 0 && sweep == NULL)
+  {
+    RunResult result = runCycle(config, *program, limitMin);
+    report(*program, result);
+    if (traceFile != NULL)
+      fclose(traceFile);
+    return result.completed ? 0 : 1;
+  }
+
+  std::vector<float> values;
+  if (sweep != NULL)
+  {
+    for (int n = 0; sweepFrom + n * sweepStep <= sweepTo + sweepStep / 1000; n++)
+      values.push_back(sweepFrom + n * sweepStep);
+  }
+  else
+    values.push_back(0);
+  std::vector<BatchRun> runs;
+  for (size_t setting = 0; setting < values.size(); setting++)
+  {
+    for (int n = 0; n < std::max(runsPerSetting, 1); n++)
+    {
+      BatchRun run = {config, setting, program, faultPlan, {}, 0, -1};
+      run.config.seed = config.seed + n;
+      if (sweep != NULL)
+        run.config.*(sweep->field) = values[setting];
+      runs.push_back(run);
+    }
+  }
+  return runBatch(runs, *program, limitMin, values, sweep, jobs) ? 0 : 1;
+}
+/* --------------------  Wash Simulator (END)  ---------------------- */
@@ -0,0 +1,302 @@
+/* --------------------  Actuator Trace Diff (START)  ----------------------
+Compares an actuator trace (main/actuator_trace.h) with a golden one: the
+serial log of a field unit, or washsim --trace output, against the trace
+checked in under host/golden for the same program.
+
+Usage:  trace_diff [--tolerance MS] [--program N] GOLDEN RUN
+
+Both files may hold any serial output; only "ACT,..." lines count, from
+the Nth BEGIN (default 1) to the next. Reported, in order:
+  - sequence: relay and CTR_SIG changes missing from the run, added to
+    it or reordered (a longest-common-subsequence match of the two)
+  - timing: for each matched change, the time since the previous matched
+    one differing by more than MS (default 250) plus 2% of it
+  - overlaps: for every pair of relays, and each relay with the drive
+    turning (CTR_SIG above 0), the total time both were on, where it
+    differs by more than a second plus 5%
+  - interlocks: changes in the run that break a rule of
+    actuatorViolations(); any at all is a failure
+
+Exit status 0 when the run matches, 1 when it does not, 2 on bad input.
+The host build runs it per program with: cmake --build ... --target golden
+-------------------------------------------------------------------------- */
+#include <algorithm>
+#include <cmath>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "actuator_trace.h"
+
+#define REPORT_LINES 20             // Findings listed per check before "... and N more"
+#define TIMING_SLACK 0.02           // Timing tolerance, fraction of the interval
+#define OVERLAP_TOLERANCE_MS 1000
+#define OVERLAP_SLACK 0.05
+#define DRIVE_SLOT ACT_CTR_SIG      // Overlap slot for "drive turning"
+
+struct Trace {
+  std::string name;
+  std::vector<ActuatorEvent> events;
+  uint32_t lost;                    // Events the device dropped (LOST markers)
+  uint8_t mode;                     // BEGIN value
+};
+
+static bool loadTrace(const char *path, int program, Trace &trace)
+{
+  FILE *file = fopen(path, "r");
+  if (file == NULL)
+  {
+    perror(path);
+    return false;
+  }
+  trace.name = path;
+  trace.lost = 0;
+  trace.mode = 0;
+  int begins = 0;
+  char line[256];
+  while (fgets(line, sizeof(line), file))
+  {
+    ActuatorEvent e;
+    if (!actuatorParse(line, e))
+      continue;
+    if (e.actuator == ACT_BEGIN)
+    {
+      begins++;
+      if (begins == program)
+        trace.mode = e.value;
+      continue;
+    }
+    // A trace without BEGIN (cut from a log) counts as the first program
+    if (begins != program && !(begins == 0 && program == 1))
+      continue;
+    if (e.actuator == ACT_LOST)
+      trace.lost += e.value;
+    else
+      trace.events.push_back(e);
+  }
+  fclose(file);
+  if (trace.events.empty())
+  {
+    fprintf(stderr, "%s: no actuator events for program %d\n", path, program);
+    return false;
+  }
+  return true;
+}
+
+static bool same(const ActuatorEvent &a, const ActuatorEvent &b)
+{
+  return a.actuator == b.actuator && a.value == b.value && a.rampMs == b.rampMs;
+}
+
+static std::string describe(const ActuatorEvent &e)
+{
+  char text[48];
+  if (e.rampMs != 0)
+    snprintf(text, sizeof(text), "%8.1f s  %s -> %u over %u ms", e.ms / 1000.0, actuatorNames[e.actuator], e.value,
+             e.rampMs);
+  else
+    snprintf(text, sizeof(text), "%8.1f s  %s -> %u", e.ms / 1000.0, actuatorNames[e.actuator], e.value);
+  return text;
+}
+
+// Prints a finding unless REPORT_LINES have been; returns the new count
+static int finding(int count, const char *format, ...) __attribute__((format(printf, 2, 3)));
+static int finding(int count, const char *format, ...)
+{
+  if (count < REPORT_LINES)
+  {
+    va_list args;
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+  }
+  return count + 1;
+}
+
+static void more(int count)
+{
+  if (count > REPORT_LINES)
+    printf("  ... and %d more\n", count - REPORT_LINES);
+}
+
+// Index pairs of the longest common subsequence of the two event lists
+static std::vector<std::pair<size_t, size_t>> matchEvents(const Trace &golden, const Trace &run)
+{
+  size_t n = golden.events.size(), m = run.events.size();
+  std::vector<uint32_t> length((n + 1) * (m + 1), 0);
+  auto at = [&](size_t i, size_t j) -> uint32_t & { return length[i * (m + 1) + j]; };
+  for (size_t i = n; i-- > 0;)
+  {
+    for (size_t j = m; j-- > 0;)
+      at(i, j) = same(golden.events[i], run.events[j]) ? at(i + 1, j + 1) + 1 : std::max(at(i + 1, j), at(i, j + 1));
+  }
+  std::vector<std::pair<size_t, size_t>> pairs;
+  size_t i = 0, j = 0;
+  while (i < n && j < m)
+  {
+    if (same(golden.events[i], run.events[j]))
+      pairs.push_back({i++, j++});
+    else if (at(i + 1, j) >= at(i, j + 1))
+      i++;
+    else
+      j++;
+  }
+  return pairs;
+}
+
+static int diffSequence(const Trace &golden, const Trace &run, const std::vector<std::pair<size_t, size_t>> &pairs)
+{
+  int count = 0;
+  size_t i = 0, j = 0;
+  for (size_t p = 0; p <= pairs.size(); p++)
+  {
+    size_t gi = p < pairs.size() ? pairs[p].first : golden.events.size();
+    size_t rj = p < pairs.size() ? pairs[p].second : run.events.size();
+    for (; i < gi; i++)
+      count = finding(count, "  - %s   (golden only)\n", describe(golden.events[i]).c_str());
+    for (; j < rj; j++)
+      count = finding(count, "  + %s   (run only)\n", describe(run.events[j]).c_str());
+    i++;
+    j++;
+  }
+  more(count);
+  return count;
+}
+
+static int diffTiming(const Trace &golden, const Trace &run, const std::vector<std::pair<size_t, size_t>> &pairs,
+                      uint32_t toleranceMs)
+{
+  int count = 0;
+  uint32_t goldenFrom = 0, runFrom = 0;
+  for (const auto &pair : pairs)
+  {
+    const ActuatorEvent &g = golden.events[pair.first];
+    const ActuatorEvent &r = run.events[pair.second];
+    int64_t goldenGap = (int64_t)g.ms - goldenFrom;
+    int64_t runGap = (int64_t)r.ms - runFrom;
+    if (llabs(runGap - goldenGap) > toleranceMs + TIMING_SLACK * goldenGap)
+      count = finding(count, "  %s   %+.1f s after the previous change than golden (%.1f s)\n",
+                      describe(r).c_str(), (runGap - goldenGap) / 1000.0, goldenGap / 1000.0);
+    goldenFrom = g.ms;
+    runFrom = r.ms;
+  }
+  more(count);
+  return count;
+}
+
+// Milliseconds each relay pair (and each relay with the drive turning) spent on together
+struct Overlaps {
+  uint64_t ms[ACTUATORS][ACTUATORS];
+};
+
+static Overlaps overlaps(const Trace &trace)
+{
+  Overlaps o = {};
+  ActuatorState state = {};
+  uint32_t from = 0;
+  for (const ActuatorEvent &e : trace.events)
+  {
+    uint8_t on = state.relays | (state.duty > 0 ? 1 << DRIVE_SLOT : 0);
+    for (int a = 0; a < ACTUATORS; a++)
+    {
+      for (int b = a + 1; b < ACTUATORS; b++)
+      {
+        if ((on >> a & 1) && (on >> b & 1))
+          o.ms[a][b] += e.ms - from;
+      }
+    }
+    actuatorApply(state, e);
+    from = e.ms;
+  }
+  return o;
+}
+
+static int diffOverlaps(const Trace &golden, const Trace &run)
+{
+  Overlaps g = overlaps(golden), r = overlaps(run);
+  int count = 0;
+  for (int a = 0; a < ACTUATORS; a++)
+  {
+    for (int b = a + 1; b < ACTUATORS; b++)
+    {
+      double diff = (double)r.ms[a][b] - (double)g.ms[a][b];
+      if (fabs(diff) > OVERLAP_TOLERANCE_MS + OVERLAP_SLACK * g.ms[a][b])
+        count = finding(count, "  %s + %s%s: %.1f s, golden %.1f s\n", actuatorNames[a],
+                        b == DRIVE_SLOT ? "drive" : actuatorNames[b], b == DRIVE_SLOT ? " turning" : "",
+                        r.ms[a][b] / 1000.0, g.ms[a][b] / 1000.0);
+    }
+  }
+  more(count);
+  return count;
+}
+
+static int checkInterlocks(const Trace &trace)
+{
+  int count = 0;
+  ActuatorState state = {};
+  for (const ActuatorEvent &e : trace.events)
+  {
+    uint8_t found = actuatorViolations(state, e);
+    for (size_t rule = 0; rule < sizeof(violationNames) / sizeof(violationNames[0]); rule++)
+    {
+      if (found & (1 << rule))
+        count = finding(count, "  %s   %s\n", describe(e).c_str(), violationNames[rule]);
+    }
+    actuatorApply(state, e);
+  }
+  more(count);
+  return count;
+}
+
+static void usage()
+{
+  fprintf(stderr, "usage: trace_diff [--tolerance MS] [--program N] GOLDEN RUN\n");
+  exit(2);
+}
+
+int main(int argc, char **argv)
+{
+  uint32_t toleranceMs = 250;
+  int program = 1;
+  const char *paths[2] = {NULL, NULL};
+  int files = 0;
+  for (int i = 1; i < argc; i++)
+  {
+    if (!strcmp(argv[i], "--tolerance") && i + 1 < argc)
+      toleranceMs = strtoul(argv[++i], NULL, 10);
+    else if (!strcmp(argv[i], "--program") && i + 1 < argc)
+      program = std::max(1, atoi(argv[++i]));
+    else if (files < 2 && argv[i][0] != '-')
+      paths[files++] = argv[i];
+    else
+      usage();
+  }
+  if (files != 2)
+    usage();
+
+  Trace golden, run;
+  if (!loadTrace(paths[0], program, golden) || !loadTrace(paths[1], program, run))
+    return 2;
+  if (golden.mode != run.mode)
+    printf("Program mode %u, golden %u\n", run.mode, golden.mode);
+  if (run.lost != 0)
+    printf("The run's trace lost %u events on the device; expect sequence differences\n", run.lost);
+
+  std::vector<std::pair<size_t, size_t>> pairs = matchEvents(golden, run);
+  printf("Sequence (%zu changes, golden %zu, %zu matched):\n", run.events.size(), golden.events.size(), pairs.size());
+  int sequence = diffSequence(golden, run, pairs);
+  printf("Timing (tolerance %u ms + %.0f%%):\n", toleranceMs, TIMING_SLACK * 100);
+  int timing = diffTiming(golden, run, pairs, toleranceMs);
+  printf("Overlaps:\n");
+  int overlap = diffOverlaps(golden, run);
+  printf("Interlocks:\n");
+  int interlock = checkInterlocks(run);
+
+  bool match = sequence + timing + overlap + interlock == 0 && golden.mode == run.mode;
+  printf("%s: %d sequence, %d timing, %d overlap, %d interlock differences from %s\n", match ? "MATCH" : "DIFFERS",
+         sequence, timing, overlap, interlock, golden.name.c_str());
+  return match ? 0 : 1;
+}
+/* --------------------  Actuator Trace Diff (END)  ---------------------- */
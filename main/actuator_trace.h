@@ -0,0 +1,162 @@
+/* --------------------  Actuator Trace (START)  ----------------------
+Every change the firmware commands on the machine's actuators, stamped in
+milliseconds since the program started: the six relays, and the CTR_SIG
+duty the drive is told to jump or ramp to. Speed loop trims around that
+duty are left out, because they follow the load rather than the program.
+An event is 8 bytes in the ring and one line on the serial port:
+
+  ACT,<ms>,<actuator>,<value>[,<rampMs>]       ACT,91110,CTR_SIG,200,800
+
+BEGIN (value: program mode) opens a program's trace and LOST (value:
+events dropped, at most 255) marks a gap where the ring was full. The
+serial stream of a field unit can be compared with a host run, or with a
+golden trace checked in under host/golden, by host/trace_diff.cpp.
+trace_diff includes this header for actuatorParse() and for the relay
+interlock rules it checks, actuatorViolations().
+-------------------------------------------------------------------------- */
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#define ACTUATOR_TRACE_DEPTH 64     // Events buffered between flushes (power of two)
+
+enum Actuator : uint8_t {
+  ACT_INV_PW,                       // Relays first, in OUT_* bit order
+  ACT_DM_WASH,
+  ACT_DM_SPIN,
+  ACT_IV,
+  ACT_CO1,
+  ACT_CO2,
+  ACT_CTR_SIG,
+  ACTUATORS,
+  ACT_BEGIN = ACTUATORS,            // Markers, not actuators
+  ACT_LOST,
+  ACT_KINDS,
+};
+
+static const char *const actuatorNames[ACT_KINDS] = {"INV_PW", "DM_WASH", "DM_SPIN", "IV", "CO1",
+                                                     "CO2", "CTR_SIG", "BEGIN", "LOST"};
+
+struct ActuatorEvent {
+  uint32_t ms;                      // Since the program started
+  uint8_t actuator;                 // Actuator
+  uint8_t value;                    // Relay 0/1, CTR_SIG duty, BEGIN mode, LOST count
+  uint16_t rampMs;                  // CTR_SIG: ramp length to value (0 = jump)
+};
+
+struct ActuatorTrace {
+  ActuatorEvent events[ACTUATOR_TRACE_DEPTH];
+  uint16_t head;                    // Next slot written
+  uint16_t tail;                    // Next slot read
+  uint32_t lost;                    // Events dropped since the last LOST marker
+  uint8_t values[ACTUATORS];        // Last recorded value per actuator
+};
+
+// Machine outputs as a trace leaves them
+struct ActuatorState {
+  uint8_t relays;                   // Bit per relay actuator (OUT_* order)
+  uint8_t duty;                     // CTR_SIG
+};
+
+// Rules the relay outputs must keep, as bits of actuatorViolations()
+enum ActuatorViolation : uint8_t {
+  VIOLATION_CHANGEOVER_LOADED = 0x01, // CO1/CO2 switched with the inverter powered and driven
+  VIOLATION_HALF_CHANGEOVER = 0x02,   // Inverter driven with CO1 and CO2 apart (one phase swapped)
+  VIOLATION_FILL_DRAINING = 0x04,     // IV open with the drain valve pulled open (DM_SPIN)
+};
+
+static const char *const violationNames[] = {"changeover under load", "half changeover", "filling while draining"};
+
+inline void actuatorTraceReset(ActuatorTrace &t)
+{
+  memset(&t, 0, sizeof(t));
+}
+
+inline void actuatorTracePush(ActuatorTrace &t, const ActuatorEvent &e)
+{
+  if ((uint16_t)(t.head - t.tail) >= ACTUATOR_TRACE_DEPTH)
+  {
+    t.lost++;
+    return;
+  }
+  t.events[t.head++ % ACTUATOR_TRACE_DEPTH] = e;
+}
+
+inline bool actuatorTracePop(ActuatorTrace &t, ActuatorEvent &e)
+{
+  if (t.head == t.tail)
+    return false;
+  e = t.events[t.tail++ % ACTUATOR_TRACE_DEPTH];
+  return true;
+}
+
+// Records a commanded value unless it is the one already in force (a relay
+// written again, a CTR_SIG jump to the duty it has); false if it was
+inline bool actuatorTraceRecord(ActuatorTrace &t, uint32_t ms, uint8_t actuator, uint8_t value, uint16_t rampMs)
+{
+  if (t.values[actuator] == value && rampMs == 0)
+    return false;
+  t.values[actuator] = value;
+  actuatorTracePush(t, {ms, actuator, value, rampMs});
+  return true;
+}
+
+inline int actuatorFormat(char *buf, size_t size, const ActuatorEvent &e)
+{
+  if (e.rampMs != 0)
+    return snprintf(buf, size, "ACT,%lu,%s,%u,%u", (unsigned long)e.ms, actuatorNames[e.actuator], e.value, e.rampMs);
+  return snprintf(buf, size, "ACT,%lu,%s,%u", (unsigned long)e.ms, actuatorNames[e.actuator], e.value);
+}
+
+// Reads an "ACT,..." line, wherever it starts (a serial log may prefix it)
+inline bool actuatorParse(const char *line, ActuatorEvent &e)
+{
+  const char *at = strstr(line, "ACT,");
+  if (at == NULL)
+    return false;
+  char name[12];
+  unsigned long ms;
+  unsigned value, rampMs = 0;
+  if (sscanf(at, "ACT,%lu,%11[^,],%u,%u", &ms, name, &value, &rampMs) < 3)
+    return false;
+  for (uint8_t i = 0; i < ACT_KINDS; i++)
+  {
+    if (!strcmp(name, actuatorNames[i]))
+    {
+      e = {(uint32_t)ms, i, (uint8_t)value, (uint16_t)rampMs};
+      return true;
+    }
+  }
+  return false;
+}
+
+inline void actuatorApply(ActuatorState &s, const ActuatorEvent &e)
+{
+  if (e.actuator < ACT_CTR_SIG)
+    s.relays = (s.relays & ~(1 << e.actuator)) | ((e.value ? 1 : 0) << e.actuator);
+  else if (e.actuator == ACT_CTR_SIG)
+    s.duty = e.value;
+}
+
+// Rules e breaks, taking the outputs from before to after it
+inline uint8_t actuatorViolations(const ActuatorState &before, const ActuatorEvent &e)
+{
+  ActuatorState after = before;
+  actuatorApply(after, e);
+  auto on = [](const ActuatorState &s, uint8_t a) { return (s.relays >> a) & 1; };
+  auto driven = [&](const ActuatorState &s) { return on(s, ACT_INV_PW) && s.duty > 0; };
+  uint8_t found = 0;
+  if ((e.actuator == ACT_CO1 || e.actuator == ACT_CO2) && on(before, e.actuator) != on(after, e.actuator) &&
+      driven(before))
+    found |= VIOLATION_CHANGEOVER_LOADED;
+  // Mid-changeover (one relay written, the other next) is fine undriven
+  if (driven(after) && on(after, ACT_CO1) != on(after, ACT_CO2) &&
+      !(e.actuator == ACT_CO1 || e.actuator == ACT_CO2))
+    found |= VIOLATION_HALF_CHANGEOVER;
+  if (on(after, ACT_IV) && on(after, ACT_DM_SPIN) && !(on(before, ACT_IV) && on(before, ACT_DM_SPIN)))
+    found |= VIOLATION_FILL_DRAINING;
+  return found;
+}
+/* --------------------  Actuator Trace (END)  ---------------------- */
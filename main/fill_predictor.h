@@ -0,0 +1,94 @@
+/* --------------------  Fill Predictor (START)  ----------------------
+Predictive inlet valve cutoff. While IV is open the fill rate is estimated
+from the last second of level samples (least-squares slope); the valve is
+closed as soon as
+
+  level + rate * lag >= target
+
+where `lag` lumps together valve closing time, pipe run-off and sensor /
+filter delay. After the valve closes and the level settles, the overshoot
+against the target gives the lag that would have hit it exactly, and the
+stored lag moves a quarter of the way there. On the host it runs only as
+part of program.cpp in washsim; --sweep inflow=... or load=... varies the
+lag and rate it has to learn.
+-------------------------------------------------------------------------- */
+#pragma once
+#include <stdint.h>
+
+#define FILL_RATE_WINDOW 10         // Samples in the slope fit (1 s at 10 Hz)
+#define FILL_LAG_DEFAULT_MS 1500    // Lag used until a fill has been learned
+#define FILL_LAG_MAX_MS 8000        // Learned lag is clamped to 0..FILL_LAG_MAX_MS
+#define FILL_MIN_RATE 0.02f         // L/s: below this the slope is noise, do not predict or learn
+
+struct FlowEstimator {
+  uint32_t t[FILL_RATE_WINDOW];     // Sample time (ms)
+  float litres[FILL_RATE_WINDOW];   // Filtered level (L)
+  uint8_t count;
+  uint8_t next;
+};
+
+struct FillLearning {
+  uint16_t lagMs;                   // Learned cutoff lead time
+  uint16_t fills;                   // Fills learned from (saturates)
+};
+
+inline void flowEstimatorReset(FlowEstimator &e)
+{
+  e.count = 0;
+  e.next = 0;
+}
+
+inline void flowEstimatorAdd(FlowEstimator &e, uint32_t timestamp, float litres)
+{
+  e.t[e.next] = timestamp;
+  e.litres[e.next] = litres;
+  e.next = (e.next + 1) % FILL_RATE_WINDOW;
+  if (e.count < FILL_RATE_WINDOW)
+    e.count++;
+}
+
+// Fill rate in L/s, 0 until half a window has been seen
+inline float flowEstimatorRate(const FlowEstimator &e)
+{
+  if (e.count < FILL_RATE_WINDOW / 2)
+    return 0;
+
+  // Times relative to the oldest sample keep the sums well inside float precision
+  uint8_t oldest = (e.next + FILL_RATE_WINDOW - e.count) % FILL_RATE_WINDOW;
+  float sumT = 0, sumL = 0, sumTT = 0, sumTL = 0;
+  for (uint8_t i = 0; i < e.count; i++)
+  {
+    uint8_t k = (oldest + i) % FILL_RATE_WINDOW;
+    float t = (e.t[k] - e.t[oldest]) / 1000.0f;
+    sumT += t;
+    sumL += e.litres[k];
+    sumTT += t * t;
+    sumTL += t * e.litres[k];
+  }
+  float denom = e.count * sumTT - sumT * sumT;
+  return denom > 0 ? (e.count * sumTL - sumT * sumL) / denom : 0;
+}
+
+// True once the water already in flight will carry the level to target
+inline bool fillShouldClose(float level, float rate, float target, const FillLearning &learn)
+{
+  if (level >= target)
+    return true;
+  return rate > FILL_MIN_RATE && level + rate * learn.lagMs / 1000.0f >= target;
+}
+
+// Folds one fill's settled overshoot (L, negative = undershoot) into the learned lag
+inline void fillLearn(FillLearning &learn, float overshoot, float rateAtClose)
+{
+  if (rateAtClose <= FILL_MIN_RATE)
+    return;
+  float observed = learn.lagMs + overshoot / rateAtClose * 1000.0f;
+  if (observed < 0)
+    observed = 0;
+  if (observed > FILL_LAG_MAX_MS)
+    observed = FILL_LAG_MAX_MS;
+  learn.lagMs = (uint16_t)(learn.lagMs + (observed - learn.lagMs) / 4);
+  if (learn.fills < UINT16_MAX)
+    learn.fills++;
+}
+/* --------------------  Fill Predictor (END)  ---------------------- */
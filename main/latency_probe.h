@@ -0,0 +1,67 @@
+/* --------------------  Latency Histogram (START)  ----------------------
+Distribution of one control path's latency, kept for p50 / p99 / max
+without storing the samples. Buckets are quarter octaves of microseconds:
+
+  0..3 us exact, then [4,5), [5,6), [6,7), [7,8), [8,10), [10,12), ...
+
+so a percentile is reported as the top of its bucket, at most 25% high,
+from 1 us up to the full uint32_t range in 128 counters (512 bytes). The
+maximum is kept exactly. On the host, washbench is program.cpp built with
+LATENCY_PROBES=1 and prints the same tables after each simulated program.
+-------------------------------------------------------------------------- */
+#pragma once
+#include <stdint.h>
+
+#define LATENCY_SUB_BUCKETS 4       // Buckets per octave
+#define LATENCY_BUCKETS (32 * LATENCY_SUB_BUCKETS)
+
+struct LatencyHistogram {
+  uint32_t buckets[LATENCY_BUCKETS];
+  uint32_t count;                   // Samples recorded
+  uint32_t maxUs;                   // Largest sample
+};
+
+inline uint8_t latencyBucket(uint32_t us)
+{
+  if (us < LATENCY_SUB_BUCKETS)
+    return us;
+  int octave = 31 - __builtin_clz(us);
+  return (octave - 1) * LATENCY_SUB_BUCKETS + ((us >> (octave - 2)) & (LATENCY_SUB_BUCKETS - 1));
+}
+
+// Largest value that falls in bucket
+inline uint32_t latencyBucketTop(uint8_t bucket)
+{
+  if (bucket < LATENCY_SUB_BUCKETS)
+    return bucket;
+  int octave = bucket / LATENCY_SUB_BUCKETS + 1;
+  uint64_t low = (uint64_t)(LATENCY_SUB_BUCKETS + bucket % LATENCY_SUB_BUCKETS) << (octave - 2);
+  return (uint32_t)(low + (1ULL << (octave - 2)) - 1);
+}
+
+inline void latencyRecord(LatencyHistogram &h, uint32_t us)
+{
+  h.buckets[latencyBucket(us)]++;
+  h.count++;
+  if (us > h.maxUs)
+    h.maxUs = us;
+}
+
+// Latency below which pct percent of the samples fall (0 with no samples)
+inline uint32_t latencyPercentile(const LatencyHistogram &h, float pct)
+{
+  if (h.count == 0)
+    return 0;
+  uint32_t rank = (uint32_t)(pct / 100.0f * h.count + 0.999f);
+  if (rank < 1)
+    rank = 1;
+  uint32_t seen = 0;
+  for (int i = 0; i < LATENCY_BUCKETS; i++)
+  {
+    seen += h.buckets[i];
+    if (seen >= rank)
+      return latencyBucketTop(i) < h.maxUs ? latencyBucketTop(i) : h.maxUs;
+  }
+  return h.maxUs;
+}
+/* --------------------  Latency Histogram (END)  ---------------------- */
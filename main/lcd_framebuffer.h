@@ -0,0 +1,83 @@
+/* --------------------  LCD Framebuffer (START)  ----------------------
+Shadow copy of a character LCD in RAM. It offers the part of the
+LiquidCrystal_I2C API the firmware uses (clear, setCursor, print/printf,
+backlight), so call sites keep their shape, but every call only touches
+RAM. A render task takes snapshot() at a fixed rate and sends the cells
+that differ from what is already on the glass.
+
+Writes from several tasks are serialised with a spinlock held for a
+handful of byte copies. Newlines are dropped rather than printed as
+glyphs, and text past the end of a row is clipped.
+-------------------------------------------------------------------------- */
+#pragma once
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+
+template <uint8_t COLS, uint8_t ROWS>
+class LcdFramebuffer : public Print
+{
+public:
+  LcdFramebuffer() { memset(cells, ' ', sizeof(cells)); }
+
+  void init()
+  {
+    portENTER_CRITICAL(&lock);
+    memset(cells, ' ', sizeof(cells));
+    col = row = 0;
+    backlightOn = true;
+    portEXIT_CRITICAL(&lock);
+  }
+
+  void clear()
+  {
+    portENTER_CRITICAL(&lock);
+    memset(cells, ' ', sizeof(cells));
+    col = row = 0;
+    portEXIT_CRITICAL(&lock);
+  }
+
+  void setCursor(uint8_t c, uint8_t r)
+  {
+    portENTER_CRITICAL(&lock);
+    col = c;
+    row = r;
+    portEXIT_CRITICAL(&lock);
+  }
+
+  void backlight() { backlightOn = true; }
+  void noBacklight() { backlightOn = false; }
+
+  size_t write(uint8_t c) override { return write(&c, 1); }
+
+  size_t write(const uint8_t *buf, size_t size) override
+  {
+    portENTER_CRITICAL(&lock);
+    for (size_t i = 0; i < size; i++)
+    {
+      if (buf[i] == '\r' || buf[i] == '\n')
+        continue;
+      if (row < ROWS && col < COLS)
+        cells[row][col] = buf[i];
+      col++;
+    }
+    portEXIT_CRITICAL(&lock);
+    return size;
+  }
+
+  // Render side: consistent copy of the whole screen
+  bool snapshot(char out[ROWS][COLS])
+  {
+    portENTER_CRITICAL(&lock);
+    memcpy(out, cells, sizeof(cells));
+    portEXIT_CRITICAL(&lock);
+    return backlightOn;
+  }
+
+private:
+  char cells[ROWS][COLS];
+  uint8_t col = 0;
+  uint8_t row = 0;
+  volatile bool backlightOn = true;
+  portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+};
+/* --------------------  LCD Framebuffer (END)  ---------------------- */
@@ -0,0 +1,99 @@
+/* --------------------  Water Level Filter (START)  ----------------------
+Streaming filter for raw HX710B counts, integer-only so it costs a few
+hundred cycles per sample on the ESP32:
+
+  raw -> median-of-N (spike rejection) -> EMA or 1-D Kalman -> filtered
+
+Header-only so the same code runs in LevelTask and in the host replay tool
+(host/level_filter_replay.cpp).
+-------------------------------------------------------------------------- */
+#pragma once
+#include <stdint.h>
+
+#define LEVEL_FILTER_MAX_MEDIAN 7   // Largest supported median window
+#define LEVEL_FILTER_FRAC_BITS 8    // Fractional bits kept in the smoother state
+
+enum LevelFilterMode : uint8_t {
+  LEVEL_FILTER_NONE,                // Median stage only
+  LEVEL_FILTER_EMA,                 // Exponential moving average
+  LEVEL_FILTER_KALMAN,              // 1-D Kalman, constant-level model
+};
+
+struct LevelFilterConfig {
+  uint8_t medianWindow;             // 1 (off), 3, 5 or 7 samples
+  LevelFilterMode mode;
+  uint8_t emaShift;                 // EMA weight = 1 / 2^emaShift
+  int32_t kalmanQ;                  // Process noise variance (counts^2 per sample)
+  int32_t kalmanR;                  // Measurement noise variance (counts^2)
+};
+
+struct LevelFilter {
+  LevelFilterConfig config;
+  int32_t window[LEVEL_FILTER_MAX_MEDIAN]; // Last medianWindow raw samples
+  uint8_t count;                    // Samples in window (saturates at medianWindow)
+  uint8_t next;                     // Next window slot to overwrite
+  int64_t state;                    // Smoothed value, LEVEL_FILTER_FRAC_BITS fractional bits
+  int64_t variance;                 // Kalman estimate variance (counts^2)
+  bool primed;                      // state holds a value
+};
+
+inline void levelFilterInit(LevelFilter &f, const LevelFilterConfig &config)
+{
+  f = LevelFilter();
+  f.config = config;
+  if (f.config.medianWindow < 1)
+    f.config.medianWindow = 1;
+  if (f.config.medianWindow > LEVEL_FILTER_MAX_MEDIAN)
+    f.config.medianWindow = LEVEL_FILTER_MAX_MEDIAN;
+  f.config.medianWindow |= 1;       // Odd window: the median is a real sample
+}
+
+inline int32_t levelFilterMedian(LevelFilter &f, int32_t raw)
+{
+  f.window[f.next] = raw;
+  f.next = (f.next + 1) % f.config.medianWindow;
+  if (f.count < f.config.medianWindow)
+    f.count++;
+
+  // Insertion sort of at most 7 values
+  int32_t sorted[LEVEL_FILTER_MAX_MEDIAN];
+  for (uint8_t i = 0; i < f.count; i++)
+  {
+    int32_t v = f.window[i];
+    int8_t j = i - 1;
+    while (j >= 0 && sorted[j] > v)
+    {
+      sorted[j + 1] = sorted[j];
+      j--;
+    }
+    sorted[j + 1] = v;
+  }
+  return sorted[f.count / 2];
+}
+
+// Feeds one raw conversion, returns the filtered value in raw counts
+inline int32_t levelFilterUpdate(LevelFilter &f, int32_t raw)
+{
+  int64_t z = (int64_t)levelFilterMedian(f, raw) << LEVEL_FILTER_FRAC_BITS;
+
+  if (!f.primed || f.config.mode == LEVEL_FILTER_NONE)
+  {
+    f.state = z;
+    f.variance = f.config.kalmanR;
+    f.primed = true;
+  }
+  else if (f.config.mode == LEVEL_FILTER_EMA)
+  {
+    f.state += (z - f.state) >> f.config.emaShift;
+  }
+  else
+  {
+    // Predict, then blend in the measurement with gain K = P / (P + R)
+    f.variance += f.config.kalmanQ;
+    int64_t gain = (f.variance << 16) / (f.variance + f.config.kalmanR);
+    f.state += ((z - f.state) * gain) >> 16;
+    f.variance = (f.variance * ((1 << 16) - gain)) >> 16;
+  }
+  return (int32_t)(f.state >> LEVEL_FILTER_FRAC_BITS);
+}
+/* --------------------  Water Level Filter (END)  ---------------------- */
@@ -10,49 +10,56 @@ ensure that the WiFi credentials are correct.
 TODO: Implement Test Mode (Hybrid) (Telegram - HW Control)        (Partially Done)
 TODO: Implement Calibration Functionality                         (Pending)
 TODO: Implement Water Level Sensor Test Functionality             (Pending)
-TODO: Implement Button Test Functionality                         (Partially Done)
+TODO: Implement Button Test Functionality                         (Done)
 TODO: Implement Inlet Valve Test Functionality                    (Done)
 TODO: Implement Drain Motor Test Functionality                    (Done)  
-TODO: Implement Inverter/Motor Test Functionality                 (Partially Done)
+TODO: Implement Inverter/Motor Test Functionality                 (Done)
 TODO: Implement Connectivity Test Functionality                   (Done)  
 TODO: Improve Wash/Rinse Cycle Logic (more agitation patterns)    (Pending)
-TODO: Add Feedback From Inverter Drive                            (Pending) 
+TODO: Add Feedback From Inverter Drive                            (Done)    
 TODO: Improve Error Handling and Recovery                         (Pending) 
 TODO: Own Inverter Drive Design                                   (Pending - Long-term)
 
 
 TOC (Table of Contents):
-1. Compiler Directives: Lines 63-106
-2. Object Declarations: Lines 109-118
-4. Function Declarations: Lines 121-178
-3. State Variables (Global): Lines 181-223
-5. Engineering Mode Variables: Lines 226-244
-6. Button ISRs: Lines 247-297
-7. Status LEDs Control Function: Lines 300-388
-8. OTA Helper Functions: Lines 390-454
-9. Wash Program Function: Lines 469-605
-10. Rinse Program Function: Lines 608-691
-11. Spin Program Function: Lines 694-766
-12. Soak Program Function: Lines 769-841
-13. WiFi Connection Function: Lines 844-891
-14. Engineering Mode Helper Functions: Lines 894-932
-15. Water Level Sensor Test Function: Lines 935-1042
-16. Inlet Valve Test Function: Lines 1045-1208
-17. Drain Motor (Wash Stage) Test Function: Lines 1211-1334
-18. Drain Motor (Spin Stage) Test Function: Lines 1337-1423
-19. Motor Rotation Test Function: Lines 1426-1547
-20. LED Test Function: Lines 1550-1649
-21. MCU Self-Test Function: Lines 1652-1749
-22. All Buttons Test Function: Lines 1752-1837
-23. Connectivity Test Function: Lines 1840-1870
-24. Calibration Test Function: Lines 1873-1888
-25. Send System Info Function: Lines 1891-1931
-26. Engineering Mode Menu Function: Lines 1934-1948
-27. Component Test Submenu Function: Lines 1952-1969
-28. Engineering Mode Control Functions: Lines 1972-2087
-29. Mode State Control Function: Lines 2091-2128
-30. Main Setup Function: Lines 2130-2232
-31. Main Loop Function: Lines 2235-2467
+1. Compiler Directives: Lines 70-228
+2. Object Declarations: Lines 231-263
+3. Function Declarations: Lines 266-798
+4. State Variables (Global): Lines 801-957
+5. Engineering Mode Variables: Lines 960-975
+6. Button Input: Lines 978-1133
+7. Status LEDs Control Function: Lines 1136-1200
+8. LCD Render Task: Lines 1203-1263
+9. OTA Helper Functions: Lines 1266-1330
+10. Stage Program Tables: Lines 1345-1454
+11. Water Level Sampler: Lines 1457-1588
+12. Drum Speed Sensor: Lines 1591-1753
+13. Drum Speed Control: Lines 1756-2067
+14. Telegram Outbox: Lines 2070-2226
+15. Telegram Receiver: Lines 2229-2286
+16. Latency Probes: Lines 2289-2341
+17. Actuator Trace: Lines 2344-2410
+18. Cycle Executor: Lines 2413-3382
+19. WiFi Connection Function: Lines 3385-3432
+20. Engineering Mode Helper Functions: Lines 3435-3473
+21. Water Level Sensor Test Function: Lines 3476-3582
+22. Inlet Valve Test Function: Lines 3585-3742
+23. Drain Motor (Wash Stage) Test Function: Lines 3745-3872
+24. Drain Motor (Spin Stage) Test Function: Lines 3875-3961
+25. Motor Rotation Test Function: Lines 3964-4136
+26. Speed Loop Tuning Logic: Lines 4139-4255
+27. LED Test Function: Lines 4258-4357
+28. MCU Self-Test Function: Lines 4360-4457
+29. All Buttons Test Function: Lines 4460-4559
+30. Connectivity Test Function: Lines 4562-4592
+31. Calibration Test Function: Lines 4595-4610
+32. Send System Info Function: Lines 4613-4773
+33. Engineering Mode Menu Function: Lines 4776-4791
+34. Component Test Submenu Function: Lines 4794-4811
+35. Engineering Mode Control Functions: Lines 4814-4940
+36. Mode State Control Function: Lines 4943-5023
+37. Main Setup Function: Lines 5025-5194
+38. Main Loop Function: Lines 5197-5251
 
 
 
@@ -69,14 +76,29 @@ TOC (Table of Contents):
 #include <WebServer.h>                    // Include the WebServer Library
 #include <ElegantOTA.h>                   // Include the ElegantOTA Library
 #include "credentials.h"                  // Include the credentials header file
+#include "level_filter.h"                 // Include the Water Level Filter header file
+#include "fill_predictor.h"               // Include the Fill Predictor header file
+#include "speed_pid.h"                    // Include the Drum Speed PID header file
+#include "spin_balance.h"                 // Include the Spin Balance Meter header file
+#include "latency_probe.h"                // Include the Latency Histogram header file
+#include "actuator_trace.h"               // Include the Actuator Trace header file
+#include <Preferences.h>                  // Include the Preferences (NVS) Library
 #include <freertos/task.h>                // Include the FreeRTOS Task Library
-#include <WiFiClientSecure.h>             // Include the WiFiClientSecure Library
+#include <freertos/semphr.h>              // Include the FreeRTOS Semaphore Library
+#include "tls_client.h"                   // Include the TLS Client (esp_tls keep-alive/resumption) header file
 #include <UniversalTelegramBot.h>         // Include the UniversalTelegramBot Library
 #include <ArduinoJson.h>                  // Include the ArduinoJson Library
 #include <LiquidCrystal_I2C.h>            // Include the LiquidCrystal_I2C Library
+#include "lcd_framebuffer.h"              // Include the LCD Framebuffer header file
 #include <freertos/FreeRTOS.h>            // Include the FreeRTOS Library
 #include "esp_system.h"                   // Include the ESP System Library
 #include "soc/rtc_cntl_reg.h"             // Include the SoC RTC Control Register Library 
+#include "esp_timer.h"                    // Include the ESP High Resolution Timer Library
+#include "driver/pulse_cnt.h"             // Include the Pulse Counter (PCNT) Driver
+#include "driver/ledc.h"                  // Include the LED Control (PWM) Driver
+#include "soc/soc_caps.h"                 // Include the SoC Capabilities Header
+#include <stdarg.h>                       // Include the Variadic Arguments Library
+#include <atomic>                         // Include the C++ Atomics Library
 
 #define INV_PW 32         // Inverter Power Control Pin
 #define DM_WASH 25        // Drain Motor Wash Stage Pin
@@ -101,8 +123,108 @@ TOC (Table of Contents):
 #define I2C_ADDR 0x27     // LCD Display I2C Address
 #define DISPLAY_COLS 16   // LCD Display Columns
 #define DISPLAY_ROWS 2    // LCD Display Rows
+#define DISPLAY_REFRESH_MS 50 // LCD Render Period (caps I2C traffic at 20 frames/s)
 #define OFF LOW           // Naming Convensions
 #define ON HIGH           // Naming Conventions
+#define CYCLE_TICK_MS 10  // Cycle Executor Tick Period (ms)
+#define LEVEL_SAMPLE_PERIOD_MS 100 // HX710B Conversion Period (10 Hz)
+#define LEVEL_STALE_MS 500 // Level Reading Age Treated As Sensor Not Ready
+#define LEVEL_RING_SIZE 16 // Level Sample Ring Buffer Slots
+#define FILL_SETTLE_MAX_MS 5000 // Longest wait for the level to settle after IV closes
+#define FILL_AGITATE_MIN_L 8 // Level Above Which A Pipelined Fill Starts Agitating
+#define FILL_SLOSH_SAMPLES 15 // Level Samples Averaged While Agitating (< LEVEL_RING_SIZE)
+#define FILL_STALL_RISE_L 0.5f // Level Rise That Counts As Fill Progress
+#define FILL_STALL_MS 60000 // IV Open Without Progress For This Long = No Supply Or Sensor (fault)
+#define LEVEL_TRACE_SERIAL 0 // 1 = log every raw conversion as "LVL,<ms>,<raw>" (host/level_filter_replay.cpp)
+#ifndef LATENCY_PROBES
+#define LATENCY_PROBES 0  // 1 = time the control paths and print "LATENCY,..." after each program (host: washbench)
+#endif
+#define LATENCY_LEVEL_TIMEOUT_MS 1000 // Level Sample To IV Close: A Longer Gap Is Not That Sample's Doing
+#define LATENCY_BUTTON_TIMEOUT_MS 2000 // HALT Edge To Relay Change: ... Not That Press's Doing
+#define LATENCY_COMMAND_TIMEOUT_MS 30000 // Telegram Command To The Next Message Delivered
+#ifndef ACTUATOR_TRACE_SERIAL
+#define ACTUATOR_TRACE_SERIAL 1 // 1 = stream every commanded relay and CTR_SIG change as "ACT,..." (host/trace_diff.cpp)
+#endif
+#if LATENCY_PROBES
+#define LATENCY_START(path, us) latencyStart(path, us)
+#define LATENCY_STOP(path) latencyStop(path)
+#else
+#define LATENCY_START(path, us)
+#define LATENCY_STOP(path)
+#endif
+#define DRUM_PULSES_PER_REV 2 // FB_SIG Pulses Per Drum Revolution (inverter output and belt ratio; calibrate)
+#define RPM_SAMPLE_MS 50  // Drum Speed Update Period (20 Hz)
+#define RPM_WINDOW 10     // Samples Per Speed Estimate (RPM_WINDOW * RPM_SAMPLE_MS = 500 ms)
+#define PCNT_HIGH_LIMIT 30000 // Pulse Counter Wrap Point (folded into the accumulated count)
+#define PCNT_GLITCH_NS 1000 // FB_SIG Pulses Shorter Than This Are Noise
+#define ROTOR_LOCK_MS 2000 // Driven Without A Feedback Pulse This Long = Locked Rotor
+#define ROTOR_LOCK_MIN_PWM 60 // CTR_SIG Duty From Which The Drum Must Turn
+#define ROTOR_LOCK_SPIN_PWM 30 // ... With The Spin Gear (DM_SPIN) In
+#define SPEED_TRIM_MAX 60 // Largest PID Correction Around The Table Duty (CTR_SIG counts)
+#define SPEED_KP_DEFAULT 0.3f // Speed Loop Gains Until Tuned (duty per rpm, per rpm*s, per rpm/s)
+#define SPEED_KI_DEFAULT 0.5f
+#define SPEED_KD_DEFAULT 0.0f
+#define SPEED_STEP_TEST_MS 10000 // Speed Loop Tuning Step Response Length
+#define DRIVE_PWM_HZ 1000 // CTR_SIG PWM Frequency (same as analogWrite)
+#define DRIVE_LEDC_MODE LEDC_LOW_SPEED_MODE // CTR_SIG LEDC group
+#define DRIVE_LEDC_TIMER LEDC_TIMER_3 // CTR_SIG LEDC timer (Arduino allocates from 0 upwards)
+#define DRIVE_LEDC_CHANNEL LEDC_CHANNEL_7 // CTR_SIG LEDC channel
+#define DRIVE_PROFILE_MAX 4 // Steps In One Motor Profile
+#define DRIVE_RAMP_SEGMENTS 8 // Linear Hardware Fades Approximating One S-Curve Ramp
+#define DRIVE_FADE_SLACK_MS 50 // Segment Overrun Before DriveTask Moves On Without The Fade ISR
+#define REVERSAL_QUIET_MS 300 // No FB_SIG Pulse For This Long = Drum Stopped
+#define REVERSAL_COAST_MAX_MS 10000 // Longest Wait For The Drum To Stop Before Reversing Anyway
+#define REVERSAL_MODEL_MARGIN_MS 300 // Added To The Learned Coast Time While FB_SIG Is Silent
+#define CHANGEOVER_SETTLE_MS 200 // CO1/CO2 Contact Settle Before The Drive Restarts
+#define FB_PERIOD_RING 32 // FB_SIG Pulse Periods Buffered For The Balance Meter
+#define FB_MIN_PERIOD_US 2000 // Shorter FB_SIG Periods Are Noise (No PCNT Glitch Filter On This Path)
+#define BALANCE_MIN_REVS 3 // Revolutions Needed For A Ripple Figure
+#define BALANCE_SETTLE_PCT 10 // Revolution Speed Within This Much Of Distribution Speed Counts As Settled
+#define BALANCE_SETTLE_REVS 3 // ... For This Many Revolutions In A Row Before Measuring
+#define BALANCE_SETTLE_MAX_MS 15000 // Longest Wait For The Speed Loop To Settle Before Measuring Anyway
+#define SPIN_STAGE_MAX 4  // Speed Stages In One Spin Profile
+#define SPIN_SUMP_SAMPLE_MS 1000 // Sump Level Sample Spacing For The Extraction Slope (10 s window)
+#define SPIN_TRACE_SERIAL 0 // 1 = log every sump sample of a spin as "SPIN,<stage>,<ms>,<level>,<lpm>"
+#define DRAIN_SAMPLE_MS 500 // Level Sample Spacing For The Drain Slope (5 s window)
+#define DRAIN_TRACE_SERIAL 0 // 1 = log every level sample of a drain as "DRAIN,<ms>,<level>,<lpm>"
+#define DRAIN_FLAT_LPM 0.5f // Level Slope (L/min, either sign) Counted As Drained
+#define DRAIN_EMPTY_MARGIN_L 0.5f // ... With The Level At Most This Far Above setDrainingWaterLevel
+#define DRAIN_FLAT_HOLD_MS 1000 // Slope Must Stay Flat This Long
+#define DRAIN_STALL_DROP_L 0.3f // Level Drop That Counts As Drain Progress
+#define DRAIN_STALL_MS 30000 // No Progress For This Long Above Empty = Pump Stalled (fault)
+#define DRAIN_PAD_MS 15000 // Fixed Wait That Used To Follow Every Drain (drain stats compare against it)
+#define DRAIN_TAIL_MAX_MS DRAIN_PAD_MS // Longest Drain After First Reaching setDrainingWaterLevel, Flat Or Not
+#define DRAIN_TIMEOUT_MS 600000 // Longest Drain Whatever The Level Does (fault)
+#define FAULT_CHANGEOVER_WAIT_MS 2000 // cycleFault: Longest Wait For The Drive To Stop Before Opening CO1/CO2
+#define OUTBOX_DEPTH 16   // Telegram Outbox Queue Slots
+#define OUTBOX_SLOTS 4    // Progress Messages That Can Be Edited In Place
+#define OUTBOX_MIN_INTERVAL_MS 1100 // Spacing Between Bot API Calls (limit: ~1 msg/s per chat)
+#define OUTBOX_RETRY_MS 2000 // First Retry Delay (doubles per attempt)
+#define OUTBOX_MAX_ATTEMPTS 5 // Attempts Before A Message Is Dropped
+#define TELEGRAM_LONG_POLL_S 25 // getUpdates Long Poll Timeout (s)
+#define TELEGRAM_RETRY_MS 5000 // Pause After A Failed Poll
+#define COMMAND_QUEUE_DEPTH 8 // Received Commands Waiting For loop()
+#define INPUT_QUEUE_DEPTH 16 // Button Events Waiting For loop()
+#define BUTTON_COUNT 5    // Front Panel Buttons (InputButton)
+#define BUTTON_SAMPLE_MS 5 // Debounce Sampler Period
+#define BUTTON_DEBOUNCE_MS 20 // Level Must Hold This Long To Count
+#define BUTTON_CHORD_MS 80 // Second Press Within This Window Makes A Chord
+#define BUTTON_LONG_PRESS_MS 1000 // Hold Time For A Long Press
+#define BUTTON_TEST_TIMEOUT_MS 15000 // Button Test: Wait Per Button Before It Fails
+#define LOOP_IDLE_MS 20   // Longest loop() sleep while waiting for input
+#define LED_BIT_WASH 0x01 // Status LED: WASH
+#define LED_BIT_RINSE 0x02 // Status LED: RINSE
+#define LED_BIT_SPIN 0x04 // Status LED: SPIN
+#define LED_BIT_SOAK 0x08 // Status LED: SOAK
+#define LED_BIT_WIFI 0x10 // Status LED: WiFi
+#define LED_STAGE_MASK 0x0F // Status LEDs showing the program stage
+#define LED_BLINK_MS 500  // Status LED Blink Half-Period
+#define OUT_INV_PW 0x01   // Stage table output: Inverter Power
+#define OUT_DM_WASH 0x02  // Stage table output: Drain Motor Wash Stage
+#define OUT_DM_SPIN 0x04  // Stage table output: Drain Motor Spin Stage
+#define OUT_IV 0x08       // Stage table output: Inlet Valve
+#define OUT_CO1 0x10      // Stage table output: Changeover Relay 1
+#define OUT_CO2 0x20      // Stage table output: Changeover Relay 2
 /* --------------------  1. Compiler Directives (END)  ---------------------- */
 
 
@@ -110,25 +232,440 @@ TOC (Table of Contents):
 HX711 level;                                                        // HX711 load cell amplifier for water level measurement
 float waterLevel;                                                   // Current water level in Liters (final calibrated value)
 float tareWaterLevel;                                               // Intermediate water level calculation before offset applied
+unsigned long waterLevelTime;                                       // millis() of the sample behind waterLevel
+Preferences fillPrefs;                                              // NVS namespace "fill" holding the learned IV cutoff lag
 WebServer server(1906);                                             // HTTP web server on port 1906 for remote control and OTA updates
-WiFiClientSecure secured_client;                                    // Secure WiFi client for encrypted Telegram API communication
-UniversalTelegramBot telegram(BOT_TOKEN, secured_client);           // Telegram bot instance for sending/receiving messages
+TlsClient secured_client;                                           // Kept-alive TLS client for Telegram API communication
+UniversalTelegramBot telegram(BOT_TOKEN, secured_client);           // Telegram bot instance for sending messages (CommsTask)
+TlsClient rx_client;                                                // Second TLS session, held open by long polls
+UniversalTelegramBot telegramRx(BOT_TOKEN, rx_client);              // Telegram bot instance for receiving messages (RxTask)
+Preferences telegramPrefs;                                          // NVS namespace "telegram" holding the update offset
 TaskHandle_t ledtask_handle = NULL;                                 // FreeRTOS task handle for LED status indicator task
-LiquidCrystal_I2C display(I2C_ADDR, DISPLAY_COLS, DISPLAY_ROWS);    // 16x2 LCD display via I2C (address 0x27)
+pcnt_unit_handle_t fbCounter = NULL;                                // PCNT unit counting FB_SIG rising edges
+esp_timer_handle_t rpmSampler = NULL;                               // Turns pulse counts into drumSpeed every RPM_SAMPLE_MS
+SemaphoreHandle_t driveMutex = NULL;                                // Serialises CTR_SIG writes between driveSet() and the speed loop
+Preferences speedPrefs;                                             // NVS namespace "speed" holding the tuned PID gains
+esp_timer_handle_t buttonSampler = NULL;                            // Debounce sampler, runs from setup() on
+esp_timer_handle_t ledBlinkTimer = NULL;                            // Toggles blinking LEDs; stopped when nothing blinks
+TaskHandle_t drivetask_handle = NULL;                               // FreeRTOS task handle for the motor profile runner
+TaskHandle_t cycletask_handle = NULL;                               // FreeRTOS task handle for the cycle executor task
+QueueHandle_t cycleEventQueue = NULL;                               // Executor -> loop() events (program done)
+TaskHandle_t commstask_handle = NULL;                               // FreeRTOS task handle for the Telegram outbox task
+QueueHandle_t outboxQueue = NULL;                                   // Any task -> CommsTask Telegram sends and edits
+SemaphoreHandle_t telegramMutex = NULL;                             // Serialises Bot API calls on secured_client
+TaskHandle_t rxtask_handle = NULL;                                  // FreeRTOS task handle for the Telegram receiver task
+QueueHandle_t commandQueue = NULL;                                  // RxTask -> loop() received commands
+QueueHandle_t inputQueue = NULL;                                    // Button ISRs -> loop() input events
+TaskHandle_t leveltask_handle = NULL;                               // FreeRTOS task handle for the HX711 sampling task (owns `level`)
+LiquidCrystal_I2C lcd(I2C_ADDR, DISPLAY_COLS, DISPLAY_ROWS);        // 16x2 LCD display via I2C (address 0x27), owned by DisplayTask
+LcdFramebuffer<DISPLAY_COLS, DISPLAY_ROWS> display;                 // RAM copy of the LCD that all other code draws into
+TaskHandle_t displaytask_handle = NULL;                             // FreeRTOS task handle for the LCD render task
 /* --------------------  2. Object Declarations (END)  ---------------------- */
 
 
 /* --------------------  3. Function Declarations (START)  ---------------------- */
 
+// Cycle Executor Types
+enum CycleStage { STAGE_NONE, STAGE_SOAK, STAGE_WASH, STAGE_RINSE, STAGE_SPIN };
+
+// Front panel buttons, as carried by InputEvent
+enum InputButton : uint8_t { INPUT_WASH, INPUT_RINSE, INPUT_SPIN, INPUT_COMP, INPUT_HALT };
+
+enum InputEventType : uint8_t {
+  INPUT_PRESS,                  // Debounced press, sent once BUTTON_CHORD_MS has passed without a chord
+  INPUT_RELEASE,                // Debounced release
+  INPUT_LONG_PRESS,             // Held for BUTTON_LONG_PRESS_MS
+  INPUT_CHORD,                  // `button` then `other` pressed within BUTTON_CHORD_MS (no PRESS for either)
+};
+
+struct InputEvent {
+  InputEventType type;
+  InputButton button;
+  InputButton other;            // INPUT_CHORD: second button
+  uint32_t cycles;              // CPU cycle counter at the first edge (core 1, where the ISRs and loop() run)
+};
+
+struct ButtonState {
+  volatile uint16_t edges;      // ISR edges since the last debounced change
+  volatile uint32_t edgeCycles; // Cycle counter at the first of those edges
+  bool raw;                     // Last sampled level (true = pressed)
+  uint8_t stableSamples;        // Consecutive samples equal to raw
+  bool pressed;                 // Debounced state
+  bool pressSent;               // INPUT_PRESS sent for this press
+  bool longSent;                // INPUT_LONG_PRESS sent for this press
+  bool chorded;                 // This press is part of a chord
+  uint32_t downAt;              // millis() of the debounced press
+  uint32_t downCycles;          // Cycle counter at the press's first edge
+  uint32_t bounces;             // Edges beyond one per debounced change, since boot
+};
+
+struct InputStats {
+  uint32_t events;              // Events handled by loop()
+  uint32_t dropped;             // Events lost to a full inputQueue
+  uint32_t maxLatencyCycles;    // Worst edge-to-handler latency
+  uint64_t totalLatencyCycles;  // Sum of latencies (for the average)
+};
+
+#if LATENCY_PROBES
+enum LatencyPath : uint8_t {
+  LATENCY_LEVEL_IV,             // Level conversion read to the IV close it led to
+  LATENCY_BUTTON_RELAY,         // HALT press edge to the next relay change
+  LATENCY_COMMAND_REPLY,        // Telegram command received to the next message delivered
+  LATENCY_PATHS,
+};
+
+struct LatencyProbe {
+  const char *name;
+  uint32_t timeoutUs;           // An older start is dropped rather than counted
+  int64_t startUs;              // esp_timer time of the pending start (0 = none)
+  LatencyHistogram histogram;
+};
+#endif
+
+// Status LED scenes (index into ledScenes[])
+enum LedScene {
+  LED_SCENE_IDLE,
+  LED_SCENE_SOAK,
+  LED_SCENE_WASH,
+  LED_SCENE_RINSE,
+  LED_SCENE_SPIN,
+  LED_SCENE_COMPLETE_WASH,
+  LED_SCENE_COMPLETE_RINSE,
+  LED_SCENE_COMPLETE_SPIN,
+  LED_SCENE_FAULT,
+};
+
+struct LedPattern {
+  uint8_t solid;                // LED_BIT_* held on
+  uint8_t blink;                // LED_BIT_* blinking at LED_BLINK_MS
+};
+
+enum BalancePhase : uint8_t {
+  BALANCE_DISTRIBUTE,           // Ramping to distribution speed
+  BALANCE_SETTLE,               // Waiting for the speed loop to hold distribution speed
+  BALANCE_MEASURE,              // Collecting FB_SIG periods
+  BALANCE_COAST,                // Drum coasting down before tumbling
+  BALANCE_TUMBLE,               // Reverse tumbles to break up the load
+  BALANCE_STOP,                 // Coasting down before handing over to the user
+  BALANCE_MANUAL,               // Inverter off, waiting for HALT
+};
+
+struct StageContext {
+  uint8_t step;                 // Index of the running step in the stage table
+  bool entered;                 // Entry actions of the running step done
+  uint8_t agitationStep;        // Position within the current agitation iteration
+  uint16_t iteration;           // Agitation iterations completed in the running step
+  unsigned long stepStart;      // millis() when the running step began
+  unsigned long agitationStart; // millis() when the current agitation step began
+  uint32_t runPulses;           // FB_SIG pulse total when the current run began
+  bool feedback;                // The last run produced FB_SIG pulses
+  BalancePhase balancePhase;    // OP_BALANCE: current phase
+  uint8_t balanceAttempt;       // OP_BALANCE: ripple measurements made
+  uint8_t balanceSettled;       // OP_BALANCE: revolutions in a row near distribution speed
+  bool balanceArmed;            // OP_BALANCE: manual prompt shown, waiting for a fresh HALT press
+  unsigned long balanceStart;   // OP_BALANCE: millis() when the phase began
+  RippleMeter ripple;           // OP_BALANCE: FB_SIG period statistics
+  uint8_t spinStage;            // OP_SPIN: index into the profile's stages
+  bool spinHolding;             // OP_SPIN: ramp done, holding speed
+  unsigned long spinStageStart; // OP_SPIN: millis() when the stage's ramp or hold began
+  unsigned long flatSince;      // OP_SPIN / OP_DRAIN: millis() when the sump went flat (0 = not flat)
+  uint32_t sumpAt;              // OP_SPIN / OP_DRAIN: timestamp of the last sump sample
+  FlowEstimator sumpFlow;       // OP_SPIN / OP_DRAIN: sump level slope
+  float drainLowest;            // OP_DRAIN: level at the last progress
+  unsigned long drainProgressAt; // OP_DRAIN: millis() of the last DRAIN_STALL_DROP_L drop
+  unsigned long drainEmptyAt;   // OP_DRAIN: millis() when the level reached setDrainingWaterLevel (0 = not yet)
+  uint32_t overlapMs;           // Stage time agitated while filling (stage report)
+  uint32_t creditMs;            // Part of overlapMs the next OP_AGITATE has not taken off yet
+};
+
+// Stage table step operations
+enum StepOp : uint8_t {
+  OP_OUTPUTS,                   // Switch relay outputs ON (arg) and OFF (arg2)
+  OP_SCREEN,                    // Clear the LCD and print two rows
+  OP_NOTIFY,                    // Queue a Telegram notice
+  OP_PWM,                       // Ramp CTR_SIG to duty arg over durationMs, trimmed to hold count rpm when nonzero
+  OP_WAIT,                      // Hold for durationMs
+  OP_FILL,                      // Fill to setFillingWaterLevel + arg litres, closing IV early (fill_predictor.h; fault if it stalls); agitation: pipelined
+  OP_DRAIN,                     // Wait until the level flattens near setDrainingWaterLevel (fault if it stalls)
+  OP_AGITATE,                   // Forward/reverse agitation for count iterations or durationMs
+  OP_BALANCE,                   // Distribute the load, redistributing until the ripple is low; ask the user last
+  OP_SPIN,                      // Staged spin, moving on once the sump level stops changing
+};
+
+struct AgitationProfile {
+  uint8_t pwm;                  // CTR_SIG duty while the drum turns (speed loop feedforward)
+  uint16_t rpm;                 // Drum speed held by the speed loop (0 = open loop)
+  uint16_t rampMs;              // S-curve soft start at the start of runMs, coast-down after it
+  uint16_t runMs;               // Run time in each direction
+  uint16_t stopMs;              // Coast before the changeover while FB_SIG is silent and nothing is learned
+  uint16_t reverseSettleMs;     // Pause after switching CO1/CO2 to reverse (FB_SIG silent)
+  uint16_t forwardSettleMs;     // Pause after switching back to forward (FB_SIG silent)
+};
+
+struct BalanceProfile {
+  uint8_t pwm;                  // Distribution speed duty (speed loop feedforward)
+  uint16_t rpm;                 // Distribution speed
+  uint16_t rampMs;              // S-curve ramp to distribution speed and back down
+  uint16_t settleMs;            // Time at speed before measuring
+  uint16_t measureMs;           // Ripple measurement time
+  uint8_t rippleMaxPct;         // Highest ripple accepted as balanced
+  uint8_t attempts;             // Measurements before asking the user
+  uint8_t tumbles;              // Reverse tumble iterations between attempts
+  const AgitationProfile *tumble;
+};
+
+struct SpinStage {
+  const char *name;             // LCD row 1 and the spin report
+  uint8_t pwm;                  // CTR_SIG duty (speed loop feedforward)
+  uint16_t rpm;                 // Drum speed held by the speed loop
+  uint16_t rampMs;              // S-curve ramp from the previous stage
+  uint32_t minMs;               // Hold before the sump level is allowed to end the stage
+  uint32_t maxMs;               // Hold limit whatever the sump level does
+};
+
+struct SpinProfile {
+  const SpinStage *stages;
+  uint8_t count;
+  float flatLpm;                // Sump slope (L/min, either sign) counted as no more extraction
+  uint16_t flatHoldMs;          // Slope must stay flat this long
+  float sumpMarginL;            // ... with the level at most this far above setDrainingWaterLevel
+};
+
+enum SpinEnd : uint8_t {
+  SPIN_END_NONE,
+  SPIN_END_EXTRACTED,           // Sump level flattened during the final stage
+  SPIN_END_TIME_LIMIT,          // Final stage ran for maxMs
+};
+
+struct StageStep {
+  StepOp op;
+  uint8_t arg;                  // OP_OUTPUTS: ON mask, OP_PWM: duty, OP_FILL: litres above target
+  uint8_t arg2;                 // OP_OUTPUTS: OFF mask
+  uint16_t count;               // OP_AGITATE: iterations (0 = run for durationMs), OP_PWM: target rpm (0 = open loop)
+  uint32_t durationMs;          // OP_WAIT / OP_AGITATE, OP_PWM: S-curve ramp time
+  const char *text;             // OP_SCREEN row 0, OP_NOTIFY message, OP_FILL/OP_DRAIN label
+  const char *text2;            // OP_SCREEN row 1, OP_FILL completion notice
+  const AgitationProfile *agitation;
+  volatile float *usage;        // OP_FILL: records the filled volume (NULL = none)
+  const BalanceProfile *balance; // OP_BALANCE
+  const SpinProfile *spin;      // OP_SPIN
+};
+
+struct StageTable {
+  const StageStep *steps;
+  uint8_t numSteps;
+};
+
+struct CycleStep {
+  CycleStage stage;             // Stage to run
+  LedScene scene;               // Status LEDs while the stage runs
+  const char *doneMessage;      // Telegram notice when the stage completes (NULL = none)
+};
+
+struct CycleProgram {
+  const char *title;            // LCD confirmation screen, line 1
+  const char *duration;         // LCD confirmation screen, line 2
+  const char *startMessage;     // Telegram notice when the program starts
+  uint8_t confirmLeds;          // LED_BIT_* lit while waiting for confirmation
+  volatile float *waterUsed;    // Water usage reported at the end (NULL = none)
+  uint8_t numSteps;
+  CycleStep steps[4];
+};
+
+enum CycleEventType { CYCLE_EVT_DONE, CYCLE_EVT_FAULT };
+
+struct CycleEvent {
+  CycleEventType type;
+};
+
+enum OutboxKind : uint8_t { OUTBOX_SEND, OUTBOX_EDIT };
+
+struct OutboxMessage {
+  OutboxKind kind;
+  int8_t slot;                  // Progress slot (-1 = plain message, not editable)
+  bool markdown;                // parse_mode "Markdown"
+  char *text;                   // Heap copy, freed by CommsTask
+};
+
+struct OutboxStats {
+  uint32_t sent;                // Messages delivered
+  uint32_t edits;               // Edits delivered
+  uint32_t coalesced;           // Edits replaced by a newer edit before delivery
+  uint32_t retries;             // Failed API calls that were retried
+  uint32_t dropped;             // Messages lost (queue full, out of memory, retries exhausted)
+};
+
+struct LevelSample {
+  std::atomic<uint32_t> seq;    // Publication number (0 while being written)
+  uint32_t timestamp;           // millis() when the conversion was clocked out
+  int32_t raw;                  // Unfiltered HX710B counts
+  float units;                  // Filtered reading, scaled like level.get_units()
+  float litres;                 // Filtered, calibrated water level
+};
+
+struct LevelReading {
+  uint32_t seq;
+  uint32_t timestamp;
+  int32_t raw;
+  float units;
+  float litres;
+};
+
+struct LevelSamplerStats {
+  uint32_t samples;             // Conversions published
+  uint32_t dropped;             // Conversions missed because the task was late
+  uint32_t notReady;            // Periods of LEVEL_STALE_MS without a conversion
+  float rateHz;                 // Publish rate over the last second
+};
+
+struct DrumSpeed {
+  float rpm;                    // Drum speed over the last RPM_WINDOW samples
+  float maxRpm;                 // Highest rpm since boot
+  uint32_t pulses;              // FB_SIG pulses since boot
+  uint32_t lastPulseAt;         // millis() of the last sample that saw a pulse
+  uint32_t samples;             // Speed updates
+};
+
+typedef void (*DriveDoneCallback)(void *arg);
+
+struct DriveStep {
+  uint8_t duty;                 // CTR_SIG duty at the end of the ramp
+  uint16_t rpm;                 // Speed held after the ramp (0 = open loop)
+  uint16_t rampMs;              // S-curve ramp from the current duty (0 = jump)
+  uint32_t holdMs;              // Time at duty/rpm before the next step
+};
+
+struct DriveControl {
+  uint8_t feedforward;          // Duty the speed loop trims around
+  uint16_t targetRpm;           // Closed loop when nonzero
+  uint8_t duty;                 // Duty last written to CTR_SIG (fade target while ramping)
+  uint32_t since;               // millis() the current duty/rpm took effect
+  DriveStep steps[DRIVE_PROFILE_MAX]; // Running motor profile
+  uint8_t count;
+  uint8_t index;                // Current step
+  uint8_t segment;              // Current ramp segment
+  uint8_t fromDuty;             // Duty when the current ramp began
+  bool active;                  // A profile is running
+  bool ramping;                 // A hardware fade is in flight (speed loop paused)
+  uint32_t phaseStart;          // millis() the current segment or hold began
+  DriveDoneCallback done;       // Called from DriveTask when the profile finishes
+  void *doneArg;
+};
+
+struct SpeedLoopStats {
+  uint32_t iterations;          // Closed-loop updates
+  uint64_t totalUs;             // Time spent in them
+  uint32_t maxUs;               // Slowest update
+  uint32_t saturated;           // Updates clamped at feedforward +/- SPEED_TRIM_MAX
+  uint32_t noFeedback;          // Updates held at feedforward because FB_SIG was silent
+  uint32_t profiles;            // Motor profiles run to completion
+  uint32_t cancelled;           // Motor profiles cut short by driveSet() or a new profile
+};
+
+struct ReversalStats {
+  uint32_t reversals;           // CO1/CO2 changeovers made by agitation
+  uint32_t feedbackStops;       // Coast-downs ended by FB_SIG going quiet
+  uint32_t modelStops;          // Coast-downs timed by the learned coast time
+  uint32_t timedStops;          // Coast-downs timed by the table (nothing learned yet)
+  uint32_t timeouts;            // Coast-downs that hit REVERSAL_COAST_MAX_MS
+  uint32_t blocked;             // CO1/CO2 changes refused by the interlock
+  uint16_t learnedCoastMs;      // Drive off to last pulse, moving average
+  uint64_t runMs;               // Agitation time spent driving
+  uint64_t totalMs;             // Agitation time in total
+};
+
+struct BalanceStats {
+  uint32_t runs;                // Spins balanced (automatically or by the user)
+  uint32_t measurements;        // Ripple measurements
+  uint32_t redistributions;     // Tumble rounds after a high ripple
+  uint32_t manual;              // Spins handed to the user
+  float lastRipplePct;          // Ripple of the last measurement
+};
+
+struct SpinStats {
+  uint32_t runs;                // Spins finished
+  uint32_t extracted;           // Spins ended early by a flat sump
+  SpinEnd lastEnd;
+  uint32_t lastMs;              // Spin time of the last run (ramps included)
+  uint32_t lastStageMs[SPIN_STAGE_MAX]; // Per stage time of the last run
+};
+
+struct DrainStats {
+  uint32_t drains;              // Drains completed
+  uint32_t faults;              // Drains stopped by a stalled pump
+  uint32_t lastMs;              // Length of the last drain
+  uint32_t lastTailMs;          // Last drain: time from setDrainingWaterLevel to a flat level
+  uint32_t maxTailMs;           // Longest tail seen
+  uint32_t totalTailMs;         // Sum of tails (average = totalTailMs / drains)
+};
+
+struct FillRun {
+  FlowEstimator flow;           // Rising level while IV is open, settling level after
+  float target;                 // Level the fill is aiming for
+  float levelAtClose;           // Level when IV was closed
+  float rateAtClose;            // Estimated fill rate when IV was closed (L/s)
+  unsigned long closedAt;       // millis() when IV was closed (0 = still filling)
+  unsigned long agitateFrom;    // millis() when pipelined agitation started (0 = not agitating)
+  uint16_t extraLagMs;          // Slosh averaging delay added to the learned lag
+  float progressLevel;          // Level at the last FILL_STALL_RISE_L rise
+  unsigned long progressAt;     // millis() of that rise
+};
+
+struct FillStats {
+  uint32_t fills;               // Fills completed since boot
+  float lastOvershoot;          // Settled level - target of the last fill (L)
+  float totalAbsOvershoot;      // Sum of |overshoot| (for the average)
+  uint32_t agitatedFills;       // Fills that agitated while filling
+  uint32_t overlapMs;           // Drum time overlapped with filling since boot
+  uint32_t faults;              // Fills stopped for want of a rising level
+};
+
+struct StageTiming {
+  uint32_t lastMs;              // Wall time of the stage in the last program
+  uint32_t lastOverlapMs;       // ... of which agitated while filling
+};
+
+struct TelegramCommand {
+  char text[64];                // Message text from CHAT_ID (longer text is cut)
+};
+
+struct ReceiverStats {
+  uint32_t polls;               // getUpdates calls
+  uint32_t reconnects;          // Polls that had to open a new TLS session
+  uint32_t failures;            // Polls that returned early with nothing
+  uint32_t commands;            // Messages from CHAT_ID handed to loop()
+  uint32_t dropped;             // Commands lost to a full commandQueue
+};
+
+struct DisplayStats {
+  uint32_t frames;              // Renders that found at least one changed cell
+  uint32_t cells;               // Characters sent over I2C
+};
+
+struct CycleTickStats {
+  uint32_t ticks;               // Executor ticks since boot
+  uint32_t overruns;            // Ticks that started a full period (or more) late
+  int32_t maxDriftUs;           // Worst lateness against the tick schedule
+  int64_t totalDriftUs;         // Sum of lateness (for the average)
+};
+
 // Button ISRs (IRAM_ATTR: stored in RAM for fast interrupt response)
 void washButtonISR();      // Interrupt handler for WASH button press
 void spinButtonISR();      // Interrupt handler for SPIN button press
 void rinseButtonISR();     // Interrupt handler for RINSE button press
 void compButtonISR();      // Interrupt handler for COMPLETE button press
 void haltButtonISR();      // Interrupt handler for HALT button press
+void buttonEdgeFromISR(InputButton button); // Count an edge for the debounce sampler
+void buttonSampleCallback(void *arg); // esp_timer debounce sampler
+void inputPost(InputEventType type, InputButton button, InputButton other, uint32_t cycles); // Queue an input event
+void handleInputEvent(const InputEvent &event); // Act on one button event in loop()
 
 // Task and Display Functions
-void ledtask(void *parameter);       // FreeRTOS task for LED status blinking
+void ledtask(void *parameter);       // FreeRTOS task applying LED patterns when notified
+void ledSet(uint8_t mask, uint8_t solid, uint8_t blink); // Change the LEDs in mask (never blocks)
+void ledShow(LedScene scene);        // Show a stage scene on the stage LEDs
+void ledBlinkCallback(void *arg);    // esp_timer callback toggling the blinking LEDs
+void displaytask(void *parameter);   // FreeRTOS task copying changed framebuffer cells to the LCD
 void displayPrint();                 // Update 16x2 LCD display with current status
 void displayTestMenu();             // Display engineering mode test menu on LCD
 void reboot();                       // Reboot ESP32 to bootloader mode
@@ -138,11 +675,94 @@ void onOTAStart();                   // Called when OTA upload starts
 void onOTAProgress(size_t current, size_t final); // Progress callback during upload
 void onOTAEnd(bool success);         // Called when OTA upload completes
 
-// Wash Cycle Logic Functions
-void washLogic();                    // Main wash stage execution logic
-void rinseLogic();                   // Main rinse stage execution logic
-void spinLogic();                    // Main spin stage execution logic
-void soakLogic();                    // Pre-wash soak stage execution logic
+// Water Level Sampler Functions
+void levelSamplerTask(void *parameter);               // FreeRTOS task owning the HX711
+void levelPublish(int32_t raw, float units, uint32_t timestamp); // Publish a conversion into the ring buffer
+bool levelRead(uint32_t seq, LevelReading &out);     // Copy one published sample (false if overwritten)
+bool levelLatest(LevelReading &out);                 // Newest sample, never blocks
+float levelAverage(int count);                       // Mean litres over the newest samples
+float levelUnits();                                  // Newest filtered reading in level.get_units() scale
+bool levelSensorReady();                             // Sampler has a recent conversion
+
+// Drum Speed Functions
+bool drumSpeedBegin();               // Start the FB_SIG pulse counter and the rpm sampler
+void rpmSampleCallback(void *arg);   // esp_timer callback turning pulse counts into rpm
+DrumSpeed drumSpeedRead();           // Consistent copy of drumSpeed (never blocks)
+float drumRpm();                     // Current drum speed
+bool drumStalled(uint32_t drivenSince); // No pulse for ROTOR_LOCK_MS while driven since drivenSince
+bool rotorLocked();                  // The drum is driven hard enough to turn but drumStalled()
+void fbPeriodISR();                  // Timestamp FB_SIG edges while the balance meter listens
+void fbPeriodsStart();               // Start collecting FB_SIG pulse periods
+void fbPeriodsStop();                // Stop collecting FB_SIG pulse periods
+void fbPeriodsDrain(RippleMeter &meter); // Feed collected periods into a ripple meter
+bool motorTestWait(uint32_t ms, uint32_t &drivenSince, bool showRpm); // Motor test delay, false on a locked rotor
+void motorTestRampDone(void *arg);   // Motor profile callback waking the test
+
+// Drum Speed Control Functions
+void driveBegin();                   // Take over CTR_SIG with LEDC and start DriveTask
+void driveSet(uint8_t duty, uint16_t rpm = 0); // Drive CTR_SIG now (cancels a profile), holding rpm by PID trim when nonzero
+bool driveProfile(const DriveStep *steps, uint8_t count, DriveDoneCallback done = NULL, void *arg = NULL); // Run ramps and holds in the background
+bool driveRamp(uint8_t duty, uint16_t rpm, uint16_t rampMs, DriveDoneCallback done = NULL, void *arg = NULL); // One S-curve ramp, then hold
+bool driveBusy();                    // A motor profile is still running
+uint8_t driveDuty();                 // Duty on CTR_SIG right now (follows a fade)
+void drivetask(void *parameter);     // FreeRTOS task sequencing motor profile ramps and holds
+TickType_t driveService(TickType_t wait); // One DriveTask pass; returns how long to sleep
+void speedLoopStep(const DrumSpeed &speed);     // One fixed-rate PID update (from rpmSampleCallback)
+void speedLoadGains();               // Restore the tuned PID gains from NVS
+void speedSaveGains();               // Persist the PID gains to NVS
+void sendSpeedTuning();              // Send the speed loop tuning menu
+void handleSpeedTuning(String cmd);  // Process a speed loop tuning command
+void speedStepTest();                // Closed-loop step response on the bench
+
+// Telegram Outbox Functions
+void commstask(void *parameter);     // FreeRTOS task delivering queued Telegram messages
+void outboxService(TickType_t wait); // One CommsTask pass: accept queued messages, make at most one API call
+bool outboxPost(OutboxKind kind, int slot, const String &text, bool markdown); // Queue without blocking
+bool outboxSend(const String &text, bool markdown = false);       // Queue a plain message
+int outboxSendProgress(const String &text, bool markdown = false); // Queue a message that will be edited; returns its slot
+void outboxEdit(int slot, const String &text, bool markdown = false); // Replace a progress message's text
+
+// Telegram Receiver Functions
+void rxtask(void *parameter);        // FreeRTOS task long-polling getUpdates
+
+#if LATENCY_PROBES
+// Latency Probe Functions
+void latencyStart(LatencyPath path, int64_t atUs); // A path's start event happened at atUs (ISR-safe)
+void latencyStop(LatencyPath path);  // The path's end event: record the time since its start
+void latencyReport();                // Print p50/p99/max per path to serial
+#endif
+
+// Actuator Trace Functions
+void relayWrite(Actuator relay, uint8_t level); // Switch one relay output, traced
+void actuatorRecord(Actuator actuator, uint8_t value, uint16_t rampMs = 0); // Trace a commanded actuator change
+void actuatorTraceBegin(int mode);   // A program starts: restart the trace clock
+void actuatorTraceFlush();           // Stream the recorded changes to serial
+
+// Cycle Executor Functions
+void cycletask(void *parameter);     // FreeRTOS task ticking the running program every CYCLE_TICK_MS
+void cycleStart(int mode);           // Hand a program (1-4) over to the executor
+void cycleTick();                    // Advance the running stage by one tick
+void beginCycleStep();               // Reset stage state for the next program step
+bool runStage(CycleStage stage, StageContext &ctx); // Run the stage table interpreter for one tick
+void cycleNotify(const char *format, ...);          // Queue a formatted Telegram notice
+void cycleFault(const char *row0, const char *row1, const char *format, ...); // Stop the program with everything off
+void handleCycleEvents();            // Drain executor events from loop()
+bool runStageStep(const StageStep &step, StageContext &ctx);        // Interpret one stage table step
+bool readWaterLevel();               // Take the newest sampler reading if one arrived
+bool applyOutputs(uint8_t on, uint8_t off);         // Switch OUT_* relay outputs (false: CO1/CO2 interlocked; offs of the rest still applied)
+bool changeoverSafe();               // CO1/CO2 may switch: no drive on the inverter output
+bool agitationCoasted(StageContext &ctx, const AgitationProfile &profile, unsigned long elapsed); // Drum has stopped after a run
+bool balanceLogic(StageContext &ctx, const BalanceProfile &profile, bool entering); // Balance the load before a spin
+bool spinLogic(StageContext &ctx, const SpinProfile &profile, bool entering); // Staged spin with extraction-based stop
+void sumpReset(StageContext &ctx);   // Forget the sump slope history
+bool sumpSample(StageContext &ctx, uint32_t spacingMs, float flatLpm, float marginL, float &lpm); // Take a sump sample, tracking flatSince
+bool fillLogic(StageContext &ctx, const StageStep &step, bool entering); // Fill to target, agitating on the way if pipelined
+bool drainLogic(StageContext &ctx, const char *label, bool entering); // Drain until the level flattens near empty
+unsigned long agitationIterationMs(const AgitationProfile &profile); // Expected length of one iteration
+void showScreen(const char *row0, const char *row1); // Clear the LCD and print both rows
+bool agitationLogic(StageContext &ctx, const AgitationProfile &profile); // One forward/reverse iteration
+void fillLoadLearning();             // Restore the learned IV cutoff lag from NVS
+void fillComplete();                 // Log the settled overshoot and learn from it
 
 // WiFi and Network Functions
 boolean connectWifi();               // Connect to WiFi network using credentials
@@ -166,7 +786,7 @@ void sendMenu();                     // Send main engineering mode menu
 void sendSubMenu();                  // Send component test submenu
 void handleMenu(String cmd);         // Process main menu selections
 void handleSubMenu(String cmd);      // Process submenu selections
-void handleTelegramMessages();       // Poll and process incoming Telegram messages
+void handleTelegramMessages();       // Process commands queued by RxTask
 
 // Engineering Mode Control
 void enterEngineeringMode();         // Activate test mode, disable normal operation
@@ -180,19 +800,11 @@ void loop();                         // Main program loop
 
 /* --------------------  4. State Variables (GLOBAL) (START)  ---------------------- */
 
-// Operating Mode Flags (Mutually exclusive states)
-bool isSoaking = false;              // Soak cycle active
-bool isWashing = false;              // Wash cycle active
-bool isRinsing = false;              // Rinse cycle active
-bool isSpinning = false;             // Spin cycle active
-bool isWaiting = true;               // Idle/waiting state
-bool isCompleteProgramWash = false;  // Complete wash phase of full program
-bool isCompleteProgramRinse = false; // Complete rinse phase of full program
-bool isCompleteProgramSpin = false;  // Complete spin phase of full program
+// Operating Mode Flags
 
 // Control Flags
 bool isSimulation = false;           // Use default HX711 values instead of calibration
-bool buttonPressed = false;          // Flag set when any button is pressed
+bool isFillAgitate = true;           // Pipelined fills: start agitating once the level passes FILL_AGITATE_MIN_L
 bool programRunning = false;         // True if any wash cycle is active
 bool wifiConnected = false;          // WiFi connection status
 
@@ -218,19 +830,139 @@ unsigned long runTime = 0;           // Elapsed time in current cycle
 unsigned long startTime = 0;         // Timestamp when cycle started
 unsigned long startWaitTime = 0;     // Timestamp when wait period started
 unsigned long ota_progress_millis = 0; // Last OTA progress update timestamp
-unsigned long lastButtonPressTime = 0;  // Debounce: time of last button press
+
+// Cycle Executor State
+BalanceStats balanceStats = {};      // Spin balancing counters
+SpinStats spinStats = {};            // Spin profile counters and the last run
+DrainStats drainStats = {};          // Drain completion times
+ReversalStats reversalStats = {};    // Agitation reversal timing and interlock counters
+StageTiming stageTimes[STAGE_SPIN + 1] = {}; // Per stage wall time and fill overlap
+bool isAwaitingBalance = false;      // Spin stage waiting for the user (WiFi LED blinked by the executor)
+int pendingMode = 0;                 // Program awaiting confirmation (0 = none)
+CycleTickStats tickStats = {};       // Executor tick drift statistics
+
+// Water Level Sampler State
+LevelSample levelRing[LEVEL_RING_SIZE];   // Single-producer/multi-consumer sample ring
+std::atomic<uint32_t> levelHead(0);       // seq of the newest published sample
+LevelSamplerStats levelStats = {};        // Sampler rate and drop counters
+
+// Drum Speed State
+DrumSpeed drumSpeed = {};                 // Written by rpmSampleCallback only
+portMUX_TYPE drumSpeedLock = portMUX_INITIALIZER_UNLOCKED;
+int rpmWindow[RPM_WINDOW] = {0};          // Pulses per sample, newest at rpmWindowNext - 1
+int rpmWindowSum = 0;
+uint8_t rpmWindowNext = 0;
+uint8_t rpmWindowFill = 0;
+int rpmLastCount = 0;                     // Accumulated PCNT count at the previous sample
+volatile uint32_t fbPeriods[FB_PERIOD_RING]; // FB_SIG pulse periods (us), written by fbPeriodISR
+volatile uint8_t fbPeriodHead = 0;        // Next slot fbPeriodISR writes
+uint8_t fbPeriodTail = 0;                 // Next slot fbPeriodsDrain reads
+int64_t fbLastEdgeUs = 0;                 // Previous FB_SIG edge (0 = none yet)
+uint32_t rotorDrivenSince = 0;            // millis() since the drum has been driven above the lock duty (0 = not)
+
+// Drum Speed Control State
+DriveControl drive = {};                  // Guarded by driveMutex
+SpeedPid speedPid = {{SPEED_KP_DEFAULT, SPEED_KI_DEFAULT, SPEED_KD_DEFAULT}, 0, 0, false};
+SpeedLoopStats speedStats = {};           // Speed loop cost and clamp counters
+uint8_t tuneDuty = 200;                   // Speed loop tuning: step test feedforward
+uint16_t tuneRpm = 120;                   // Speed loop tuning: step test target
+volatile bool driveFadeDone = false;      // Set by the LEDC fade-end interrupt
+
+// Input State
+InputStats inputStats = {};               // Button event latency statistics
+const uint8_t buttonPins[BUTTON_COUNT] = {WASH_BTN, RINSE_BTN, SPIN_BTN, COMP_BTN, HALT_BTN}; // By InputButton
+const char *const buttonNames[BUTTON_COUNT] = {"WASH", "RINSE", "SPIN", "COMP", "HALT"};
+ButtonState buttonStates[BUTTON_COUNT] = {};
+uint32_t buttonEdges = 0;                 // All edges; stray ones are settled only in a pass none arrived during
+portMUX_TYPE buttonLock = portMUX_INITIALIZER_UNLOCKED;
+
+// Status LED State
+const uint8_t ledPins[] = {WASH_LED, RINSE_LED, SPIN_LED, SOAK_LED, WIFI_LED}; // By LED_BIT_* position
+const LedPattern ledScenes[] = {
+  {0, 0},                                       // LED_SCENE_IDLE
+  {0, LED_BIT_SOAK},                            // LED_SCENE_SOAK
+  {0, LED_BIT_WASH},                            // LED_SCENE_WASH
+  {0, LED_BIT_RINSE},                           // LED_SCENE_RINSE
+  {0, LED_BIT_SPIN},                            // LED_SCENE_SPIN
+  {0, LED_BIT_WASH},                            // LED_SCENE_COMPLETE_WASH
+  {LED_BIT_WASH, LED_BIT_RINSE},                // LED_SCENE_COMPLETE_RINSE: wash done, rinsing
+  {LED_BIT_WASH | LED_BIT_RINSE, LED_BIT_SPIN}, // LED_SCENE_COMPLETE_SPIN: wash and rinse done, spinning
+  {0, LED_STAGE_MASK},                          // LED_SCENE_FAULT: program stopped
+};
+LedPattern ledRequested = {};             // Wanted LED state, written by ledSet()
+volatile uint8_t ledBlinking = 0;         // LED_BIT_* the blink timer toggles
+portMUX_TYPE ledLock = portMUX_INITIALIZER_UNLOCKED;
+
+// Display State
+DisplayStats displayStats = {};           // LCD render counters
+
+// Telegram Outbox State
+OutboxStats outboxStats = {};             // Delivery counters
+std::atomic<uint8_t> outboxNextSlot(0);   // Round-robin progress slot allocator
+
+// Telegram Receiver State
+ReceiverStats rxStats = {};               // Long poll counters
+
+#if LATENCY_PROBES
+// Latency Probe State
+LatencyProbe latencyProbes[LATENCY_PATHS] = {
+  {"level_iv", LATENCY_LEVEL_TIMEOUT_MS * 1000, 0, {}},
+  {"button_relay", LATENCY_BUTTON_TIMEOUT_MS * 1000, 0, {}},
+  {"command_reply", LATENCY_COMMAND_TIMEOUT_MS * 1000, 0, {}},
+};
+portMUX_TYPE latencyLock = portMUX_INITIALIZER_UNLOCKED;
+#endif
+
+// Actuator Trace State
+ActuatorTrace actuatorTrace = {};         // Commanded changes waiting for actuatorTraceFlush()
+unsigned long actuatorTraceStart = 0;     // millis() when the running program's trace began
+portMUX_TYPE actuatorTraceLock = portMUX_INITIALIZER_UNLOCKED;
+
+// Predictive Fill State
+FillRun fillRun = {};                     // Running OP_FILL step
+FillLearning fillLearning = {FILL_LAG_DEFAULT_MS, 0}; // IV cutoff lead time (persisted in NVS)
+FillStats fillStats = {};                 // Overshoot history since boot
+
+// Water level filter: median-of-5 spike rejection, then EMA with 1/4 weight
+const LevelFilterConfig levelFilterConfig = {5, LEVEL_FILTER_EMA, 2, 1000000, 25000000};
+LevelFilter levelFilter;                  // Owned by LevelTask
+
+struct {
+  const CycleProgram *program;       // Running program (NULL = idle)
+  uint8_t step;                      // Index into program->steps
+  unsigned long stageStart;          // millis() when the running stage began
+  StageContext stage;                // Resumable state of the running stage
+} cycle = {};
+
+const char *const stageNames[] = {"", "Soak", "Wash", "Rinse", "Spin"}; // Indexed by CycleStage
+
+// Programs by selectedMode (1=WASH, 2=RINSE, 3=SPIN, 4=COMPLETE)
+const CycleProgram cyclePrograms[] = {
+  {},
+  {"Wash Only", "Time: 30 Min", "Wash Only Started", LED_BIT_WASH, &washWaterUsed, 2,
+   {{STAGE_WASH, LED_SCENE_WASH, "Washing Complete"},
+    {STAGE_SPIN, LED_SCENE_SPIN, NULL}}},
+  {"Rinse Only", "Time: 30 Min", "Rinse Only Started", LED_BIT_RINSE, &rinseWaterUsed, 2,
+   {{STAGE_RINSE, LED_SCENE_RINSE, "Rinsing Complete"},
+    {STAGE_SPIN, LED_SCENE_SPIN, NULL}}},
+  {"Spin Only", "Time: 10 Min", "Spin Only Started", LED_BIT_SPIN, NULL, 1,
+   {{STAGE_SPIN, LED_SCENE_SPIN, "Spinning Complete"}}},
+  {"Complete Wash", "Time: 45 Min", "Complete Wash Started", LED_BIT_WASH | LED_BIT_RINSE | LED_BIT_SPIN, &totalWaterUsed, 4,
+   {{STAGE_WASH, LED_SCENE_COMPLETE_WASH, "Washing Complete"},
+    {STAGE_SPIN, LED_SCENE_COMPLETE_WASH, NULL},
+    {STAGE_RINSE, LED_SCENE_COMPLETE_RINSE, "Rinsing Complete"},
+    {STAGE_SPIN, LED_SCENE_COMPLETE_SPIN, "Spinning Complete"}}},
+};
 
 /* --------------------  4. State Variables (GLOBAL) (END)  ---------------------- */
 
 
 /* --------------------  5. Engineering Mode Variables (START)  ---------------------- */
 bool isTestMode = false;
-int testMenuOption = 0;   // 0 = main menu, 100 = component test submenu
+int testMenuOption = 0;   // 0 = main menu, 100 = component test submenu, 200 = speed loop tuning
 int componentTestOption = 0;  
 const String ENGINEERING_COMMAND = "engineering";
 const String ENGINEERING_EXIT = "exit";
-unsigned long lastTelegramCheck = 0;
-const unsigned long telegramCheckDelay = 1000; 
 
 // ========== VALVE TEST Variables ==========
 const float VALVE_TEST_DURATION = 60000;  // 60 seconds in milliseconds
@@ -239,155 +971,299 @@ const float VALVE_TEST_interval = 1000;  // Sample every 1 second
 const int VALVE_TEST_SAMPLES = VALVE_TEST_DURATION / VALVE_TEST_interval;
 
 // ========== Drain Motor Test Variables ==========
-bool awaitingDrainMotorResponse = false;
 bool drainMotorTestResult = false; // true = smooth, false = stuck
 /* --------------------  5. Engineering Mode Variables (END)  ---------------------- */
 
 
-/* --------------------  6. Button ISRs (START)  ---------------------- */
-void IRAM_ATTR washButtonISR()
+/* --------------------  6. Button Input (START)  ---------------------- */
+// The ISRs fire on both edges and only count them and stamp the first; a
+// shared esp_timer samples all five buttons every BUTTON_SAMPLE_MS in the
+// timer task. A level that holds for BUTTON_DEBOUNCE_MS is a debounced
+// change, and every extra edge before it counts as a bounce. The sampler
+// runs continuously (five pin reads per pass), so the ISRs never touch the
+// timer, and bounce never reaches loop(), which only sees InputEvents.
+void IRAM_ATTR buttonEdgeFromISR(InputButton button)
 {
-  if (!programRunning)
+  ButtonState &b = buttonStates[button];
+  portENTER_CRITICAL_ISR(&buttonLock);
+  if (b.edges++ == 0)
   {
-    selectedMode = 1;
-    lastButtonPressTime = millis();
-    buttonPressed = true;
+    b.edgeCycles = ESP.getCycleCount();
+    if (button == INPUT_HALT && !b.pressed && isAwaitingBalance)
+    {
+      LATENCY_START(LATENCY_BUTTON_RELAY, esp_timer_get_time());
+    }
   }
+  buttonEdges++;
+  portEXIT_CRITICAL_ISR(&buttonLock);
 }
 
-void IRAM_ATTR spinButtonISR() {
-  if (awaitingDrainMotorResponse) {
-    // User pressed SPIN = Motor working smoothly
-    drainMotorTestResult = true;
-    awaitingDrainMotorResponse = false;
-  } else if (!programRunning) {
-    selectedMode = 3;
-    lastButtonPressTime = millis();
-    buttonPressed = true;
-  }
+void IRAM_ATTR washButtonISR()
+{
+  buttonEdgeFromISR(INPUT_WASH);
 }
 
-void IRAM_ATTR rinseButtonISR() {
-  if (awaitingDrainMotorResponse) {
-    // User pressed RINSE = Motor stuck/failed
-    drainMotorTestResult = false;
-    awaitingDrainMotorResponse = false;
-  } else if (!programRunning) {
-    selectedMode = 2;
-    lastButtonPressTime = millis();
-    buttonPressed = true;
-  }
+void IRAM_ATTR spinButtonISR()
+{
+  buttonEdgeFromISR(INPUT_SPIN);
 }
 
+void IRAM_ATTR rinseButtonISR()
+{
+  buttonEdgeFromISR(INPUT_RINSE);
+}
 
 void IRAM_ATTR compButtonISR()
 {
-  if (!programRunning)
-  {
-    selectedMode = 4;
-    lastButtonPressTime = millis();
-    buttonPressed = true;
-  }
+  buttonEdgeFromISR(INPUT_COMP);
 }
 
 void IRAM_ATTR haltButtonISR()
 {
-  selectedMode = 0;
+  buttonEdgeFromISR(INPUT_HALT);
 }
-/* -------------------- 6. Button ISRs (END)  ---------------------- */
 
+void inputPost(InputEventType type, InputButton button, InputButton other, uint32_t cycles)
+{
+  InputEvent event = {type, button, other, cycles};
+  if (xQueueSend(inputQueue, &event, 0) != pdTRUE)
+  {
+    inputStats.dropped++;
+  }
+}
 
-/* -------------------- 7. Status LEDs Control Function (START)  ---------------------- */
-void ledtask(void *parameter)
+void buttonSampleCallback(void *arg)
 {
-  while (true)
+  portENTER_CRITICAL(&buttonLock);
+  uint32_t edgesAtStart = buttonEdges;
+  portEXIT_CRITICAL(&buttonLock);
+
+  uint32_t now = millis();
+  bool busy = false;
+  for (int i = 0; i < BUTTON_COUNT; i++)
   {
-    if (isSoaking)
+    ButtonState &b = buttonStates[i];
+    InputButton button = (InputButton)i;
+    bool level = digitalRead(buttonPins[i]) == LOW;
+    if (level != b.raw)
     {
-      digitalWrite(RINSE_LED, OFF);
-      digitalWrite(SPIN_LED, OFF);
-      digitalWrite(WASH_LED, OFF);
-      digitalWrite(SOAK_LED, OFF);
-      vTaskDelay(500 / portTICK_PERIOD_MS);
-      digitalWrite(SOAK_LED, ON);
-      vTaskDelay(500 / portTICK_PERIOD_MS);
+      b.raw = level;
+      b.stableSamples = 0;
     }
-    else if (isWashing)
+    else if (b.stableSamples < 255)
     {
-      digitalWrite(SOAK_LED, OFF);
-      digitalWrite(RINSE_LED, OFF);
-      digitalWrite(SPIN_LED, OFF);
-      digitalWrite(WASH_LED, OFF);
-      vTaskDelay(500 / portTICK_PERIOD_MS);
-      digitalWrite(WASH_LED, ON);
-      vTaskDelay(500 / portTICK_PERIOD_MS);
+      b.stableSamples++;
     }
-    else if (isRinsing)
+    if (b.stableSamples * BUTTON_SAMPLE_MS < BUTTON_DEBOUNCE_MS)
     {
-      digitalWrite(SOAK_LED, OFF);
-      digitalWrite(WASH_LED, OFF);
-      digitalWrite(SPIN_LED, OFF);
-      digitalWrite(RINSE_LED, OFF);
-      vTaskDelay(500 / portTICK_PERIOD_MS);
-      digitalWrite(RINSE_LED, ON);
-      vTaskDelay(500 / portTICK_PERIOD_MS);
+      busy = true;
+      continue;
     }
-    else if (isSpinning)
+
+    if (b.raw != b.pressed)
     {
-      digitalWrite(SOAK_LED, OFF);
-      digitalWrite(WASH_LED, OFF);
-      digitalWrite(RINSE_LED, OFF);
-      digitalWrite(SPIN_LED, OFF);
-      vTaskDelay(500 / portTICK_PERIOD_MS);
-      digitalWrite(SPIN_LED, ON);
-      vTaskDelay(500 / portTICK_PERIOD_MS);
+      // Debounced change: settle the edge count
+      portENTER_CRITICAL(&buttonLock);
+      uint16_t edges = b.edges;
+      uint32_t cycles = b.edgeCycles;
+      b.edges = 0;
+      portEXIT_CRITICAL(&buttonLock);
+      if (edges > 1)
+      {
+        b.bounces += edges - 1;
+      }
+
+      b.pressed = b.raw;
+      if (b.pressed)
+      {
+        b.downAt = now;
+        b.downCycles = cycles;
+        b.pressSent = b.longSent = b.chorded = false;
+        // A button pressed moments ago and not yet reported makes this a chord
+        for (int j = 0; j < BUTTON_COUNT; j++)
+        {
+          ButtonState &first = buttonStates[j];
+          if (j != i && first.pressed && !first.pressSent && !first.chorded)
+          {
+            first.chorded = b.chorded = true;
+            inputPost(INPUT_CHORD, (InputButton)j, button, first.downCycles);
+            break;
+          }
+        }
+      }
+      else
+      {
+        if (!b.pressSent && !b.chorded)
+        {
+          // Tap shorter than the chord window
+          inputPost(INPUT_PRESS, button, button, b.downCycles);
+        }
+        inputPost(INPUT_RELEASE, button, button, cycles);
+      }
     }
-    else if (isCompleteProgramWash)
+
+    if (b.pressed)
     {
-      digitalWrite(SOAK_LED, OFF);
-      digitalWrite(RINSE_LED, OFF);
-      digitalWrite(SPIN_LED, OFF);
-      digitalWrite(WASH_LED, OFF);
-      vTaskDelay(500 / portTICK_PERIOD_MS);
-      digitalWrite(WASH_LED, ON);
-      vTaskDelay(500 / portTICK_PERIOD_MS);
+      busy = true;
+      if (!b.chorded && !b.pressSent && now - b.downAt >= BUTTON_CHORD_MS)
+      {
+        b.pressSent = true;
+        inputPost(INPUT_PRESS, button, button, b.downCycles);
+      }
+      if (!b.chorded && !b.longSent && now - b.downAt >= BUTTON_LONG_PRESS_MS)
+      {
+        b.longSent = true;
+        inputPost(INPUT_LONG_PRESS, button, button, b.downCycles);
+      }
     }
-    else if (isCompleteProgramRinse)
+  }
+
+  portENTER_CRITICAL(&buttonLock);
+  if (!busy && buttonEdges == edgesAtStart)
+  {
+    // Idle: edges that never became a change were glitches
+    for (int i = 0; i < BUTTON_COUNT; i++)
     {
-      digitalWrite(SOAK_LED, OFF);
-      digitalWrite(WASH_LED, ON);
-      digitalWrite(SPIN_LED, OFF);
-      digitalWrite(RINSE_LED, OFF);
-      vTaskDelay(500 / portTICK_PERIOD_MS);
-      digitalWrite(RINSE_LED, ON);
-      vTaskDelay(500 / portTICK_PERIOD_MS);
+      buttonStates[i].bounces += buttonStates[i].edges;
+      buttonStates[i].edges = 0;
+    }
+  }
+  portEXIT_CRITICAL(&buttonLock);
+}
+/* -------------------- 6. Button Input (END)  ---------------------- */
+
+
+/* -------------------- 7. Status LEDs Control Function (START)  ---------------------- */
+// LEDs change only through ledSet(), which records the wanted state and
+// notifies LEDTask, so a stage change shows on the next scheduler tick.
+// LEDTask writes the solid LEDs and hands the blinking ones to an esp_timer;
+// with nothing blinking the timer is stopped and no code runs at all.
+void ledSet(uint8_t mask, uint8_t solid, uint8_t blink)
+{
+  portENTER_CRITICAL(&ledLock);
+  uint8_t newSolid = (ledRequested.solid & ~mask) | (solid & mask);
+  uint8_t newBlink = (ledRequested.blink & ~mask) | (blink & mask);
+  bool changed = newSolid != ledRequested.solid || newBlink != ledRequested.blink;
+  ledRequested.solid = newSolid;
+  ledRequested.blink = newBlink;
+  portEXIT_CRITICAL(&ledLock);
+  if (changed && ledtask_handle != NULL)
+  {
+    xTaskNotifyGive(ledtask_handle);
+  }
+}
+
+void ledShow(LedScene scene)
+{
+  ledSet(LED_STAGE_MASK, ledScenes[scene].solid, ledScenes[scene].blink);
+}
+
+void ledBlinkCallback(void *arg)
+{
+  static bool phase = false;
+  phase = !phase;
+  uint8_t blinking = ledBlinking;
+  for (int i = 0; i < 5; i++)
+  {
+    if (blinking & (1 << i))
+      digitalWrite(ledPins[i], phase ? ON : OFF);
+  }
+}
+
+void ledtask(void *parameter)
+{
+  const esp_timer_create_args_t timerArgs = {ledBlinkCallback, NULL, ESP_TIMER_TASK, "led_blink", true};
+  esp_timer_create(&timerArgs, &ledBlinkTimer);
+
+  while (true)
+  {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+    portENTER_CRITICAL(&ledLock);
+    LedPattern pattern = ledRequested;
+    portEXIT_CRITICAL(&ledLock);
+    pattern.solid &= ~pattern.blink;
+
+    // Blinking LEDs restart lit so the change is visible at once
+    esp_timer_stop(ledBlinkTimer);
+    ledBlinking = pattern.blink;
+    for (int i = 0; i < 5; i++)
+    {
+      digitalWrite(ledPins[i], ((pattern.solid | pattern.blink) & (1 << i)) ? ON : OFF);
     }
-    else if (isCompleteProgramSpin)
+    if (pattern.blink != 0)
     {
-      digitalWrite(SOAK_LED, OFF);
-      digitalWrite(WASH_LED, ON);
-      digitalWrite(RINSE_LED, ON);
-      digitalWrite(SPIN_LED, OFF);
-      vTaskDelay(500 / portTICK_PERIOD_MS);
-      digitalWrite(SPIN_LED, ON);
-      vTaskDelay(500 / portTICK_PERIOD_MS);
+      esp_timer_start_periodic(ledBlinkTimer, LED_BLINK_MS * 1000ULL);
     }
-    else if (selectedMode == 0)
+  }
+}
+/* --------------------  7. Status LEDs Control Function (END)  ---------------------- */
+
+
+/* --------------------  8. LCD Render Task (START)  ---------------------- */
+// `display` is only a framebuffer; this task is the sole user of `lcd` and
+// the I2C bus. Every DISPLAY_REFRESH_MS it compares a snapshot against what
+// it last sent and rewrites only the runs of changed cells, so a clear and
+// reprint of the same text costs no I2C traffic at all.
+void displaytask(void *parameter)
+{
+  char shown[DISPLAY_ROWS][DISPLAY_COLS];
+  char frame[DISPLAY_ROWS][DISPLAY_COLS];
+  bool shownBacklight = true;
+  lcd.init();
+  lcd.backlight();
+  lcd.clear();
+  memset(shown, ' ', sizeof(shown));
+
+  TickType_t lastWake = xTaskGetTickCount();
+  while (true)
+  {
+    vTaskDelayUntil(&lastWake, pdMS_TO_TICKS(DISPLAY_REFRESH_MS));
+    bool backlight = display.snapshot(frame);
+    if (backlight != shownBacklight)
     {
-      digitalWrite(SOAK_LED, OFF);
-      digitalWrite(RINSE_LED, OFF);
-      digitalWrite(SPIN_LED, OFF);
-      digitalWrite(WASH_LED, OFF);
+      backlight ? lcd.backlight() : lcd.noBacklight();
+      shownBacklight = backlight;
+    }
 
-      vTaskDelay(pdMS_TO_TICKS(100));
-      continue;
+    bool changed = false;
+    for (uint8_t row = 0; row < DISPLAY_ROWS; row++)
+    {
+      uint8_t col = 0;
+      while (col < DISPLAY_COLS)
+      {
+        if (frame[row][col] == shown[row][col])
+        {
+          col++;
+          continue;
+        }
+        // One setCursor per run; an unchanged cell between two changes is cheaper to resend
+        uint8_t end = col + 1;
+        while (end < DISPLAY_COLS && (frame[row][end] != shown[row][end] ||
+                                      (end + 1 < DISPLAY_COLS && frame[row][end + 1] != shown[row][end + 1])))
+        {
+          end++;
+        }
+        lcd.setCursor(col, row);
+        for (; col < end; col++)
+        {
+          lcd.write(frame[row][col]);
+          shown[row][col] = frame[row][col];
+          displayStats.cells++;
+        }
+        changed = true;
+      }
+    }
+    if (changed)
+    {
+      displayStats.frames++;
     }
-    vTaskDelay(pdMS_TO_TICKS(50));
   }
 }
-/* --------------------  7. Status LEDs Control Function (END)  ---------------------- */
+/* --------------------  8. LCD Render Task (END)  ---------------------- */
 
-/* --------------------  8. OTA Helper Functions (START)  ---------------------- */
+
+/* --------------------  9. OTA Helper Functions (START)  ---------------------- */
 void onOTAStart()
 {
   Serial.println("OTA update started!");
@@ -400,7 +1276,7 @@ void onOTAProgress(size_t current, size_t final)
   {
     ota_progress_millis = millis();
     // Print to serial monitor
-    Serial.printf("OTA Progress Current: %u bytes, Final: %u bytes\n", current, final);
+    Serial.printf("OTA Progress Current: %u bytes, Final: %u bytes\n", (unsigned)current, (unsigned)final);
     // Toggle the WiFi LED
     digitalWrite(WIFI_LED, !digitalRead(WIFI_LED));
     // Update display
@@ -451,7 +1327,7 @@ void onOTAEnd(bool success)
     display.print("Rebooting.....");
   }
 }
-/* --------------------  8. OTA Helper Functions (END)  ---------------------- */
+/* --------------------  9. OTA Helper Functions (END)  ---------------------- */
 
 
 /* --------------------  Menu Print Function (START)  ---------------------- */
@@ -466,382 +1342,2047 @@ void displayPrint()
 /* --------------------  Menu Print Function (END)  ---------------------- */
 
 
-/* --------------------  9. Wash Program Function (START)  ---------------------- */
-void washLogic()
+/* --------------------  10. Stage Program Tables (START)  ---------------------- */
+// Each stage is a flat list of steps run by runStage(). Timings, PWM duties and
+// fill targets live here; adding a program means adding table rows, not code.
+// Drum speeds are held by the speed loop with the duty as its starting point;
+// the rpm targets are the speeds the table duty gives at half load.
+// Every helper starts from a value-initialised step, so fields it does not set are zero
+constexpr StageStep stageStep(StepOp op) { StageStep s{}; s.op = op; return s; }
+constexpr StageStep outputs(uint8_t on, uint8_t off) { StageStep s = stageStep(OP_OUTPUTS); s.arg = on; s.arg2 = off; return s; }
+constexpr StageStep screen(const char *row0, const char *row1) { StageStep s = stageStep(OP_SCREEN); s.text = row0; s.text2 = row1; return s; }
+constexpr StageStep notify(const char *message) { StageStep s = stageStep(OP_NOTIFY); s.text = message; return s; }
+constexpr StageStep pwm(uint8_t duty) { StageStep s = stageStep(OP_PWM); s.arg = duty; return s; }
+constexpr StageStep speed(uint8_t duty, uint16_t rpm, uint32_t rampMs) { StageStep s = stageStep(OP_PWM); s.arg = duty; s.count = rpm; s.durationMs = rampMs; return s; }
+constexpr StageStep wait(uint32_t ms) { StageStep s = stageStep(OP_WAIT); s.durationMs = ms; return s; }
+constexpr StageStep fill(uint8_t extraLitres, const char *label, volatile float *usage, const char *notice) { StageStep s = stageStep(OP_FILL); s.arg = extraLitres; s.text = label; s.text2 = notice; s.usage = usage; return s; }
+constexpr StageStep fillAgitating(const AgitationProfile &profile, uint8_t extraLitres, const char *label, volatile float *usage, const char *notice) { StageStep s = fill(extraLitres, label, usage, notice); s.agitation = &profile; return s; }
+constexpr StageStep drain(const char *label) { StageStep s = stageStep(OP_DRAIN); s.text = label; return s; }
+constexpr StageStep agitateFor(const AgitationProfile &profile, uint32_t ms) { StageStep s = stageStep(OP_AGITATE); s.durationMs = ms; s.agitation = &profile; return s; }
+constexpr StageStep agitateTimes(const AgitationProfile &profile, uint16_t iterations) { StageStep s = stageStep(OP_AGITATE); s.count = iterations; s.agitation = &profile; return s; }
+constexpr StageStep balance(const BalanceProfile &profile) { StageStep s = stageStep(OP_BALANCE); s.balance = &profile; return s; }
+constexpr StageStep spin(const SpinProfile &profile) { StageStep s = stageStep(OP_SPIN); s.spin = &profile; return s; }
+
+//                                        PWM  RPM  Ramp  Run    Stop  Reverse  Forward
+constexpr AgitationProfile washPhase1  = {200, 120, 1000,  6000, 3000, 3000,    3000};
+constexpr AgitationProfile washPhase2  = {200, 120, 1000, 45000, 3000, 3000,    3000};
+constexpr AgitationProfile rinsePhase  = {200, 120, 1000, 30000, 2500, 2500,    2500};
+constexpr AgitationProfile soakPhase   = {200, 100,  800,  4000, 2500, 4000,    2500};
+constexpr AgitationProfile tumblePhase = {120,  60,  500,  3000, 1500, 1500,    1500};
+constexpr AgitationProfile fillPhase   = {150,  60,  800,  4000, 2000, 2000,    2000};
+
+//                                         PWM  RPM  Ramp  Settle  Measure  Ripple%  Attempts  Tumbles
+constexpr BalanceProfile spinBalance    = {35,  90,  3000, 4000,   6000,    10,      3,        2,      &tumblePhase};
+
+// The balance step leaves the drum at distribution speed. Worst case is the
+// old fixed 180 s at duty 50; a light load usually stops well before that.
+//                                       Name            PWM  RPM  Ramp  Min    Max
+constexpr SpinStage spinStages[]     = {{"Distribution", 35,  90,  0,    10000, 10000},
+                                        {"Plateau",      42,  400, 8000, 20000, 50000},
+                                        {"Final Speed",  50,  600, 8000, 30000, 120000}};
+
+//                                       Stages      Count  Flat L/min  Flat Hold  Sump Margin L
+constexpr SpinProfile spinProfile    = {spinStages, 3,     0.2f,       10000,     0.5f};
+
+constexpr StageStep soakSteps[] = {
+  outputs(0, OUT_INV_PW | OUT_DM_SPIN | OUT_DM_WASH | OUT_CO1 | OUT_CO2),
+  fillAgitating(fillPhase, 0, "SOAK", NULL, NULL),
+  outputs(OUT_DM_WASH | OUT_INV_PW, 0),
+  screen(" Soaking.....", ""),
+  wait(100),
+  agitateTimes(soakPhase, 50),
+  outputs(0, OUT_INV_PW | OUT_DM_WASH),
+};
+
+constexpr StageStep washSteps[] = {
+  outputs(0, OUT_INV_PW | OUT_DM_SPIN | OUT_DM_WASH | OUT_CO1 | OUT_CO2),
+  fillAgitating(fillPhase, 0, "WASH", &washWaterUsed, "Wash Water filling complete. Filled: %.2f L"),
+  wait(3000),
+  outputs(OUT_INV_PW, 0),
+  screen(" Washing... PH1", ""),
+  agitateFor(washPhase1, 180000),
+  outputs(0, OUT_INV_PW | OUT_DM_WASH),
+  screen("Adjusting Water", "    Level"),
+  fill(2, NULL, NULL, NULL),
+  outputs(OUT_INV_PW, 0),
+  screen(" Washing... PH2", ""),
+  agitateFor(washPhase2, 180000),
+  outputs(0, OUT_INV_PW),
+  screen("    Washing", "    Complete"),
+  wait(6000),
+};
+
+constexpr StageStep rinseSteps[] = {
+  fillAgitating(fillPhase, 0, "RINSE", &rinseWaterUsed, "Rinse Water filling complete. Filled: %.2f L"),
+  wait(500),
+  outputs(OUT_INV_PW, 0),
+  screen(" Rinsing.....", ""),
+  agitateFor(rinsePhase, 360000),
+  outputs(0, OUT_INV_PW),
+  screen("    Rinsing", "    Complete"),
+  wait(15000),
+};
+
+constexpr StageStep spinSteps[] = {
+  outputs(OUT_DM_WASH | OUT_DM_SPIN, OUT_INV_PW),
+  wait(1000),
+  drain("DRAIN"),
+  outputs(0, OUT_CO1 | OUT_CO2),
+  notify("Water Drain Complete. Balancing the load before spinning."),
+  outputs(OUT_INV_PW, 0),
+  wait(1000),
+  screen("Balancing Load", ""),
+  balance(spinBalance),
+  wait(1000),
+  screen(" Spinning....", ""),
+  spin(spinProfile),
+  outputs(0, OUT_INV_PW),
+  wait(2000),
+  outputs(OUT_CO1, 0),
+  wait(40000),
+  outputs(0, OUT_DM_SPIN | OUT_DM_WASH | OUT_IV | OUT_CO1 | OUT_CO2),
+};
+
+// Indexed by CycleStage
+const StageTable stageTables[] = {
+  {NULL, 0},
+  {soakSteps, sizeof(soakSteps) / sizeof(soakSteps[0])},
+  {washSteps, sizeof(washSteps) / sizeof(washSteps[0])},
+  {rinseSteps, sizeof(rinseSteps) / sizeof(rinseSteps[0])},
+  {spinSteps, sizeof(spinSteps) / sizeof(spinSteps[0])},
+};
+/* --------------------  10. Stage Program Tables (END)  ---------------------- */
+
+
+/* --------------------  11. Water Level Sampler (START)  ---------------------- */
+// LevelTask is the only user of `level` after setup(). Each conversion goes
+// through levelFilter and is published into levelRing[]: the slot is written
+// first, then its seq, then levelHead, so readers never wait on the HX710B.
+void levelPublish(int32_t raw, float units, uint32_t timestamp)
 {
-  programRunning = true;
-  digitalWrite(INV_PW, OFF);
-  digitalWrite(DM_SPIN, OFF);
-  digitalWrite(DM_WASH, OFF);
-  digitalWrite(CO1, OFF);
-  digitalWrite(CO2, OFF);
-  display.clear();
-  display.setCursor(0, 0);
-  display.print("Filling Water..");
-  display.setCursor(0, 1);
-  display.print("WASH");
-  display.setCursor(13, 1);
-  display.print("L");
+  uint32_t seq = levelHead.load(std::memory_order_relaxed) + 1;
+  LevelSample &slot = levelRing[seq % LEVEL_RING_SIZE];
+  slot.seq.store(0, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  slot.timestamp = timestamp;
+  slot.raw = raw;
+  slot.units = units;
+  slot.litres = units / multiplier - offset;
+  slot.seq.store(seq, std::memory_order_release);
+  levelHead.store(seq, std::memory_order_release);
+}
 
-  // Water Filling Control
-  while (waterLevel < setFillingWaterLevel)
+bool levelRead(uint32_t seq, LevelReading &out)
+{
+  const LevelSample &slot = levelRing[seq % LEVEL_RING_SIZE];
+  if (slot.seq.load(std::memory_order_acquire) != seq)
   {
-    digitalWrite(IV, ON);
-    tareWaterLevel = level.get_units() / multiplier;
-    waterLevel = tareWaterLevel - offset;
-    Serial.println(waterLevel, 1);
-    display.setCursor(8, 1);
-    display.print(waterLevel, 1);
+    return false;
   }
-  washWaterUsed = waterLevel;
-  delay(10);
-  String message = "Wash Water filling complete. Filled: " + String(washWaterUsed) + " L";
-  telegram.sendMessage(CHAT_ID, message, "");
-  display.clear();
-  display.setCursor(2, 0);
-  display.print("Water Filled");
-  display.setCursor(1, 1);
-  display.print("Value:      L");
-  display.setCursor(8, 1);
-  display.print(waterLevel, 1);
-  digitalWrite(IV, OFF);
-  digitalWrite(DM_WASH, OFF);
-  vTaskDelay(3000 / portTICK_PERIOD_MS);
-  digitalWrite(INV_PW, ON);
-  display.clear();
-  display.setCursor(1, 0);
-  display.print("Washing... PH1");
+  out.seq = seq;
+  out.timestamp = slot.timestamp;
+  out.raw = slot.raw;
+  out.units = slot.units;
+  out.litres = slot.litres;
+  std::atomic_thread_fence(std::memory_order_acquire);
+  // Overwritten while copying (reader stalled for a full ring): discard
+  return slot.seq.load(std::memory_order_relaxed) == seq;
+}
 
-  unsigned long washPhase1Duration = 180000;
-  unsigned long washPhase1StartTime = millis();
-  while (millis() - washPhase1StartTime < washPhase1Duration)
+bool levelLatest(LevelReading &out)
+{
+  for (int attempt = 0; attempt < 3; attempt++)
   {
-    unsigned long elapsed = millis() - washPhase1StartTime;
-    int iteration = (elapsed / 12000) % 10; // Adjust according to the total number of iterations
-    display.setCursor(0, 1);
-    display.print("Iteration:");
-    display.setCursor(11, 1);
-    display.print(iteration);
-    display.setCursor(12, 1);
-    display.print("/10");
-
-    analogWrite(CTR_SIG, 200);
-    vTaskDelay(6000 / portTICK_PERIOD_MS);
-    analogWrite(CTR_SIG, 0);
-    vTaskDelay(3000 / portTICK_PERIOD_MS);
-    digitalWrite(CO1, ON);
-    digitalWrite(CO2, ON);
-    vTaskDelay(3000 / portTICK_PERIOD_MS);
-    analogWrite(CTR_SIG, 200);
-    vTaskDelay(6000 / portTICK_PERIOD_MS);
-    analogWrite(CTR_SIG, 0);
-    vTaskDelay(3000 / portTICK_PERIOD_MS);
-    digitalWrite(CO1, OFF);
-    digitalWrite(CO2, OFF);
-    vTaskDelay(3000 / portTICK_PERIOD_MS);
+    uint32_t head = levelHead.load(std::memory_order_acquire);
+    if (head == 0)
+    {
+      return false;
+    }
+    if (levelRead(head, out))
+    {
+      return true;
+    }
   }
+  return false;
+}
 
-  digitalWrite(INV_PW, OFF);
-  digitalWrite(DM_WASH, OFF);
-  display.clear();
-  display.setCursor(0, 0);
-  display.print("Adjusting Water");
-  display.setCursor(4, 1);
-  display.print("Level");
- while (waterLevel < setFillingWaterLevel + 2)
-  {
-    digitalWrite(IV, ON);
-    tareWaterLevel = level.get_units() / multiplier;
-    waterLevel = tareWaterLevel - offset;
-    Serial.println(waterLevel, 1);
-    display.setCursor(8, 1);
-    display.print(waterLevel, 1);
+float levelAverage(int count)
+{
+  uint32_t head = levelHead.load(std::memory_order_acquire);
+  float total = 0;
+  int used = 0;
+  LevelReading reading;
+  for (int i = 0; i < count && i < LEVEL_RING_SIZE - 1 && head > (uint32_t)i; i++)
+  {
+    if (levelRead(head - i, reading))
+    {
+      total += reading.litres;
+      used++;
+    }
   }
+  return used ? total / used : waterLevel;
+}
 
-  digitalWrite(IV, OFF);
-  display.clear();
-  display.setCursor(1, 0);
-  display.print("Washing... PH2");
-  digitalWrite(INV_PW, ON);
+float levelUnits()
+{
+  LevelReading reading;
+  return levelLatest(reading) ? reading.units : 0;
+}
+
+bool levelSensorReady()
+{
+  LevelReading reading;
+  return levelLatest(reading) && millis() - reading.timestamp < LEVEL_STALE_MS;
+}
+
+void levelSamplerTask(void *parameter)
+{
+  uint32_t lastSample = 0;
+  uint32_t windowStart = millis();
+  uint32_t windowSamples = 0;
+  levelFilterInit(levelFilter, levelFilterConfig);
 
-  unsigned long washPhase2Duration = 180000;
-  unsigned long washPhase2StartTime = millis();
-  while (millis() - washPhase2StartTime < washPhase2Duration)
+  while (true)
   {
-    unsigned long elapsed = millis() - washPhase2StartTime;
-    int iteration = (elapsed / 12000) % 10; // Adjust according to the total number of iterations
-    display.setCursor(0, 1);
-    display.print("Iteration:");
-    display.setCursor(11, 1);
-    display.print(iteration);
-    display.setCursor(12, 1);
-    display.print("/10");
-    
-    analogWrite(CTR_SIG, 200);
-    vTaskDelay(45000 / portTICK_PERIOD_MS);
-    analogWrite(CTR_SIG, 0);
-    vTaskDelay(3000 / portTICK_PERIOD_MS);
-    digitalWrite(CO1, ON);
-    digitalWrite(CO2, ON);
-    vTaskDelay(3000 / portTICK_PERIOD_MS);
-    analogWrite(CTR_SIG, 200);
-    vTaskDelay(45000 / portTICK_PERIOD_MS);
-    analogWrite(CTR_SIG, 0);
-    vTaskDelay(3000 / portTICK_PERIOD_MS);
-    digitalWrite(CO1, OFF);
-    digitalWrite(CO2, OFF);
-    vTaskDelay(3000 / portTICK_PERIOD_MS);
-  }
+    // Poll DOUT for the end of conversion, flagging a silent sensor
+    uint32_t waitStart = millis();
+    while (!level.is_ready())
+    {
+      if (millis() - waitStart > LEVEL_STALE_MS)
+      {
+        levelStats.notReady++;
+        waitStart = millis();
+      }
+      vTaskDelay(1);
+    }
+    int32_t raw = level.read();
+    LATENCY_START(LATENCY_LEVEL_IV, esp_timer_get_time());
+    uint32_t now = millis();
+    int32_t filtered = levelFilterUpdate(levelFilter, raw);
+    float units = (filtered - level.get_offset()) / level.get_scale();
+#if LEVEL_TRACE_SERIAL
+    Serial.printf("LVL,%u,%d\n", (unsigned)now, (int)raw);
+#endif
+
+    // Conversions we were too late to clock out are lost for good
+    if (lastSample != 0 && now - lastSample > LEVEL_SAMPLE_PERIOD_MS * 3 / 2)
+    {
+      levelStats.dropped += (now - lastSample + LEVEL_SAMPLE_PERIOD_MS / 2) / LEVEL_SAMPLE_PERIOD_MS - 1;
+    }
+    lastSample = now;
+    levelPublish(raw, units, now);
+    levelStats.samples++;
 
-  digitalWrite(INV_PW, OFF);
-  display.clear();
-  display.setCursor(4, 0);
-  display.print("Washing ");
-  display.setCursor(4, 1);
-  display.print("Complete");
-  vTaskDelay(6000 / portTICK_PERIOD_MS);
-  programRunning = false;
+    windowSamples++;
+    if (now - windowStart >= 1000)
+    {
+      levelStats.rateHz = windowSamples * 1000.0f / (now - windowStart);
+      windowStart = now;
+      windowSamples = 0;
+    }
+
+    // Sleep through most of the next conversion
+    vTaskDelay(pdMS_TO_TICKS(LEVEL_SAMPLE_PERIOD_MS - 10));
+  }
 }
-/* --------------------  9. Wash Program Function (END)  ---------------------- */
+/* --------------------  11. Water Level Sampler (END)  ---------------------- */
 
 
-/* --------------------  10. Rinse Program Function (START)  ---------------------- */
-void rinseLogic()
+/* --------------------  12. Drum Speed Sensor (START)  ---------------------- */
+// The PCNT peripheral counts FB_SIG rising edges in hardware (with its glitch
+// filter rejecting relay and inverter noise), so a pulse costs no CPU time.
+// An esp_timer reads the count every RPM_SAMPLE_MS and keeps the pulses of
+// the last RPM_WINDOW samples: at a few pulses per revolution a single 50 ms
+// sample is too coarse, the window trades 500 ms of lag for resolution.
+bool drumSpeedBegin()
 {
-  programRunning = true;
-
-  display.clear();
-  display.setCursor(1, 0);
-  display.print("Filling Water..");
-  display.setCursor(1, 1);
-  display.print("RINSE");
-  display.setCursor(13, 1);
-  display.print("L");
+  pcnt_unit_config_t unitConfig = {};
+  unitConfig.low_limit = -1;
+  unitConfig.high_limit = PCNT_HIGH_LIMIT;
+  unitConfig.flags.accum_count = 1;
+  if (pcnt_new_unit(&unitConfig, &fbCounter) != ESP_OK)
+  {
+    return false;
+  }
+  pcnt_glitch_filter_config_t filterConfig = {};
+  filterConfig.max_glitch_ns = PCNT_GLITCH_NS;
+  pcnt_unit_set_glitch_filter(fbCounter, &filterConfig);
+
+  pcnt_chan_config_t channelConfig = {};
+  channelConfig.edge_gpio_num = FB_SIG;
+  channelConfig.level_gpio_num = -1;
+  pcnt_channel_handle_t channel = NULL;
+  if (pcnt_new_channel(fbCounter, &channelConfig, &channel) != ESP_OK)
+  {
+    return false;
+  }
+  pcnt_channel_set_edge_action(channel, PCNT_CHANNEL_EDGE_ACTION_INCREASE, PCNT_CHANNEL_EDGE_ACTION_HOLD);
+  // The wrap at PCNT_HIGH_LIMIT is folded into the count by the driver (accum_count)
+  pcnt_unit_add_watch_point(fbCounter, PCNT_HIGH_LIMIT);
+  pcnt_unit_enable(fbCounter);
+  pcnt_unit_clear_count(fbCounter);
+  pcnt_unit_start(fbCounter);
+
+  const esp_timer_create_args_t samplerArgs = {rpmSampleCallback, NULL, ESP_TIMER_TASK, "drum_rpm", true};
+  esp_timer_create(&samplerArgs, &rpmSampler);
+  esp_timer_start_periodic(rpmSampler, RPM_SAMPLE_MS * 1000);
+  return true;
+}
 
-  while (waterLevel < setFillingWaterLevel)
+void rpmSampleCallback(void *arg)
+{
+  int count = 0;
+  pcnt_unit_get_count(fbCounter, &count);
+  int pulses = count - rpmLastCount;
+  rpmLastCount = count;
+
+  rpmWindowSum += pulses - rpmWindow[rpmWindowNext];
+  rpmWindow[rpmWindowNext] = pulses;
+  rpmWindowNext = (rpmWindowNext + 1) % RPM_WINDOW;
+  if (rpmWindowFill < RPM_WINDOW)
   {
-    digitalWrite(IV, ON);
-    tareWaterLevel = level.get_units() / multiplier;
-    waterLevel = tareWaterLevel - offset;
-    Serial.println(waterLevel, 1);
-    display.setCursor(8, 1);
-    display.print(waterLevel, 1);
+    rpmWindowFill++;
   }
-  digitalWrite(IV, OFF);
-  Serial.println("Water Filling Complete!");
-  Serial.println("Value (In Litres):");
-  Serial.print(waterLevel);
-  rinseWaterUsed = waterLevel;
-  delay(10);
-  String message = "Wash Water filling complete. Filled: " + String(rinseWaterUsed) + " L";
-  telegram.sendMessage(CHAT_ID, message, "");
-  display.clear();
-  display.setCursor(2, 0);
-  display.print("Water Filled");
-  display.setCursor(1, 1);
-  display.print("Value:      L");
-  display.setCursor(8, 1);
-  display.print(waterLevel, 1);
-  vTaskDelay(500 / portTICK_PERIOD_MS);
-  digitalWrite(INV_PW, ON);
-  display.clear();
-  display.setCursor(1, 0);
-  display.print("Rinsing.....");
+  float rpm = rpmWindowSum * 60000.0f / (DRUM_PULSES_PER_REV * rpmWindowFill * RPM_SAMPLE_MS);
 
-  unsigned long rinsePhaseDuration = 360000;
-  unsigned long rinsePhaseStartTime = millis();
-  while (millis() - rinsePhaseStartTime < rinsePhaseDuration)
+  portENTER_CRITICAL(&drumSpeedLock);
+  drumSpeed.rpm = rpm;
+  if (rpm > drumSpeed.maxRpm)
   {
-    unsigned long elapsed = millis() - rinsePhaseStartTime;
-    int iteration = (elapsed / 12000) % 10; // Adjust according to the total number of iterations
-    display.setCursor(0, 1);
-    display.print("Iteration:");
-    display.setCursor(11, 1);
-    display.print(iteration);
-    display.setCursor(12, 1);
-    display.print("/10");
-
-    analogWrite(CTR_SIG, 200);
-    vTaskDelay(30000 / portTICK_PERIOD_MS);
-    analogWrite(CTR_SIG, 0);
-    vTaskDelay(2500 / portTICK_PERIOD_MS);
-    digitalWrite(CO1, ON);
-    digitalWrite(CO2, ON);
-    vTaskDelay(2500 / portTICK_PERIOD_MS);
-    analogWrite(CTR_SIG, 200);
-    vTaskDelay(30000 / portTICK_PERIOD_MS);
-    analogWrite(CTR_SIG, 0);
-    vTaskDelay(2500 / portTICK_PERIOD_MS);
-    digitalWrite(CO1, OFF);
-    digitalWrite(CO2, OFF);
-    vTaskDelay(2500 / portTICK_PERIOD_MS);
+    drumSpeed.maxRpm = rpm;
   }
+  drumSpeed.pulses += pulses;
+  if (pulses > 0)
+  {
+    drumSpeed.lastPulseAt = millis();
+  }
+  drumSpeed.samples++;
+  DrumSpeed speed = drumSpeed;
+  portEXIT_CRITICAL(&drumSpeedLock);
 
-  digitalWrite(INV_PW, OFF);
+  speedLoopStep(speed);
+}
 
-  display.clear();
-  display.setCursor(4, 0);
-  display.print("Rinsing");
-  display.setCursor(4, 1);
-  display.print("Complete");
-  vTaskDelay(15000 / portTICK_PERIOD_MS);
+DrumSpeed drumSpeedRead()
+{
+  portENTER_CRITICAL(&drumSpeedLock);
+  DrumSpeed copy = drumSpeed;
+  portEXIT_CRITICAL(&drumSpeedLock);
+  return copy;
+}
 
-  programRunning = false;
+float drumRpm()
+{
+  return drumSpeedRead().rpm;
 }
-/* --------------------  10. Rinse Program Function (END)  ---------------------- */
 
+bool drumStalled(uint32_t drivenSince)
+{
+  DrumSpeed speed = drumSpeedRead();
+  uint32_t since = (int32_t)(speed.lastPulseAt - drivenSince) > 0 ? speed.lastPulseAt : drivenSince;
+  return millis() - since >= ROTOR_LOCK_MS;
+}
 
-/* --------------------  11. Spin Program Function (START)  ---------------------- */
-void spinLogic()
+// Polled by the cycle executor every tick. The drum counts as driven with
+// INV_PW on, CO1 and CO2 together and CTR_SIG at or above the duty the
+// gear in use must turn at; a speed loop trim below it restarts the clock.
+bool rotorLocked()
 {
-  programRunning = true;
-  display.clear();
-  display.setCursor(1, 0);
-  display.print("Draining Water");
-  display.setCursor(1, 1);
-  display.print("DRAIN");
-  display.setCursor(13, 1);
-  display.print("L");
-  digitalWrite(INV_PW, OFF);
-  digitalWrite(DM_WASH, ON);
-  digitalWrite(DM_SPIN, ON);
-  vTaskDelay(1000 / portTICK_PERIOD_MS);
-  waterLevel = 10;
-  while (waterLevel > setDrainingWaterLevel)
+  uint8_t minDuty = digitalRead(DM_SPIN) == ON ? ROTOR_LOCK_SPIN_PWM : ROTOR_LOCK_MIN_PWM;
+  bool driven = digitalRead(INV_PW) == ON && digitalRead(CO1) == digitalRead(CO2) && driveDuty() >= minDuty;
+  if (!driven)
   {
-    tareWaterLevel = level.get_units() / multiplier;
-    waterLevel = tareWaterLevel - offset;
-    Serial.println(waterLevel, 2);
-    display.setCursor(8, 1);
-    display.print(waterLevel, 1);
+    rotorDrivenSince = 0;
+    return false;
   }
-  vTaskDelay(15000 / portTICK_PERIOD_MS);
-
-  digitalWrite(DM_WASH, ON);
-  digitalWrite(DM_SPIN, ON);
-  digitalWrite(CO1, OFF);
-  digitalWrite(CO2, OFF);
-  display.clear();
-  display.setCursor(0, 0);
-  display.print("Press Start");
-  display.setCursor(0, 1);
-  display.print("Once Balanced");
-  telegram.sendMessage(CHAT_ID, "Water Drain Complete. Waiting for User Input to Start Spinning.", "");
-  vTaskDelay(1000 / portTICK_PERIOD_MS);
-  while (isWaiting)
+  if (rotorDrivenSince == 0)
   {
-    if (digitalRead(HALT_BTN) == LOW)
+    rotorDrivenSince = millis();
+  }
+  return drumStalled(rotorDrivenSince);
+}
+
+// Pulse periods for the balance meter. PCNT only counts, so while a spin is
+// being balanced (a few pulses per second) a GPIO interrupt on the same pin
+// timestamps the edges too. Integer work only: no FPU in ISRs.
+#if DRUM_PULSES_PER_REV != 2
+#error "The balance meter (spin_balance.h) pairs FB_SIG periods into revolutions of two pulses"
+#endif
+void IRAM_ATTR fbPeriodISR()
+{
+  int64_t now = esp_timer_get_time();
+  int64_t period = now - fbLastEdgeUs;
+  if (fbLastEdgeUs != 0 && period < FB_MIN_PERIOD_US)
+  {
+    return;
+  }
+  if (fbLastEdgeUs != 0)
+  {
+    fbPeriods[fbPeriodHead % FB_PERIOD_RING] = (uint32_t)period;
+    fbPeriodHead++;
+  }
+  fbLastEdgeUs = now;
+}
+
+void fbPeriodsStart()
+{
+  fbLastEdgeUs = 0;
+  fbPeriodTail = fbPeriodHead;
+  attachInterrupt(digitalPinToInterrupt(FB_SIG), fbPeriodISR, RISING);
+}
+
+void fbPeriodsStop()
+{
+  detachInterrupt(digitalPinToInterrupt(FB_SIG));
+}
+
+void fbPeriodsDrain(RippleMeter &meter)
+{
+  uint8_t head = fbPeriodHead;
+  // Fell a whole ring behind: skip to the oldest period still there
+  if ((uint8_t)(head - fbPeriodTail) > FB_PERIOD_RING)
+  {
+    fbPeriodTail = head - FB_PERIOD_RING;
+  }
+  while (fbPeriodTail != head)
+  {
+    rippleAdd(meter, fbPeriods[fbPeriodTail % FB_PERIOD_RING]);
+    fbPeriodTail++;
+  }
+}
+/* --------------------  12. Drum Speed Sensor (END)  ---------------------- */
+
+
+/* --------------------  13. Drum Speed Control (START)  ---------------------- */
+// Everything that moves the drum goes through driveSet() or a motor profile.
+// CTR_SIG is an LEDC channel of its own, so ramps are hardware fades: an
+// S-curve is DRIVE_RAMP_SEGMENTS linear fades, and the fade-end interrupt
+// wakes DriveTask to start the next one or to time a hold. The control code
+// only queues the profile and gets a callback at the end.
+// With a target rpm the duty is only the starting point: speedLoopStep() runs
+// right after each speed update (RPM_SAMPLE_MS, fixed rate) and trims the
+// duty by at most SPEED_TRIM_MAX to hold the target (speed_pid.h). It pauses
+// while a ramp is fading. A silent FB_SIG leaves the drive at the table duty,
+// i.e. the old open-loop behaviour.
+static bool IRAM_ATTR driveFadeEnd(const ledc_cb_param_t *param, void *arg)
+{
+  BaseType_t woken = pdFALSE;
+  if (param->event == LEDC_FADE_END_EVT)
+  {
+    driveFadeDone = true;
+    vTaskNotifyGiveFromISR(drivetask_handle, &woken);
+  }
+  return woken == pdTRUE;
+}
+
+void driveBegin()
+{
+  driveMutex = xSemaphoreCreateMutex();
+  ledc_timer_config_t timerConfig = {};
+  timerConfig.speed_mode = DRIVE_LEDC_MODE;
+  timerConfig.duty_resolution = LEDC_TIMER_8_BIT;
+  timerConfig.timer_num = DRIVE_LEDC_TIMER;
+  timerConfig.freq_hz = DRIVE_PWM_HZ;
+  timerConfig.clk_cfg = LEDC_AUTO_CLK;
+  ledc_timer_config(&timerConfig);
+
+  ledc_channel_config_t channelConfig = {};
+  channelConfig.gpio_num = CTR_SIG;
+  channelConfig.speed_mode = DRIVE_LEDC_MODE;
+  channelConfig.channel = DRIVE_LEDC_CHANNEL;
+  channelConfig.intr_type = LEDC_INTR_DISABLE;
+  channelConfig.timer_sel = DRIVE_LEDC_TIMER;
+  channelConfig.duty = 0;
+  ledc_channel_config(&channelConfig);
+
+  xTaskCreatePinnedToCore(
+      drivetask,         // Task Function
+      "DriveTask",       // Task Name
+      2048,              // Stack Size (bytes)
+      NULL,              // Task parameter
+      3,                 // Task Priority (segments start on time)
+      &drivetask_handle, // Task handle
+      1                  // Core to run the task
+  );
+  ledc_fade_func_install(0);
+  ledc_cbs_t callbacks = {};
+  callbacks.fade_cb = driveFadeEnd;
+  ledc_cb_register(DRIVE_LEDC_MODE, DRIVE_LEDC_CHANNEL, &callbacks, NULL);
+}
+
+// CTR_SIG writers below run with driveMutex held
+static void driveWrite(uint8_t duty)
+{
+  if (drive.ramping)
+  {
+#if SOC_LEDC_SUPPORT_FADE_STOP
+    ledc_fade_stop(DRIVE_LEDC_MODE, DRIVE_LEDC_CHANNEL);
+#endif
+    drive.ramping = false;
+  }
+  drive.duty = duty;
+  ledc_set_duty(DRIVE_LEDC_MODE, DRIVE_LEDC_CHANNEL, duty);
+  ledc_update_duty(DRIVE_LEDC_MODE, DRIVE_LEDC_CHANNEL);
+}
+
+static void driveCancel()
+{
+  if (drive.active)
+  {
+    drive.active = false;
+    speedStats.cancelled++;
+  }
+}
+
+// The current step's ramp is done (or was a jump): hold its duty and speed
+static void driveHold()
+{
+  const DriveStep &step = drive.steps[drive.index];
+  driveWrite(step.duty);
+  drive.feedforward = step.duty;
+  drive.targetRpm = step.rpm;
+  drive.since = millis();
+  drive.phaseStart = drive.since;
+  speedPidReset(speedPid);
+}
+
+static void driveStartSegment()
+{
+  const DriveStep &step = drive.steps[drive.index];
+  // Smoothstep: gentle at both ends, steepest mid-ramp
+  float t = (drive.segment + 1) / (float)DRIVE_RAMP_SEGMENTS;
+  float shape = t * t * (3 - 2 * t);
+  uint8_t target = (uint8_t)(drive.fromDuty + (step.duty - drive.fromDuty) * shape + 0.5f);
+  driveFadeDone = false;
+  drive.ramping = true;
+  drive.duty = target;
+  drive.phaseStart = millis();
+  ledc_set_fade_with_time(DRIVE_LEDC_MODE, DRIVE_LEDC_CHANNEL, target, step.rampMs / DRIVE_RAMP_SEGMENTS);
+  ledc_fade_start(DRIVE_LEDC_MODE, DRIVE_LEDC_CHANNEL, LEDC_FADE_NO_WAIT);
+}
+
+static void driveStartStep()
+{
+  const DriveStep &step = drive.steps[drive.index];
+  drive.fromDuty = drive.duty;
+  drive.targetRpm = 0;
+  if (step.rampMs < DRIVE_RAMP_SEGMENTS || step.duty == drive.fromDuty)
+  {
+    actuatorRecord(ACT_CTR_SIG, step.duty);
+    driveHold();
+    return;
+  }
+  actuatorRecord(ACT_CTR_SIG, step.duty, step.rampMs);
+  drive.segment = 0;
+  driveStartSegment();
+}
+
+void driveSet(uint8_t duty, uint16_t rpm)
+{
+  xSemaphoreTake(driveMutex, portMAX_DELAY);
+  driveCancel();
+  if (rpm != drive.targetRpm || duty != drive.feedforward)
+  {
+    speedPidReset(speedPid);
+  }
+  drive.feedforward = duty;
+  drive.targetRpm = rpm;
+  drive.since = millis();
+  driveWrite(duty);
+  actuatorRecord(ACT_CTR_SIG, duty);
+  xSemaphoreGive(driveMutex);
+}
+
+bool driveProfile(const DriveStep *steps, uint8_t count, DriveDoneCallback done, void *arg)
+{
+  if (count == 0 || count > DRIVE_PROFILE_MAX)
+  {
+    return false;
+  }
+  xSemaphoreTake(driveMutex, portMAX_DELAY);
+  driveCancel();
+  memcpy(drive.steps, steps, count * sizeof(DriveStep));
+  drive.count = count;
+  drive.index = 0;
+  drive.done = done;
+  drive.doneArg = arg;
+  drive.active = true;
+  driveStartStep();
+  xSemaphoreGive(driveMutex);
+  // Let DriveTask re-time its sleep for the new profile
+  xTaskNotifyGive(drivetask_handle);
+  return true;
+}
+
+bool driveRamp(uint8_t duty, uint16_t rpm, uint16_t rampMs, DriveDoneCallback done, void *arg)
+{
+  DriveStep step = {duty, rpm, rampMs, 0};
+  return driveProfile(&step, 1, done, arg);
+}
+
+bool driveBusy()
+{
+  return drive.active;
+}
+
+uint8_t driveDuty()
+{
+  return ledc_get_duty(DRIVE_LEDC_MODE, DRIVE_LEDC_CHANNEL);
+}
+
+TickType_t driveService(TickType_t wait)
+{
+  ulTaskNotifyTake(pdTRUE, wait);
+
+  DriveDoneCallback done = NULL;
+  void *doneArg = NULL;
+  TickType_t next = portMAX_DELAY;
+  xSemaphoreTake(driveMutex, portMAX_DELAY);
+  while (drive.active)
+  {
+    const DriveStep &step = drive.steps[drive.index];
+    uint32_t elapsed = millis() - drive.phaseStart;
+    uint32_t limit = drive.ramping ? step.rampMs / DRIVE_RAMP_SEGMENTS + DRIVE_FADE_SLACK_MS : step.holdMs;
+    if (drive.ramping && !driveFadeDone && elapsed < limit)
+    {
+      next = pdMS_TO_TICKS(limit - elapsed) + 1;
+      break;
+    }
+    if (!drive.ramping && elapsed < limit)
+    {
+      next = pdMS_TO_TICKS(limit - elapsed) + 1;
+      break;
+    }
+
+    if (drive.ramping)
+    {
+      // Fade finished (or its interrupt was missed): next segment, then hold
+      drive.ramping = false;
+      if (++drive.segment < DRIVE_RAMP_SEGMENTS)
+      {
+        driveStartSegment();
+      }
+      else
+      {
+        driveHold();
+      }
+    }
+    else if (++drive.index < drive.count)
     {
-      isWaiting = !isWaiting;
+      driveStartStep();
     }
     else
     {
-     digitalWrite(WIFI_LED, HIGH);
-     vTaskDelay(500 / portTICK_PERIOD_MS);
-     digitalWrite(WIFI_LED, LOW);
-     vTaskDelay(500 / portTICK_PERIOD_MS);
+      drive.active = false;
+      speedStats.profiles++;
+      done = drive.done;
+      doneArg = drive.doneArg;
     }
   }
+  xSemaphoreGive(driveMutex);
 
-  vTaskDelay(1000 / portTICK_PERIOD_MS);
-  digitalWrite(INV_PW, ON);
-  display.clear();
-  display.setCursor(1, 0);
-  vTaskDelay(1000 / portTICK_PERIOD_MS);
-  display.print("Spinning....");
-  analogWrite(CTR_SIG, 50);
-  vTaskDelay(180000 / portTICK_PERIOD_MS);
-  digitalWrite(INV_PW, OFF);
-  vTaskDelay(2000 / portTICK_PERIOD_MS);
-  digitalWrite(CO1, ON);
-  vTaskDelay(40000 / portTICK_PERIOD_MS);
-  digitalWrite(DM_SPIN, OFF);
-  digitalWrite(DM_WASH, OFF);
-  digitalWrite(IV, OFF);
-  digitalWrite(CO1, OFF);
-  digitalWrite(CO2, OFF);
-  isWaiting = true;
+  if (done != NULL)
+  {
+    done(doneArg);
+  }
+  return next;
+}
+
+void drivetask(void *parameter)
+{
+  TickType_t wait = portMAX_DELAY;
+  while (true)
+  {
+    wait = driveService(wait);
+  }
+}
+
+void speedLoopStep(const DrumSpeed &speed)
+{
+  // driveSet() in progress: its write wins, catch up next period
+  if (driveMutex == NULL || xSemaphoreTake(driveMutex, 0) != pdTRUE)
+  {
+    return;
+  }
+  if (drive.targetRpm == 0 || drive.feedforward == 0 || drive.ramping)
+  {
+    xSemaphoreGive(driveMutex);
+    return;
+  }
+
+  int64_t start = esp_timer_get_time();
+  float outMin = drive.feedforward > SPEED_TRIM_MAX ? drive.feedforward - SPEED_TRIM_MAX : 0;
+  float outMax = drive.feedforward + SPEED_TRIM_MAX < 255 ? drive.feedforward + SPEED_TRIM_MAX : 255;
+  uint8_t duty;
+  if (drumStalled(drive.since))
+  {
+    // No feedback: nothing to close the loop on
+    speedPidReset(speedPid);
+    duty = drive.feedforward;
+    speedStats.noFeedback++;
+  }
+  else
+  {
+    float out = speedPidUpdate(speedPid, drive.targetRpm, speed.rpm, drive.feedforward,
+                               outMin, outMax, RPM_SAMPLE_MS / 1000.0f);
+    if (out <= outMin || out >= outMax)
+    {
+      speedStats.saturated++;
+    }
+    duty = (uint8_t)(out + 0.5f);
+  }
+  if (duty != drive.duty)
+  {
+    driveWrite(duty);
+  }
+  xSemaphoreGive(driveMutex);
+
+  uint32_t elapsed = (uint32_t)(esp_timer_get_time() - start);
+  speedStats.iterations++;
+  speedStats.totalUs += elapsed;
+  if (elapsed > speedStats.maxUs)
+  {
+    speedStats.maxUs = elapsed;
+  }
+}
+
+void speedLoadGains()
+{
+  speedPrefs.begin("speed", true);
+  speedPid.gains.kp = speedPrefs.getFloat("kp", SPEED_KP_DEFAULT);
+  speedPid.gains.ki = speedPrefs.getFloat("ki", SPEED_KI_DEFAULT);
+  speedPid.gains.kd = speedPrefs.getFloat("kd", SPEED_KD_DEFAULT);
+  speedPrefs.end();
+  Serial.printf("Speed loop gains: Kp %.3f Ki %.3f Kd %.3f\n", speedPid.gains.kp, speedPid.gains.ki, speedPid.gains.kd);
+}
+
+void speedSaveGains()
+{
+  speedPrefs.begin("speed", false);
+  speedPrefs.putFloat("kp", speedPid.gains.kp);
+  speedPrefs.putFloat("ki", speedPid.gains.ki);
+  speedPrefs.putFloat("kd", speedPid.gains.kd);
+  speedPrefs.end();
+}
+/* --------------------  13. Drum Speed Control (END)  ---------------------- */
+
+
+/* --------------------  14. Telegram Outbox (START)  ---------------------- */
+// All Telegram output goes through outboxQueue. Posting copies the text to
+// the heap and queues a pointer with a zero timeout, so control code never
+// waits on the network. CommsTask owns the Bot API calls:
+//   - plain and progress messages go out in order, one API call per
+//     OUTBOX_MIN_INTERVAL_MS at most
+//   - edits wait for their progress message, and an edit still pending when
+//     a newer one arrives for the same slot is discarded
+//   - a failed call is retried after OUTBOX_RETRY_MS, doubling each time,
+//     and the message is dropped after OUTBOX_MAX_ATTEMPTS
+bool outboxPost(OutboxKind kind, int slot, const String &text, bool markdown)
+{
+  OutboxMessage msg = {kind, (int8_t)slot, markdown, strdup(text.c_str())};
+  if (msg.text == NULL || outboxQueue == NULL || xQueueSend(outboxQueue, &msg, 0) != pdTRUE)
+  {
+    free(msg.text);
+    outboxStats.dropped++;
+    return false;
+  }
+  return true;
+}
+
+bool outboxSend(const String &text, bool markdown)
+{
+  return outboxPost(OUTBOX_SEND, -1, text, markdown);
+}
+
+int outboxSendProgress(const String &text, bool markdown)
+{
+  int slot = outboxNextSlot.fetch_add(1) % OUTBOX_SLOTS;
+  outboxPost(OUTBOX_SEND, slot, text, markdown);
+  return slot;
+}
+
+void outboxEdit(int slot, const String &text, bool markdown)
+{
+  outboxPost(OUTBOX_EDIT, slot, text, markdown);
+}
+
+void outboxService(TickType_t wait)
+{
+  // CommsTask-private state
+  static OutboxMessage pending[OUTBOX_DEPTH]; // Sends awaiting delivery, oldest at pendingHead
+  static uint8_t pendingHead = 0;
+  static uint8_t pendingCount = 0;
+  static OutboxMessage edits[OUTBOX_SLOTS];   // Newest undelivered edit per slot (text NULL = none)
+  static int messageIds[OUTBOX_SLOTS];        // Telegram message_id per slot (0 = not sent yet, -1 = lost)
+  static uint8_t attempts = 0;                // Failed attempts at the current call
+  static unsigned long nextCall = 0;          // millis() before which no API call is made
+
+  // Accept everything queued; only the first receive may block
+  OutboxMessage msg;
+  while (xQueueReceive(outboxQueue, &msg, wait) == pdTRUE)
+  {
+    wait = 0;
+    if (msg.kind == OUTBOX_SEND)
+    {
+      if (msg.slot >= 0)
+      {
+        // Slot reused: edits queued for its previous message are moot
+        messageIds[msg.slot] = 0;
+        free(edits[msg.slot].text);
+        edits[msg.slot].text = NULL;
+      }
+      if (pendingCount == OUTBOX_DEPTH)
+      {
+        free(msg.text);
+        outboxStats.dropped++;
+        continue;
+      }
+      pending[(pendingHead + pendingCount++) % OUTBOX_DEPTH] = msg;
+    }
+    else if (messageIds[msg.slot] < 0)
+    {
+      free(msg.text);
+      outboxStats.dropped++;
+    }
+    else
+    {
+      if (edits[msg.slot].text != NULL)
+      {
+        free(edits[msg.slot].text);
+        outboxStats.coalesced++;
+      }
+      edits[msg.slot] = msg;
+    }
+  }
+
+  if ((long)(millis() - nextCall) < 0)
+  {
+    return;
+  }
+
+  // Sends first (in order), then edits whose message has been delivered
+  OutboxMessage *job = pendingCount ? &pending[pendingHead] : NULL;
+  for (int slot = 0; job == NULL && slot < OUTBOX_SLOTS; slot++)
+  {
+    if (edits[slot].text != NULL && messageIds[slot] > 0)
+    {
+      job = &edits[slot];
+    }
+  }
+  if (job == NULL)
+  {
+    return;
+  }
+
+  int editId = job->kind == OUTBOX_EDIT ? messageIds[job->slot] : 0;
+  xSemaphoreTake(telegramMutex, portMAX_DELAY);
+  bool ok = telegram.sendMessage(CHAT_ID, job->text, job->markdown ? "Markdown" : "", editId);
+  int sentId = telegram.last_sent_message_id;
+  xSemaphoreGive(telegramMutex);
+
+  if (!ok && ++attempts < OUTBOX_MAX_ATTEMPTS)
+  {
+    outboxStats.retries++;
+    nextCall = millis() + (OUTBOX_RETRY_MS << (attempts - 1));
+    return;
+  }
+  nextCall = millis() + OUTBOX_MIN_INTERVAL_MS;
+  attempts = 0;
+
+  if (!ok)
+  {
+    outboxStats.dropped++;
+  }
+  else if (job->kind == OUTBOX_EDIT)
+  {
+    outboxStats.edits++;
+  }
+  else
+  {
+    outboxStats.sent++;
+    LATENCY_STOP(LATENCY_COMMAND_REPLY);
+  }
+  if (job->kind == OUTBOX_SEND)
+  {
+    if (job->slot >= 0)
+    {
+      messageIds[job->slot] = ok ? sentId : -1;
+    }
+    pendingHead = (pendingHead + 1) % OUTBOX_DEPTH;
+    pendingCount--;
+  }
+  free(job->text);
+  job->text = NULL;
+}
+
+void commstask(void *parameter)
+{
+  while (true)
+  {
+    // Wake for new messages, or after a short nap to make a rate-limited or retried call
+    outboxService(pdMS_TO_TICKS(250));
+  }
+}
+/* --------------------  14. Telegram Outbox (END)  ---------------------- */
+
+
+/* --------------------  15. Telegram Receiver (START)  ---------------------- */
+// RxTask long-polls getUpdates on its own TLS session: each request is held
+// by Telegram for up to TELEGRAM_LONG_POLL_S and returns as soon as a message
+// arrives, so a command reaches loop() within one round trip and the session
+// stays open between polls. The update offset is kept in NVS so a reboot
+// does not replay messages that were already handled.
+void rxtask(void *parameter)
+{
+  telegramPrefs.begin("telegram", true);
+  telegramRx.last_message_received = telegramPrefs.getLong("offset", 0);
+  telegramPrefs.end();
+  telegramRx.longPoll = TELEGRAM_LONG_POLL_S;
+
+  while (true)
+  {
+    if (!rx_client.connected())
+    {
+      rxStats.reconnects++;
+    }
+    rxStats.polls++;
+    unsigned long pollStart = millis();
+    int numNewMessages = telegramRx.getUpdates(telegramRx.last_message_received + 1);
+
+    for (int i = 0; i < numNewMessages; i++)
+    {
+      // Only respond to authorized chat ID
+      if (telegramRx.messages[i].chat_id != CHAT_ID)
+      {
+        continue;
+      }
+      TelegramCommand command = {};
+      strncpy(command.text, telegramRx.messages[i].text.c_str(), sizeof(command.text) - 1);
+      if (xQueueSend(commandQueue, &command, 0) == pdTRUE)
+      {
+        rxStats.commands++;
+        LATENCY_START(LATENCY_COMMAND_REPLY, esp_timer_get_time());
+      }
+      else
+      {
+        rxStats.dropped++;
+      }
+    }
+
+    if (numNewMessages > 0)
+    {
+      telegramPrefs.begin("telegram", false);
+      telegramPrefs.putLong("offset", telegramRx.last_message_received);
+      telegramPrefs.end();
+    }
+    else if (millis() - pollStart < 1000)
+    {
+      // An empty long poll takes TELEGRAM_LONG_POLL_S; a quick one failed
+      rxStats.failures++;
+      vTaskDelay(pdMS_TO_TICKS(TELEGRAM_RETRY_MS));
+    }
+  }
+}
+/* --------------------  15. Telegram Receiver (END)  ---------------------- */
+
+
+/* --------------------  16. Latency Probes (START)  ---------------------- */
+// Built with LATENCY_PROBES set to 1, the paths that must react promptly
+// are timed end to end, across tasks and cores:
+//   - level_iv: LevelTask reading a conversion, to fillLogic() closing IV
+//     on the executor once the level it gave reaches the target
+//   - button_relay: the HALT edge in its ISR while the balance prompt is
+//     up, through debounce and the executor tick, to the relay change
+//   - command_reply: RxTask taking a command off getUpdates, through
+//     loop(), to CommsTask delivering the next message
+// The start event stamps its path and the end event records the time
+// since; a start older than the path's timeout was not the cause and is
+// dropped. Stamps come from esp_timer, which both cores share (the CPU
+// cycle counter is per core). Without LATENCY_PROBES, LATENCY_START and
+// LATENCY_STOP expand to nothing.
+#if LATENCY_PROBES
+void IRAM_ATTR latencyStart(LatencyPath path, int64_t atUs)
+{
+  portENTER_CRITICAL_SAFE(&latencyLock);
+  latencyProbes[path].startUs = atUs;
+  portEXIT_CRITICAL_SAFE(&latencyLock);
+}
+
+void latencyStop(LatencyPath path)
+{
+  int64_t now = esp_timer_get_time();
+  portENTER_CRITICAL(&latencyLock);
+  LatencyProbe &probe = latencyProbes[path];
+  if (probe.startUs != 0 && now - probe.startUs <= probe.timeoutUs)
+  {
+    latencyRecord(probe.histogram, (uint32_t)(now - probe.startUs));
+  }
+  probe.startUs = 0;
+  portEXIT_CRITICAL(&latencyLock);
+}
+
+// One line per path, since boot: "LATENCY,<path>,<samples>,<p50 us>,<p99 us>,<max us>"
+void latencyReport()
+{
+  for (int i = 0; i < LATENCY_PATHS; i++)
+  {
+    portENTER_CRITICAL(&latencyLock);
+    const LatencyHistogram &h = latencyProbes[i].histogram;
+    uint32_t count = h.count;
+    uint32_t p50 = latencyPercentile(h, 50);
+    uint32_t p99 = latencyPercentile(h, 99);
+    uint32_t maxUs = h.maxUs;
+    portEXIT_CRITICAL(&latencyLock);
+    Serial.printf("LATENCY,%s,%u,%u,%u,%u\n", latencyProbes[i].name, (unsigned)count, (unsigned)p50,
+                  (unsigned)p99, (unsigned)maxUs);
+  }
+}
+#endif
+/* --------------------  16. Latency Probes (END)  ---------------------- */
+
+
+/* --------------------  17. Actuator Trace (START)  ---------------------- */
+// The stage tables, the stage functions and the drive switch actuators
+// from CycleTask, DriveTask and loop(); each commanded change is recorded
+// here as it is made (actuator_trace.h) and loop() streams the ring to
+// serial, so a change that reorders or overlaps relay steps shows up
+// against a golden trace. Engineering tests drive the pins directly and
+// are not traced.
+static const uint8_t relayPins[] = {INV_PW, DM_WASH, DM_SPIN, IV, CO1, CO2}; // By Actuator
+
+void relayWrite(Actuator relay, uint8_t level)
+{
+  digitalWrite(relayPins[relay], level);
+  actuatorRecord(relay, level == ON);
+}
+
+void actuatorRecord(Actuator actuator, uint8_t value, uint16_t rampMs)
+{
+  uint32_t now = millis();
+  portENTER_CRITICAL(&actuatorTraceLock);
+  actuatorTraceRecord(actuatorTrace, now - actuatorTraceStart, actuator, value, rampMs);
+  portEXIT_CRITICAL(&actuatorTraceLock);
+}
+
+// BEGIN, then whatever is already on, so each program's trace stands alone
+void actuatorTraceBegin(int mode)
+{
+  portENTER_CRITICAL(&actuatorTraceLock);
+  actuatorTraceStart = millis();
+  actuatorTracePush(actuatorTrace, {0, ACT_BEGIN, (uint8_t)mode, 0});
+  for (uint8_t i = 0; i < ACTUATORS; i++)
+  {
+    if (actuatorTrace.values[i] != 0)
+    {
+      actuatorTracePush(actuatorTrace, {0, i, actuatorTrace.values[i], 0});
+    }
+  }
+  portEXIT_CRITICAL(&actuatorTraceLock);
+}
+
+void actuatorTraceFlush()
+{
+  ActuatorEvent event;
+  while (true)
+  {
+    portENTER_CRITICAL(&actuatorTraceLock);
+    bool more = actuatorTracePop(actuatorTrace, event);
+    uint32_t lost = actuatorTrace.lost;
+    if (!more && lost != 0)
+    {
+      // The ring overflowed: mark the gap once it has drained
+      event = {(uint32_t)(millis() - actuatorTraceStart), ACT_LOST, (uint8_t)(lost < 255 ? lost : 255), 0};
+      actuatorTrace.lost = 0;
+      more = true;
+    }
+    portEXIT_CRITICAL(&actuatorTraceLock);
+    if (!more)
+    {
+      return;
+    }
+#if ACTUATOR_TRACE_SERIAL
+    char line[40];
+    actuatorFormat(line, sizeof(line), event);
+    Serial.println(line);
+#endif
+  }
+}
+/* --------------------  17. Actuator Trace (END)  ---------------------- */
+
+
+/* --------------------  18. Cycle Executor (START)  ---------------------- */
+// Picks up the sampler's newest reading; returns true if it is one the executor has not seen yet
+bool readWaterLevel()
+{
+  static uint32_t lastSeq = 0;
+  LevelReading reading;
+  if (!levelLatest(reading) || reading.seq == lastSeq)
+  {
+    return false;
+  }
+  lastSeq = reading.seq;
+  tareWaterLevel = reading.units / multiplier;
+  waterLevel = reading.litres;
+  waterLevelTime = reading.timestamp;
+  return true;
+}
+
+void fillLoadLearning()
+{
+  fillPrefs.begin("fill", true);
+  fillLearning.lagMs = fillPrefs.getUShort("lagMs", FILL_LAG_DEFAULT_MS);
+  fillLearning.fills = fillPrefs.getUShort("fills", 0);
+  fillPrefs.end();
+  Serial.printf("Fill cutoff lag: %u ms (learned from %u fills)\n", fillLearning.lagMs, fillLearning.fills);
+}
+
+// Called once the level has settled after IV closed
+void fillComplete()
+{
+  float overshoot = waterLevel - fillRun.target;
+  // Learn on the lag actually used, then take the slosh averaging back off
+  FillLearning used = fillLearning;
+  used.lagMs += fillRun.extraLagMs;
+  fillLearn(used, overshoot, fillRun.rateAtClose);
+  fillLearning.fills = used.fills;
+  fillLearning.lagMs = used.lagMs > fillRun.extraLagMs ? used.lagMs - fillRun.extraLagMs : 0;
+
+  fillStats.fills++;
+  fillStats.lastOvershoot = overshoot;
+  fillStats.totalAbsOvershoot += fabsf(overshoot);
+
+  fillPrefs.begin("fill", false);
+  fillPrefs.putUShort("lagMs", fillLearning.lagMs);
+  fillPrefs.putUShort("fills", fillLearning.fills);
+  fillPrefs.end();
+
+  // FILL,<ms>,<target>,<level at close>,<settled level>,<overshoot>,<rate L/s>,<new lag ms>
+  Serial.printf("FILL,%lu,%.1f,%.2f,%.2f,%+.2f,%.3f,%u\n", millis(), fillRun.target, fillRun.levelAtClose,
+                waterLevel, overshoot, fillRun.rateAtClose, fillLearning.lagMs);
+}
+
+// The changeover relays reverse the motor on the inverter output; switching
+// them with the drive on would break the motor current across the contacts.
+bool changeoverSafe()
+{
+  return digitalRead(INV_PW) == OFF || (driveDuty() == 0 && !driveBusy());
+}
+
+// Interlock: no CO1/CO2 change while it would switch under load. Switching
+// the other relays off is always safe, so a refused mask still applies those
+// offs; its CO1/CO2 bits and every on bit wait for the caller's next try.
+bool applyOutputs(uint8_t on, uint8_t off)
+{
+  const uint8_t changeover = OUT_CO1 | OUT_CO2;
+  for (int i = ACT_CO1; i <= ACT_CO2; i++)
+  {
+    bool level = digitalRead(relayPins[i]) == ON;
+    if ((((on >> i) & 1) && !level) || (((off >> i) & 1) && level))
+    {
+      if (!changeoverSafe())
+      {
+        reversalStats.blocked++;
+        for (int j = 0; j < ACT_CTR_SIG; j++)
+        {
+          if ((off & ~changeover) & (1 << j))
+            relayWrite((Actuator)j, OFF);
+        }
+        return false;
+      }
+      break;
+    }
+  }
+  for (int i = 0; i < ACT_CTR_SIG; i++)
+  {
+    if (off & (1 << i))
+      relayWrite((Actuator)i, OFF);
+    if (on & (1 << i))
+      relayWrite((Actuator)i, ON);
+  }
+  LATENCY_STOP(LATENCY_BUTTON_RELAY);
+  return true;
+}
+
+void showScreen(const char *row0, const char *row1)
+{
+  display.clear();
+  display.setCursor(0, 0);
+  display.print(row0);
+  display.setCursor(0, 1);
+  display.print(row1);
+}
+
+// True once the drum has stopped after a run. With FB_SIG pulses during the
+// run, that is REVERSAL_QUIET_MS without one, and the drive-off to last-pulse
+// time is learned. Without them the learned coast time (plus a margin) stands
+// in, and the table's fixed stopMs until anything has been learned.
+bool agitationCoasted(StageContext &ctx, const AgitationProfile &profile, unsigned long elapsed)
+{
+  if (driveBusy())
+  {
+    return false;
+  }
+  if (ctx.feedback)
+  {
+    DrumSpeed speed = drumSpeedRead();
+    unsigned long now = millis();
+    if (now - speed.lastPulseAt >= REVERSAL_QUIET_MS)
+    {
+      uint32_t coastMs = (int32_t)(speed.lastPulseAt - ctx.agitationStart) > 0 ? speed.lastPulseAt - ctx.agitationStart : 0;
+      if (reversalStats.feedbackStops == 0)
+      {
+        reversalStats.learnedCoastMs = coastMs;
+      }
+      else
+      {
+        reversalStats.learnedCoastMs += ((int32_t)coastMs - (int32_t)reversalStats.learnedCoastMs) / 4;
+      }
+      reversalStats.feedbackStops++;
+      return true;
+    }
+    if (elapsed >= REVERSAL_COAST_MAX_MS)
+    {
+      reversalStats.timeouts++;
+      return true;
+    }
+    return false;
+  }
+  if (reversalStats.feedbackStops > 0)
+  {
+    if (elapsed >= (unsigned long)reversalStats.learnedCoastMs + REVERSAL_MODEL_MARGIN_MS)
+    {
+      reversalStats.modelStops++;
+      return true;
+    }
+    return false;
+  }
+  if (elapsed >= profile.stopMs)
+  {
+    reversalStats.timedStops++;
+    return true;
+  }
+  return false;
+}
+
+unsigned long agitationIterationMs(const AgitationProfile &profile)
+{
+  if (reversalStats.feedbackStops > 0)
+  {
+    return 2UL * (profile.runMs + reversalStats.learnedCoastMs + REVERSAL_QUIET_MS + CHANGEOVER_SETTLE_MS);
+  }
+  return 2UL * (profile.runMs + profile.stopMs) + profile.reverseSettleMs + profile.forwardSettleMs;
+}
+
+// One forward/reverse agitation iteration: run, coast, reverse, settle, run, coast, forward, settle.
+// The coasts end when the drum has stopped rather than after a fixed time.
+bool agitationLogic(StageContext &ctx, const AgitationProfile &profile)
+{
+  unsigned long now = millis();
+  unsigned long elapsed = now - ctx.agitationStart;
+  bool settled = true;
+  switch (ctx.agitationStep)
+  {
+  case 1:
+  case 4:
+    // Running; a soft start still fading holds the step
+    settled = elapsed >= profile.runMs && !driveBusy();
+    break;
+  case 2:
+  case 5:
+    settled = agitationCoasted(ctx, profile, elapsed);
+    break;
+  case 3:
+  case 6:
+    settled = elapsed >= (ctx.feedback ? CHANGEOVER_SETTLE_MS
+                                       : (ctx.agitationStep == 3 ? profile.reverseSettleMs : profile.forwardSettleMs));
+    break;
+  }
+  if (!settled)
+  {
+    return false;
+  }
+
+  switch (ctx.agitationStep)
+  {
+  case 0:
+  case 3:
+    ctx.runPulses = drumSpeedRead().pulses;
+    driveRamp(profile.pwm, profile.rpm, profile.rampMs);
+    break;
+  case 1:
+  case 4:
+    ctx.feedback = drumSpeedRead().pulses != ctx.runPulses;
+    reversalStats.runMs += elapsed;
+    driveRamp(0, 0, profile.rampMs);
+    break;
+  case 2:
+  case 5:
+    if (!applyOutputs(ctx.agitationStep == 2 ? OUT_CO1 | OUT_CO2 : 0, ctx.agitationStep == 2 ? 0 : OUT_CO1 | OUT_CO2))
+    {
+      return false;
+    }
+    reversalStats.reversals++;
+    break;
+  default:
+    break;
+  }
+  if (ctx.agitationStep > 0)
+  {
+    reversalStats.totalMs += elapsed;
+  }
+  ctx.agitationStart = now;
+  if (ctx.agitationStep == 6)
+  {
+    ctx.agitationStep = 0;
+    return true;
+  }
+  ctx.agitationStep++;
+  return false;
+}
+
+// Load balancing before a spin: run up to distribution speed, measure the
+// FB_SIG ripple and, while it is too high, coast down, tumble the load
+// back and forth and try again. Only after profile.attempts measurements
+// (or with no feedback to measure) does the user get asked, as before:
+// inverter off, WiFi LED blinking until HALT is pressed.
+bool balanceLogic(StageContext &ctx, const BalanceProfile &profile, bool entering)
+{
+  unsigned long now = millis();
+  if (entering)
+  {
+    ctx.balanceAttempt = 0;
+    ctx.balancePhase = BALANCE_DISTRIBUTE;
+    ctx.balanceStart = now;
+    driveRamp(profile.pwm, profile.rpm, profile.rampMs);
+  }
+  unsigned long elapsed = now - ctx.balanceStart;
+
+  switch (ctx.balancePhase)
+  {
+  case BALANCE_DISTRIBUTE:
+    if (elapsed >= (unsigned long)profile.rampMs + profile.settleMs && !driveBusy())
+    {
+      rippleReset(ctx.ripple);
+      fbPeriodsStart();
+      ctx.balanceSettled = 0;
+      ctx.balancePhase = BALANCE_SETTLE;
+      ctx.balanceStart = now;
+    }
+    return false;
+
+  case BALANCE_SETTLE:
+  {
+    // Hunting would swamp the load's ripple: wait until whole revolutions
+    // hold distribution speed, or measure anyway once that takes too long
+    uint16_t revs = ctx.ripple.count;
+    fbPeriodsDrain(ctx.ripple);
+    if (ctx.ripple.count != revs)
+    {
+      bool near = fabsf(rippleRpm(ctx.ripple) - profile.rpm) <= profile.rpm * BALANCE_SETTLE_PCT / 100.0f;
+      ctx.balanceSettled = near ? ctx.balanceSettled + 1 : 0;
+    }
+    if (ctx.balanceSettled < BALANCE_SETTLE_REVS && elapsed < BALANCE_SETTLE_MAX_MS)
+    {
+      return false;
+    }
+    rippleReset(ctx.ripple);
+    ctx.balancePhase = BALANCE_MEASURE;
+    ctx.balanceStart = now;
+    return false;
+  }
+
+  case BALANCE_MEASURE:
+    fbPeriodsDrain(ctx.ripple);
+    if (elapsed < profile.measureMs)
+    {
+      return false;
+    }
+    fbPeriodsStop();
+    ctx.balanceAttempt++;
+    ctx.feedback = ctx.ripple.count >= BALANCE_MIN_REVS;
+    ctx.balanceStart = now;
+    Serial.printf("BALANCE,%u,%.1f,%u\n", ctx.balanceAttempt, ripplePercent(ctx.ripple), ctx.ripple.count);
+    if (!ctx.feedback)
+    {
+      driveRamp(0, 0, profile.rampMs);
+      cycleNotify("Spin feedback unavailable. Waiting for User Input to Start Spinning.");
+      ctx.balancePhase = BALANCE_STOP;
+      return false;
+    }
+    balanceStats.measurements++;
+    balanceStats.lastRipplePct = ripplePercent(ctx.ripple);
+    if (balanceStats.lastRipplePct <= profile.rippleMaxPct)
+    {
+      // Balanced: keep turning, the spin ramps up from distribution speed
+      balanceStats.runs++;
+      cycleNotify("Load balanced (ripple %.1f%%, attempt %u).", balanceStats.lastRipplePct, ctx.balanceAttempt);
+      return true;
+    }
+    driveRamp(0, 0, profile.rampMs);
+    if (ctx.balanceAttempt >= profile.attempts)
+    {
+      cycleNotify("Load still unbalanced after %u attempts (ripple %.1f%%). Waiting for User Input to Start Spinning.",
+                  ctx.balanceAttempt, balanceStats.lastRipplePct);
+      ctx.balancePhase = BALANCE_STOP;
+      return false;
+    }
+    showScreen("Redistributing", "    Load");
+    balanceStats.redistributions++;
+    ctx.balancePhase = BALANCE_COAST;
+    return false;
+
+  case BALANCE_COAST:
+    if (!agitationCoasted(ctx, *profile.tumble, elapsed))
+    {
+      return false;
+    }
+    ctx.agitationStep = 0;
+    ctx.iteration = 0;
+    ctx.balancePhase = BALANCE_TUMBLE;
+    return false;
+
+  case BALANCE_TUMBLE:
+    if (agitationLogic(ctx, *profile.tumble) && ++ctx.iteration >= profile.tumbles)
+    {
+      showScreen("Balancing Load", "");
+      driveRamp(profile.pwm, profile.rpm, profile.rampMs);
+      ctx.balancePhase = BALANCE_DISTRIBUTE;
+      ctx.balanceStart = now;
+    }
+    return false;
+
+  case BALANCE_STOP:
+    if (!agitationCoasted(ctx, *profile.tumble, elapsed))
+    {
+      return false;
+    }
+    // Hands may go into the drum: inverter off until the user confirms
+    applyOutputs(0, OUT_INV_PW);
+    showScreen("Press Start", "Once Balanced");
+    isAwaitingBalance = true;
+    ledSet(LED_BIT_WIFI, 0, LED_BIT_WIFI);
+    balanceStats.manual++;
+    ctx.balanceArmed = false;
+    ctx.balancePhase = BALANCE_MANUAL;
+    return false;
+
+  case BALANCE_MANUAL:
+    // Blink the WiFi LED until the user confirms the load is balanced. A
+    // HALT held since before the prompt does not count: it must be
+    // released (arming the prompt) and pressed again
+    if (!ctx.balanceArmed)
+    {
+      ctx.balanceArmed = !buttonStates[INPUT_HALT].pressed;
+      return false;
+    }
+    if (!buttonStates[INPUT_HALT].pressed)
+    {
+      return false;
+    }
+    ctx.balanceArmed = false;
+    isAwaitingBalance = false;
+    ledSet(LED_BIT_WIFI, 0, 0);
+    applyOutputs(OUT_INV_PW, 0);
+    balanceStats.runs++;
+    return true;
+  }
+  return true;
+}
+
+void sumpReset(StageContext &ctx)
+{
+  ctx.flatSince = 0;
+  ctx.sumpAt = 0;
+  flowEstimatorReset(ctx.sumpFlow);
+}
+
+// Feeds the sump slope (the last FILL_RATE_WINDOW samples, spacingMs apart)
+// and keeps ctx.flatSince: set while the slope is within flatLpm and the
+// level within marginL of setDrainingWaterLevel. False if no new sample.
+bool sumpSample(StageContext &ctx, uint32_t spacingMs, float flatLpm, float marginL, float &lpm)
+{
+  if (!readWaterLevel() || waterLevelTime - ctx.sumpAt < spacingMs)
+  {
+    return false;
+  }
+  ctx.sumpAt = waterLevelTime;
+  flowEstimatorAdd(ctx.sumpFlow, waterLevelTime, waterLevel);
+  lpm = flowEstimatorRate(ctx.sumpFlow) * 60;
+  bool flat = ctx.sumpFlow.count == FILL_RATE_WINDOW && fabsf(lpm) <= flatLpm &&
+              waterLevel <= setDrainingWaterLevel + marginL;
+  if (!flat)
+  {
+    ctx.flatSince = 0;
+  }
+  else if (ctx.flatSince == 0)
+  {
+    ctx.flatSince = millis();
+  }
+  return true;
+}
+
+// Fills to the step's target, closing IV early by the water still in
+// flight. With an agitation profile (and isFillAgitate) the drum starts
+// turning gently once the level passes FILL_AGITATE_MIN_L; that time is
+// credited to the stage's next OP_AGITATE.
+bool fillLogic(StageContext &ctx, const StageStep &step, bool entering)
+{
+  if (entering && step.text != NULL)
+  {
+    showScreen(" Filling Water..", "");
+    display.setCursor(1, 1);
+    display.print(step.text);
+    display.setCursor(13, 1);
+    display.print("L");
+  }
+  if (entering)
+  {
+    flowEstimatorReset(fillRun.flow);
+    fillRun.target = setFillingWaterLevel + step.arg;
+    fillRun.closedAt = 0;
+    fillRun.agitateFrom = 0;
+    fillRun.extraLagMs = 0;
+    fillRun.progressLevel = waterLevel;
+    fillRun.progressAt = millis();
+  }
+  if (readWaterLevel())
+  {
+    // Agitating: the surface sloshes, so take the mean of the last
+    // FILL_SLOSH_SAMPLES readings; the lag grows by half that window
+    if (fillRun.agitateFrom != 0)
+    {
+      waterLevel = levelAverage(FILL_SLOSH_SAMPLES);
+    }
+    flowEstimatorAdd(fillRun.flow, waterLevelTime, waterLevel);
+    if (waterLevel >= fillRun.progressLevel + FILL_STALL_RISE_L)
+    {
+      fillRun.progressLevel = waterLevel;
+      fillRun.progressAt = millis();
+    }
+    Serial.println(waterLevel, 1);
+    display.setCursor(8, 1);
+    display.print(waterLevel, 1);
+  }
+  // Pipelined fill: the drum is covered, agitate gently while IV stays open
+  if (step.agitation != NULL && isFillAgitate && fillRun.agitateFrom == 0 && fillRun.closedAt == 0 &&
+      waterLevel >= FILL_AGITATE_MIN_L && applyOutputs(OUT_INV_PW, 0))
+  {
+    fillRun.agitateFrom = millis();
+    fillRun.extraLagMs = FILL_SLOSH_SAMPLES * LEVEL_SAMPLE_PERIOD_MS / 2;
+    flowEstimatorReset(fillRun.flow);
+    ctx.agitationStep = 0;
+  }
+  bool iterationDone = fillRun.agitateFrom != 0 && agitationLogic(ctx, *step.agitation);
+  // Water Filling Control: close IV early by the water still in flight. A
+  // level that does not rise with IV open means no supply, a valve that
+  // will not open or a sensor that has stopped: the program is stopped
+  // rather than filling blind.
+  if (fillRun.closedAt == 0)
+  {
+    if (millis() - fillRun.progressAt >= FILL_STALL_MS)
+    {
+      fillStats.faults++;
+      cycleFault("  Fill Fault", " Check Supply", "Fill fault: level stuck at %.1f L for %lu s with the inlet open. Program stopped.",
+                 waterLevel, (millis() - fillRun.progressAt) / 1000);
+      return false;
+    }
+    float rate = flowEstimatorRate(fillRun.flow);
+    FillLearning lead = fillLearning;
+    lead.lagMs += fillRun.extraLagMs;
+    if (!fillShouldClose(waterLevel, rate, fillRun.target, lead))
+    {
+      relayWrite(ACT_IV, ON);
+      return false;
+    }
+    relayWrite(ACT_IV, OFF);
+    LATENCY_STOP(LATENCY_LEVEL_IV);
+    fillRun.closedAt = millis();
+    fillRun.levelAtClose = waterLevel;
+    fillRun.rateAtClose = rate;
+    flowEstimatorReset(fillRun.flow);
+    return false;
+  }
+  // Wait for the level to stop rising before measuring the overshoot
+  if (millis() - fillRun.closedAt < FILL_SETTLE_MAX_MS &&
+      (fillRun.flow.count < FILL_RATE_WINDOW || flowEstimatorRate(fillRun.flow) > FILL_MIN_RATE))
+  {
+    return false;
+  }
+  // Finish the running iteration, so the drum is stopped and forward again
+  if (fillRun.agitateFrom != 0 && !iterationDone && ctx.agitationStep != 0)
+  {
+    return false;
+  }
+  fillComplete();
+  if (fillRun.agitateFrom != 0)
+  {
+    uint32_t overlap = millis() - fillRun.agitateFrom;
+    ctx.overlapMs += overlap;
+    ctx.creditMs += overlap;
+    fillStats.agitatedFills++;
+    fillStats.overlapMs += overlap;
+  }
+  Serial.printf("Water Filling Complete! Value (In Litres): %.1f\n", waterLevel);
+  if (step.usage != NULL)
+  {
+    *step.usage = waterLevel;
+    cycleNotify(step.text2, waterLevel);
+    showScreen("  Water Filled", " Value:      L");
+    display.setCursor(8, 1);
+    display.print(waterLevel, 1);
+  }
+  return true;
+}
+
+// Drain until the level curve flattens near empty, instead of stopping at
+// the first reading under setDrainingWaterLevel and padding with a fixed
+// wait. A level that stops falling while still above empty means the pump
+// has stalled or the outlet is blocked: the program is stopped. Once the
+// level has been at empty, DRAIN_TAIL_MAX_MS ends the drain even if a noisy
+// sensor never shows a flat curve; DRAIN_TIMEOUT_MS bounds the whole step
+// (a sensor that never reads, or one that never settles above empty).
+bool drainLogic(StageContext &ctx, const char *label, bool entering)
+{
+  unsigned long now = millis();
+  if (entering)
+  {
+    showScreen(" Draining Water", "");
+    display.setCursor(1, 1);
+    display.print(label);
+    display.setCursor(13, 1);
+    display.print("L");
+    sumpReset(ctx);
+    ctx.drainProgressAt = now;
+    ctx.drainEmptyAt = 0;
+  }
+  if (now - ctx.stepStart >= DRAIN_TIMEOUT_MS)
+  {
+    drainStats.faults++;
+    cycleFault("  Drain Fault", "   Timed Out", "Drain fault: not drained after %lu min (level %.1f L). Program stopped.",
+               (now - ctx.stepStart) / 60000, waterLevel);
+    return false;
+  }
+
+  float lpm;
+  if (!sumpSample(ctx, DRAIN_SAMPLE_MS, DRAIN_FLAT_LPM, DRAIN_EMPTY_MARGIN_L, lpm))
+  {
+    return false;
+  }
+#if DRAIN_TRACE_SERIAL
+  Serial.printf("DRAIN,%lu,%.2f,%.2f\n", now - ctx.stepStart, waterLevel, lpm);
+#endif
+  display.setCursor(8, 1);
+  display.print(waterLevel, 1);
+
+  if (ctx.sumpFlow.count == 1 || waterLevel <= ctx.drainLowest - DRAIN_STALL_DROP_L)
+  {
+    ctx.drainLowest = waterLevel;
+    ctx.drainProgressAt = now;
+  }
+  if (ctx.drainEmptyAt == 0 && waterLevel <= setDrainingWaterLevel)
+  {
+    ctx.drainEmptyAt = now;
+  }
+  if (waterLevel > setDrainingWaterLevel + DRAIN_EMPTY_MARGIN_L && now - ctx.drainProgressAt >= DRAIN_STALL_MS)
+  {
+    drainStats.faults++;
+    cycleFault("  Drain Fault", " Check The Pump", "Drain fault: level stuck at %.1f L for %lu s. Program stopped.",
+               waterLevel, (now - ctx.drainProgressAt) / 1000);
+    return false;
+  }
+  bool tailDone = ctx.drainEmptyAt != 0 && now - ctx.drainEmptyAt >= DRAIN_TAIL_MAX_MS;
+  if (!tailDone && (ctx.flatSince == 0 || now - ctx.flatSince < DRAIN_FLAT_HOLD_MS))
+  {
+    return false;
+  }
+
+  // Tail: time spent after crossing setDrainingWaterLevel, i.e. the part of
+  // the old DRAIN_PAD_MS wait that was really needed
+  uint32_t tail = ctx.drainEmptyAt != 0 ? now - ctx.drainEmptyAt : 0;
+  drainStats.drains++;
+  drainStats.lastMs = now - ctx.stepStart;
+  drainStats.lastTailMs = tail;
+  drainStats.totalTailMs += tail;
+  if (tail > drainStats.maxTailMs)
+  {
+    drainStats.maxTailMs = tail;
+  }
+  Serial.printf("Drain done in %lu ms, tail %lu ms (pad was %u ms)\n", (unsigned long)drainStats.lastMs,
+                (unsigned long)tail, DRAIN_PAD_MS);
+  return true;
+}
+
+// Starts the ramp into the current spin stage
+static void spinStageBegin(StageContext &ctx, const SpinProfile &profile, unsigned long now)
+{
+  const SpinStage &stage = profile.stages[ctx.spinStage];
+  ctx.spinHolding = false;
+  ctx.spinStageStart = now;
+  driveRamp(stage.pwm, stage.rpm, stage.rampMs);
+  display.setCursor(0, 1);
+  display.printf("%-16s", stage.name);
+}
+
+// Staged spin: each stage ramps to its speed and holds it for minMs, then
+// until the sump level stops changing (the drain keeps up with whatever the
+// load still gives off) or maxMs runs out. A flat sump in the final stage
+// ends the spin early. The drive then ramps down to 0 over the final
+// stage's rampMs, so the step after it never cuts INV_PW under a speed
+// loop target, and the run is reported with its stage times.
+bool spinLogic(StageContext &ctx, const SpinProfile &profile, bool entering)
+{
+  unsigned long now = millis();
+  if (entering)
+  {
+    ctx.spinStage = 0;
+    memset(spinStats.lastStageMs, 0, sizeof(spinStats.lastStageMs));
+    spinStageBegin(ctx, profile, now);
+  }
+  if (ctx.spinStage == profile.count)
+  {
+    // Ramping down after the final stage
+    if (driveBusy())
+    {
+      return false;
+    }
+    String report;
+    for (uint8_t i = 0; i < profile.count; i++)
+    {
+      report += String("\n") + profile.stages[i].name + " (" + profile.stages[i].rpm + " rpm): " +
+                String(spinStats.lastStageMs[i] / 1000) + " s";
+    }
+    // Longer than cycleNotify's buffer, so straight to the outbox
+    const char *end = spinStats.lastEnd == SPIN_END_EXTRACTED ? "extraction finished" : "time limit";
+    outboxSend(String("Spin ended: ") + end + " after " + String(spinStats.lastMs / 1000) + " s." + report);
+    return true;
+  }
+  const SpinStage &stage = profile.stages[ctx.spinStage];
+  unsigned long elapsed = now - ctx.spinStageStart;
+
+  if (!ctx.spinHolding)
+  {
+    if (driveBusy())
+    {
+      return false;
+    }
+    spinStats.lastStageMs[ctx.spinStage] = elapsed;
+    ctx.spinHolding = true;
+    ctx.spinStageStart = now;
+    sumpReset(ctx);
+    return false;
+  }
+
+  float lpm;
+  if (sumpSample(ctx, SPIN_SUMP_SAMPLE_MS, profile.flatLpm, profile.sumpMarginL, lpm))
+  {
+#if SPIN_TRACE_SERIAL
+    Serial.printf("SPIN,%u,%lu,%.2f,%.2f\n", ctx.spinStage, elapsed, waterLevel, lpm);
+#endif
+  }
+
+  bool extracted = elapsed >= stage.minMs && ctx.flatSince != 0 && now - ctx.flatSince >= profile.flatHoldMs;
+  if (!extracted && elapsed < stage.maxMs)
+  {
+    return false;
+  }
+  spinStats.lastStageMs[ctx.spinStage] += elapsed;
+  if (++ctx.spinStage < profile.count)
+  {
+    spinStageBegin(ctx, profile, now);
+    return false;
+  }
+
+  // Final stage done: record the run and ramp down (target rpm 0)
+  spinStats.runs++;
+  spinStats.lastEnd = extracted ? SPIN_END_EXTRACTED : SPIN_END_TIME_LIMIT;
+  if (extracted)
+  {
+    spinStats.extracted++;
+  }
+  spinStats.lastMs = 0;
+  for (uint8_t i = 0; i < profile.count; i++)
+  {
+    spinStats.lastMs += spinStats.lastStageMs[i];
+  }
+  driveRamp(0, 0, stage.rampMs);
+  return false;
+}
+
+// Runs one table step for this tick; returns true once the step has finished.
+bool runStageStep(const StageStep &step, StageContext &ctx)
+{
+  bool entering = !ctx.entered;
+  ctx.entered = true;
+
+  switch (step.op)
+  {
+  case OP_OUTPUTS:
+    // Held by the CO1/CO2 interlock until the drive is off
+    return applyOutputs(step.arg, step.arg2);
+
+  case OP_SCREEN:
+    showScreen(step.text, step.text2);
+    return true;
+
+  case OP_NOTIFY:
+    cycleNotify("%s", step.text);
+    return true;
+
+  case OP_PWM:
+    driveRamp(step.arg, step.count, step.durationMs);
+    return true;
+
+  case OP_WAIT:
+    return millis() - ctx.stepStart >= step.durationMs;
+
+  case OP_FILL:
+    return fillLogic(ctx, step, entering);
+
+  case OP_DRAIN:
+    return drainLogic(ctx, step.text, entering);
+
+  case OP_AGITATE:
+    if (entering)
+    {
+      ctx.iteration = 0;
+      ctx.agitationStep = 0;
+      // Agitation already done while filling counts towards this step
+      if (ctx.creditMs != 0)
+      {
+        if (step.count)
+        {
+          ctx.iteration = min((unsigned long)step.count, ctx.creditMs / agitationIterationMs(*step.agitation));
+        }
+        else
+        {
+          ctx.stepStart -= min((uint32_t)step.durationMs, ctx.creditMs);
+        }
+        ctx.creditMs = 0;
+      }
+    }
+    if (ctx.agitationStep == 0)
+    {
+      const AgitationProfile &p = *step.agitation;
+      unsigned long iterationMs = agitationIterationMs(p);
+      int total = step.count ? step.count : (step.durationMs + iterationMs - 1) / iterationMs;
+      bool done = step.count ? ctx.iteration >= step.count : millis() - ctx.stepStart >= step.durationMs;
+      if (done)
+      {
+        return true;
+      }
+      display.setCursor(0, 1);
+      display.printf("Iteration:%d/%d ", ctx.iteration + 1, total);
+    }
+    if (agitationLogic(ctx, *step.agitation))
+    {
+      ctx.iteration++;
+    }
+    return false;
+
+  case OP_BALANCE:
+    return balanceLogic(ctx, *step.balance, entering);
+
+  case OP_SPIN:
+    return spinLogic(ctx, *step.spin, entering);
+  }
+  return true;
+}
+
+// Table interpreter: advances the stage through as many steps as finish this tick.
+bool runStage(CycleStage stage, StageContext &ctx)
+{
+  const StageTable &table = stageTables[stage];
+  while (ctx.step < table.numSteps)
+  {
+    if (!runStageStep(table.steps[ctx.step], ctx))
+    {
+      return false;
+    }
+    ctx.step++;
+    ctx.entered = false;
+    ctx.stepStart = millis();
+  }
+  return true;
+}
+
+void cycleNotify(const char *format, ...)
+{
+  char text[96];
+  va_list args;
+  va_start(args, format);
+  vsnprintf(text, sizeof(text), format, args);
+  va_end(args);
+  outboxSend(text);
+}
+
+// Drive off and the relays open, the reason on the LCD, all stage LEDs
+// blinking and a Telegram notice; the executor then goes idle. INV_PW and
+// IV go first and unconditionally. An open drain stays open when a drain
+// step faulted or the tub still holds water: closing it would trap whatever
+// a stuck IV lets in. CO1/CO2 open last, once changeoverSafe() holds; the
+// LEDC duty can lag driveSet(0) by a PWM period, or a running fade.
+void cycleFault(const char *row0, const char *row1, const char *format, ...)
+{
+  char text[128];
+  va_list args;
+  va_start(args, format);
+  vsnprintf(text, sizeof(text), format, args);
+  va_end(args);
+
+  const StageTable &table = stageTables[cycle.program->steps[cycle.step].stage];
+  bool draining = cycle.stage.step < table.numSteps && table.steps[cycle.stage.step].op == OP_DRAIN;
+  bool keepDrain = digitalRead(DM_SPIN) == ON &&
+                   (draining || waterLevel > setDrainingWaterLevel + DRAIN_EMPTY_MARGIN_L);
+  driveSet(0);
+  applyOutputs(0, OUT_INV_PW | OUT_IV | (keepDrain ? 0 : OUT_DM_WASH | OUT_DM_SPIN));
+  uint32_t waitStart = millis();
+  while (!changeoverSafe() && millis() - waitStart < FAULT_CHANGEOVER_WAIT_MS)
+  {
+    vTaskDelay(pdMS_TO_TICKS(10));
+  }
+  if (!applyOutputs(0, OUT_CO1 | OUT_CO2))
+  {
+    strncat(text, " CO1/CO2 left on: drive did not stop.", sizeof(text) - strlen(text) - 1);
+  }
+  showScreen(row0, row1);
+  ledShow(LED_SCENE_FAULT);
+  outboxSend(text);
+
+  cycle.program = NULL;
+  programRunning = false;
+  CycleEvent fault = {CYCLE_EVT_FAULT};
+  xQueueSend(cycleEventQueue, &fault, portMAX_DELAY);
+}
+
+void beginCycleStep()
+{
+  memset(&cycle.stage, 0, sizeof(cycle.stage));
+  cycle.stage.stepStart = millis();
+  cycle.stageStart = cycle.stage.stepStart;
+  ledShow(cycle.program->steps[cycle.step].scene);
+}
+
+void cycleStart(int mode)
+{
+  cycle.program = &cyclePrograms[mode];
+  cycle.step = 0;
+  startTime = millis();
+  actuatorTraceBegin(mode);
+  programRunning = true;
+  beginCycleStep();
+  xTaskNotifyGive(cycletask_handle);
+}
+
+void cycleTick()
+{
+  const CycleProgram *program = cycle.program;
+  const CycleStep &step = program->steps[cycle.step];
+
+  if (rotorLocked())
+  {
+    cycleFault("  Motor Fault", " Rotor Locked", "Motor fault: no drum feedback for %u s while driven at duty %u. Program stopped.",
+               ROTOR_LOCK_MS / 1000, driveDuty());
+    return;
+  }
+  if (!runStage(step.stage, cycle.stage))
+  {
+    return;
+  }
+  StageTiming &timing = stageTimes[step.stage];
+  timing.lastMs = millis() - cycle.stageStart;
+  timing.lastOverlapMs = cycle.stage.overlapMs;
+  Serial.printf("STAGE,%s,%lu,%lu\n", stageNames[step.stage], (unsigned long)timing.lastMs, (unsigned long)timing.lastOverlapMs);
+  if (timing.lastOverlapMs != 0)
+  {
+    cycleNotify("%s stage: %lu min %lu s, %lu s of it agitating while filling.", stageNames[step.stage],
+                timing.lastMs / 60000, timing.lastMs / 1000 % 60, timing.lastOverlapMs / 1000);
+  }
+  if (step.doneMessage != NULL)
+  {
+    cycleNotify("%s", step.doneMessage);
+  }
+  if (++cycle.step < program->numSteps)
+  {
+    beginCycleStep();
+    return;
+  }
+
+  // Program finished: report usage and runtime, then hand the UI back to loop()
+  if (program->waterUsed == &totalWaterUsed)
+  {
+    totalWaterUsed = washWaterUsed + rinseWaterUsed;
+  }
+  if (program->waterUsed != NULL)
+  {
+    cycleNotify("Total Water Used:%.2f L", *program->waterUsed);
+  }
+  runTime = millis() - startTime;
+  cycleNotify("Program Complete. Total Runtime:  %lu Minutes", runTime / 60000);
+  Serial.printf("Cycle ticks: %u, drift avg: %d us, max: %d us, overruns: %u\n",
+                (unsigned)tickStats.ticks, (int)(tickStats.totalDriftUs / (tickStats.ticks ? tickStats.ticks : 1)),
+                (int)tickStats.maxDriftUs, (unsigned)tickStats.overruns);
+#if LATENCY_PROBES
+  latencyReport();
+#endif
+
+  ledShow(LED_SCENE_IDLE);
+  cycle.program = NULL;
   programRunning = false;
+  CycleEvent done = {CYCLE_EVT_DONE};
+  xQueueSend(cycleEventQueue, &done, portMAX_DELAY);
 }
-/* --------------------  11. Spin Program Function (END)  ---------------------- */
 
-
-/* --------------------  12. Soak Program Function (START)  ---------------------- */
-void soakLogic()
+void cycletask(void *parameter)
 {
-  programRunning = true;
-  digitalWrite(INV_PW, OFF);
-  digitalWrite(DM_SPIN, OFF);
-  digitalWrite(DM_WASH, OFF);
-  digitalWrite(CO1, OFF);
-  digitalWrite(CO2, OFF);
-  display.clear();
-  display.setCursor(1, 0);
-  display.print("Filling Water..");
-  display.setCursor(1, 1);
-  display.print("SOAK");
-  display.setCursor(13, 1);
-  display.print("L");
-
-  // Water Filling Control
-  while (waterLevel < setFillingWaterLevel)
+  while (true)
   {
-    digitalWrite(IV, ON);
-    tareWaterLevel = level.get_units() / multiplier;
-    waterLevel = tareWaterLevel - offset;
-    Serial.println(waterLevel, 1);
-    display.setCursor(8, 1);
-    display.print(waterLevel, 1);
+    // Sleep until cycleStart() hands over a program
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+    TickType_t lastWake = xTaskGetTickCount();
+    int64_t scheduledUs = esp_timer_get_time();
+    while (cycle.program != NULL)
+    {
+      vTaskDelayUntil(&lastWake, pdMS_TO_TICKS(CYCLE_TICK_MS));
+      scheduledUs += CYCLE_TICK_MS * 1000;
+
+      // Drift: how late this tick started against its fixed schedule
+      int32_t driftUs = (int32_t)(esp_timer_get_time() - scheduledUs);
+      tickStats.ticks++;
+      tickStats.totalDriftUs += driftUs;
+      if (driftUs > tickStats.maxDriftUs)
+      {
+        tickStats.maxDriftUs = driftUs;
+      }
+      if (driftUs >= CYCLE_TICK_MS * 1000)
+      {
+        tickStats.overruns++;
+      }
+
+      cycleTick();
+    }
   }
-  digitalWrite(IV, OFF);
-  Serial.println("Water Filling Complete!");
-  Serial.println("Value (In Litres):");
-  Serial.print(waterLevel);
-  display.clear();
-  display.setCursor(2, 0);
-  display.print("Water Filled");
-  display.setCursor(1, 1);
-  display.print("Value:      L");
-  display.setCursor(8, 1);
-  display.print(waterLevel, 1);
-  digitalWrite(IV, OFF);
-  digitalWrite(DM_WASH, ON);
-  display.clear();
-  display.setCursor(1, 0);
-  display.print("Soaking.....");
-  digitalWrite(INV_PW, ON);
-  vTaskDelay(100 / portTICK_PERIOD_MS);
+}
 
-  for (int i = 0; i < 50; i++)
+void handleCycleEvents()
+{
+  CycleEvent event;
+  while (xQueueReceive(cycleEventQueue, &event, 0) == pdTRUE)
   {
-    display.setCursor(1, 1);
-    display.print("Iteration:");
-    display.setCursor(12, 1);
-    display.print(i);
-    analogWrite(CTR_SIG, 200);
-    vTaskDelay(4000 / portTICK_PERIOD_MS);
-    analogWrite(CTR_SIG, 0);
-    vTaskDelay(2500 / portTICK_PERIOD_MS);
-    digitalWrite(CO1, ON);
-    digitalWrite(CO2, ON);
-    vTaskDelay(4000 / portTICK_PERIOD_MS);
-    analogWrite(CTR_SIG, 200);
-    vTaskDelay(4000 / portTICK_PERIOD_MS);
-    analogWrite(CTR_SIG, 0);
-    vTaskDelay(2500 / portTICK_PERIOD_MS);
-    digitalWrite(CO1, OFF);
-    digitalWrite(CO2, OFF);
-    vTaskDelay(2500 / portTICK_PERIOD_MS);
+    selectedMode = 0;
+    if (event.type == CYCLE_EVT_DONE)
+    {
+      // Back to the program selection screen
+      display.clear();
+      displayPrint();
+    }
+    // CYCLE_EVT_FAULT: the fault stays on the LCD until a program is selected
   }
-
-  digitalWrite(INV_PW, OFF);
-  digitalWrite(DM_WASH, OFF);
-  programRunning = false;
 }
-/* --------------------  12. Soak Program Function (END)  ---------------------- */
+/* --------------------  18. Cycle Executor (END)  ---------------------- */
 
 
-/* --------------------  13. WiFi Connect Function (START)  ---------------------- */
+/* --------------------  19. WiFi Connect Function (START)  ---------------------- */
 boolean connectWifi()
 {
   boolean state = true;
@@ -888,10 +3429,10 @@ boolean connectWifi()
   }
   return state;
 }
-/* --------------------  13. WiFi Connect Function (END)  ---------------------- */
+/* --------------------  19. WiFi Connect Function (END)  ---------------------- */
 
 
-/* ----------------  14. Engineering Mode Helper Functions (START)  -------------------- */
+/* ----------------  20. Engineering Mode Helper Functions (START)  -------------------- */
 void displayTestMenu() {
   display.clear();
   display.setCursor(1, 0);
@@ -903,7 +3444,7 @@ void displayTestMenu() {
 void reboot() {
   // Final safety check
   if (programRunning) {
-    telegram.sendMessage(CHAT_ID, "❌ Cannot reboot - Program is running!\nPlease halt the program first.", "Markdown");
+    outboxSend("❌ Cannot reboot - Program is running!\nPlease halt the program first.", true);
     testMenuOption = 0;
     sendMenu();
     return;
@@ -916,9 +3457,9 @@ void reboot() {
   digitalWrite(IV, OFF);
   digitalWrite(CO1, OFF);
   digitalWrite(CO2, OFF);
-  analogWrite(CTR_SIG, 0);
+  driveSet(0);
   
-  telegram.sendMessage(CHAT_ID, "⚠️ *Rebooting System*\n\nDevice restaring in 3 seconds...", "Markdown");
+  outboxSend("⚠️ *Rebooting System*\n\nDevice restaring in 3 seconds...", true);
   
   display.clear();
   display.setCursor(5, 0);
@@ -929,10 +3470,10 @@ void reboot() {
   delay(3000);
   esp_restart();
 }
-/* ----------------  14. Engineering Mode Helper Functions (END)  -------------------- */
+/* ----------------  20. Engineering Mode Helper Functions (END)  -------------------- */
 
 
-/* ----------------  15. Water Level Sensor Test Logic (START)  -------------------- */
+/* ----------------  21. Water Level Sensor Test Logic (START)  -------------------- */
 void waterLevelSensorTest() {
   // ========== SEND INITIAL INFO ==========
   String msg = "💧 *WATER LEVEL SENSOR TEST*\n\n";
@@ -944,7 +3485,7 @@ void waterLevelSensorTest() {
   msg += "3. Open inlet valve briefly\n";
   msg += "4. Verify sensor response\n\n";
   msg += "⚡ Starting test...";
-  telegram.sendMessage(CHAT_ID, msg, "Markdown");
+  outboxSend(msg, true);
   
   display.clear();
   display.setCursor(0, 0);
@@ -955,17 +3496,16 @@ void waterLevelSensorTest() {
   // ========== CHECK HX710B COMMUNICATION ==========
   bool i2cOK = false;
   float baseline = 0;
-  float readings[10];
   
-  if (level.is_ready()) {
+  if (levelSensorReady()) {
     i2cOK = true;
-    baseline = level.get_units() / multiplier;
     
-    // Take 10 baseline readings
+    // Baseline: mean of 10 readings
     for (int i = 0; i < 10; i++) {
-      readings[i] = level.get_units() / multiplier;
+      baseline += levelUnits() / multiplier;
       delay(100);
     }
+    baseline /= 10;
   }
   
   // ========== OPEN VALVE & TEST RESPONSE ==========
@@ -982,7 +3522,7 @@ void waterLevelSensorTest() {
   vTaskDelay(2000 / portTICK_PERIOD_MS); // Wait for water to settle
   
   // Take new readings
-  float newLevel = level.get_units() / multiplier;
+  float newLevel = levelUnits() / multiplier;
   float delta = abs(newLevel - baseline);
   
   // ========== ANALYZE RESULTS ==========
@@ -1028,7 +3568,7 @@ void waterLevelSensorTest() {
     report += "Sensor and valve functioning correctly.";
   }
   
-  telegram.sendMessage(CHAT_ID, report, "Markdown");
+  outboxSend(report, true);
   
   display.clear();
   display.setCursor(0, 0);
@@ -1039,10 +3579,10 @@ void waterLevelSensorTest() {
   
   displayTestMenu();
 }
-/* ----------------  15. Water Level Sensor Test Logic (END)  -------------------- */
+/* ----------------  21. Water Level Sensor Test Logic (END)  -------------------- */
 
 
-/* ----------------  16. Inlet Valve Test Logic (START)  -------------------- */
+/* ----------------  22. Inlet Valve Test Logic (START)  -------------------- */
 void inletValveTest() {
   // ========== CONSTANTS FOR 4 MINUTE TEST ==========
   const unsigned long duration = 240000; // 4 minutes in milliseconds
@@ -1051,14 +3591,8 @@ void inletValveTest() {
 
   // ========== HELPER: Get averaged water level reading ==========
   auto getCurrentWaterLevel = [&]() {
-    float total = 0;
-    for (int i = 0; i < 5; i++) {
-      tareWaterLevel = level.get_units() / multiplier;
-      waterLevel = tareWaterLevel - offset;
-      total += waterLevel;
-      delay(50);
-    }
-    return total / 5.0;
+    waterLevel = levelAverage(5);
+    return waterLevel;
   };
 
   // ========== SAFETY CHECK ==========
@@ -1067,12 +3601,12 @@ void inletValveTest() {
   if (initialLevel > 15.0) { // Prevent overflow
     String msg = "⚠️ *TEST ABORTED*\nWater level too high: " + String(initialLevel, 1) + "L\n";
     msg += "Please drain tank below 15L before testing.";
-    telegram.sendMessage(CHAT_ID, msg, "Markdown");
+    outboxSend(msg, true);
     return;
   }
 
   // ========== INITIALIZE TEST ==========
-  telegram.sendMessage(CHAT_ID, "🚰 *WATER INLET VALVE AUTO-TEST*\nStarting 4 minute test...", "Markdown");
+  outboxSend("🚰 *WATER INLET VALVE AUTO-TEST*\nStarting 4 minute test...", true);
   
   float waterLevelReadings[samples];
   unsigned long testStartTime = millis();
@@ -1082,7 +3616,7 @@ void inletValveTest() {
   progressMsg += "Initial Level: " + String(initialLevel, 2) + "L\n";
   progressMsg += "Duration: 4min | Min Delta: " + String(VALVE_TEST_MIN_DELTA, 1) + "L\n\n";
   progressMsg += "🔄 Opening valve...";
-  int msgid = telegram.sendMessage(CHAT_ID, progressMsg, "Markdown");
+  int msgid = outboxSendProgress(progressMsg, true);
   
   // Open the inlet valve
   digitalWrite(IV, ON);
@@ -1108,7 +3642,7 @@ void inletValveTest() {
       update += "Remaining: " + String(minutesRemaining) + "m " + String(secsRemaining) + "s\n";
       update += (deltaLevel >= VALVE_TEST_MIN_DELTA) ? "✅ ON TRACK" : "⏳ IN PROGRESS";
       
-      telegram.sendMessage(CHAT_ID, update, "Markdown", msgid);
+      outboxEdit(msgid, update, true);
     }
     
     sampleIndex++;
@@ -1199,16 +3733,16 @@ void inletValveTest() {
   }
 
   // ========== SEND FINAL REPORT ==========
-  telegram.sendMessage(CHAT_ID, report, "Markdown");
+  outboxSend(report, true);
   
   Serial.println("=== VALVE TEST COMPLETE ===");
   Serial.printf("Initial: %.2fL, Final: %.2fL, Delta: %.2fL\n", initialLevel, finalLevel, totalDelta);
   Serial.printf("Flow Rate: %.3fL/s, Samples: %d, Result: %s\n", averageFlowRate, sampleIndex, testPassed ? "PASS" : "FAIL");
 }
-/* ----------------  16. Inlet Valve Test Logic (END)  -------------------- */
+/* ----------------  22. Inlet Valve Test Logic (END)  -------------------- */
 
 
-/* ----------------  17. Drain Motor (Wash Stage) Test Logic (START)  -------------------- */
+/* ----------------  23. Drain Motor (Wash Stage) Test Logic (START)  -------------------- */
 void drainMotorWashStageTest() {
   // ========== SEND INITIAL INSTRUCTIONS ==========
   String msg = "🔧 *DRAIN MOTOR TEST*\n\n";
@@ -1221,7 +3755,7 @@ void drainMotorWashStageTest() {
   msg += "   ❌ *RINSE Button* - Drum is stuck/hard to turn\n\n";
   msg += "⚡ Starting test in 5 seconds...";
   
-  telegram.sendMessage(CHAT_ID, msg, "Markdown");
+  outboxSend(msg, true);
   
   // ========== COUNTDOWN & ACTIVATE MOTOR ==========
   for (int i = 5; i > 0; i--) {
@@ -1250,28 +3784,33 @@ void drainMotorWashStageTest() {
   instructionMsg += "❌ RINSE button - Stuck/difficult\n\n";
   instructionMsg += "Waiting for your input...";
   
-  telegram.sendMessage(CHAT_ID, instructionMsg, "Markdown");
+  outboxSend(instructionMsg, true);
   
   // ========== WAIT FOR USER RESPONSE ==========
-  awaitingDrainMotorResponse = true;
+  bool responded = false;
   drainMotorTestResult = false;
+  xQueueReset(inputQueue);
   
   unsigned long waitStart = millis();
   unsigned long timeout = 60000; // 60 second timeout
   
-  while (awaitingDrainMotorResponse && (millis() - waitStart < timeout)) {
-    if ((millis() - waitStart) % 2000 < 100) {
-      display.setCursor(0, 1);
-      display.print("Waiting...      ");
+  display.setCursor(0, 1);
+  display.print("Waiting...      ");
+  while (!responded && (millis() - waitStart < timeout)) {
+    InputEvent event;
+    if (xQueueReceive(inputQueue, &event, pdMS_TO_TICKS(500)) == pdTRUE &&
+        (event.button == INPUT_SPIN || event.button == INPUT_RINSE)) {
+      // SPIN = Motor working smoothly, RINSE = Motor stuck/failed
+      drainMotorTestResult = event.button == INPUT_SPIN;
+      responded = true;
     }
-    delay(100);
   }
   
   // ========== TURN OFF MOTOR ==========
   digitalWrite(DM_WASH, OFF);
   
   // ========== GENERATE & SEND REPORT ==========
-  if (!awaitingDrainMotorResponse) {
+  if (responded) {
     // User responded - display result
     display.clear();
     display.setCursor(0, 0);
@@ -1314,7 +3853,7 @@ void drainMotorWashStageTest() {
       "4. Inspect motor mounting and bearings\n"
       "5. Check for belt misalignment";
     
-    telegram.sendMessage(CHAT_ID, report, "Markdown");
+    outboxSend(report, true);
   } else {
     // Timeout occurred
     display.clear();
@@ -1323,18 +3862,17 @@ void drainMotorWashStageTest() {
     display.setCursor(0, 1);
     display.print("No Response");
     
-    telegram.sendMessage(CHAT_ID, "⏱️ *TEST TIMEOUT*\nNo button pressed within 60 seconds.\nTest cancelled.", "Markdown");
+    outboxSend("⏱️ *TEST TIMEOUT*\nNo button pressed within 60 seconds.\nTest cancelled.", true);
     delay(2000);
   }
   
-  // ========== RESET & RETURN TO TEST MODE ==========
-  awaitingDrainMotorResponse = false;
+  // ========== RETURN TO TEST MODE ==========
   displayTestMenu();
 }
-/* ----------------  17. Drain Motor (Wash Stage) Test Logic (END) -------------------- */
+/* ----------------  23. Drain Motor (Wash Stage) Test Logic (END) -------------------- */
 
 
-/* ----------------  18. Drain Motor (Spin Stage) Test Logic (START) -------------------- */
+/* ----------------  24. Drain Motor (Spin Stage) Test Logic (START) -------------------- */
 void drainMotorSpinStageTest() {
   String msg = 
     "🔧 *SPIN STAGE TEST INITIATED*\n\n"
@@ -1344,7 +3882,7 @@ void drainMotorSpinStageTest() {
     "2. Activating Inverter Power\n"
     "3. Sending low speed (50 PWM) to motor\n"
     "4. Running for 30 seconds\n";
-  telegram.sendMessage(CHAT_ID, msg, "Markdown");
+  outboxSend(msg, true);
 
   display.clear();
   display.setCursor(0, 0); 
@@ -1368,7 +3906,7 @@ void drainMotorSpinStageTest() {
   display.print("Inverter: ON");
 
   // Step 4: Send 50 PWM on CTR_SIG
-  analogWrite(CTR_SIG, 50);
+  driveSet(50);
   display.clear();
   display.setCursor(0, 0); 
   display.print("Motor PWM: 50");
@@ -1379,7 +3917,7 @@ void drainMotorSpinStageTest() {
   vTaskDelay(30000 / portTICK_PERIOD_MS);
 
   // Step 6: Turn off PWM (CTRL to 0)
-  analogWrite(CTR_SIG, 0);
+  driveSet(0);
   display.clear();
   display.setCursor(0, 0); 
   display.print("PWM: OFF");
@@ -1408,7 +3946,7 @@ void drainMotorSpinStageTest() {
     "• Test power to DM_WASH & DM_SPIN\n"
     "• Review error LEDs on inverter (if present)\n"
     "• Investigate motor connections\n";
-  telegram.sendMessage(CHAT_ID, result, "Markdown");
+  outboxSend(result, true);
 
   display.clear();
   display.setCursor(0, 0); 
@@ -1420,20 +3958,48 @@ void drainMotorSpinStageTest() {
   // Restore display to engineering status
   displayTestMenu();
 }
-/* ----------------  18. Drain Motor (Spin Stage) Test Logic (END)  -------------------- */
+/* ----------------  24. Drain Motor (Spin Stage) Test Logic (END)  -------------------- */
+
+
+/* ----------------  25. Main Motor Rotation Test Logic (START)  -------------------- */
+// Delay in 100 ms slices, ending early when a motor profile started with
+// motorTestRampDone finishes. drivenSince is set once CTR_SIG reaches
+// ROTOR_LOCK_MIN_PWM; false as soon as the drum has been driven for
+// ROTOR_LOCK_MS from then without a feedback pulse.
+bool motorTestWait(uint32_t ms, uint32_t &drivenSince, bool showRpm) {
+  uint32_t start = millis();
+  while (millis() - start < ms) {
+    if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(100)) > 0) {
+      return true;
+    }
+    if (drivenSince == 0 && driveDuty() >= ROTOR_LOCK_MIN_PWM) {
+      drivenSince = millis();
+    }
+    if (showRpm) {
+      display.setCursor(9, 1);
+      display.printf("%4drpm", (int)drumRpm());
+    }
+    if (drivenSince != 0 && drumStalled(drivenSince)) {
+      return false;
+    }
+  }
+  return true;
+}
 
+void motorTestRampDone(void *arg) {
+  xTaskNotifyGive((TaskHandle_t)arg);
+}
 
-/* ----------------  19. Main Motor Rotation Test Logic (START)  -------------------- */
 void motorRotationTest() {
   // ========== SEND INITIAL INFO ==========
   String msg = "⚙️ *MOTOR ROTATION TEST*\n\n";
   msg += "Test Procedure:\n";
-  msg += "1. Forward rotation (0-200 PWM)\n";
+  msg += "1. Forward S-curve ramp (20-200 PWM, 18s)\n";
   msg += "2. Hold at 200 PWM for 10s\n";
-  msg += "3. Reverse rotation (0-200 PWM)\n";
+  msg += "3. Reverse S-curve ramp (20-200 PWM, 3.6s)\n";
   msg += "4. Repeat 2 cycles\n\n";
   msg += "⚡ Starting test...";
-  telegram.sendMessage(CHAT_ID, msg, "Markdown");
+  outboxSend(msg, true);
   
   display.clear();
   display.setCursor(0, 0);
@@ -1441,16 +4007,20 @@ void motorRotationTest() {
   display.setCursor(0, 1);
   display.print("Initializing..");
   
-  // ========== FEEDBACK PULSE COUNTER (FOR FUTURE) ==========
-  volatile int feedbackPulses = 0;
+  // ========== FEEDBACK PULSE COUNTERS (PCNT) ==========
+  uint32_t forwardPulses = 0;
+  uint32_t reversePulses = 0;
+  uint32_t testStartPulses = drumSpeedRead().pulses;
+  float peakRpm = 0;
   bool motorLocked = false;
+  int cyclesCompleted = 0;
   
   // ========== TURN ON INVERTER POWER ==========
   digitalWrite(INV_PW, ON);
   vTaskDelay(200 / portTICK_PERIOD_MS);
   
   // ========== CYCLE LOOP (2 TIMES) ==========
-  for (int cycle = 1; cycle <= 2; cycle++) {
+  for (int cycle = 1; cycle <= 2 && !motorLocked; cycle++) {
     // --- FORWARD ROTATION ---
     display.clear();
     display.setCursor(0, 0);
@@ -1460,17 +4030,25 @@ void motorRotationTest() {
     display.setCursor(0, 1);
     display.print("Forward Ramp");
     
-    for (int pwm = 20; pwm <= 200; pwm += 5) {
-      analogWrite(CTR_SIG, pwm);
-      vTaskDelay(500 / portTICK_PERIOD_MS);
-      // TODO: Read feedback pulses here and update feedbackPulses
-    }
+    uint32_t startPulses = drumSpeedRead().pulses;
+    uint32_t drivenSince = 0;
+    ulTaskNotifyTake(pdTRUE, 0);
+    driveSet(20);
+    driveRamp(200, 0, 18000, motorTestRampDone, xTaskGetCurrentTaskHandle());
+    motorLocked = !motorTestWait(20000, drivenSince, false);
     
-    display.setCursor(0, 1);
-    display.print("Hold 10s...   ");
-    vTaskDelay(10000 / portTICK_PERIOD_MS);
+    if (!motorLocked) {
+      display.setCursor(0, 1);
+      display.print("Hold 10s        ");
+      motorLocked = !motorTestWait(10000, drivenSince, true);
+      peakRpm = max(peakRpm, drumRpm());
+    }
     
-    analogWrite(CTR_SIG, 0);
+    driveSet(0);
+    forwardPulses += drumSpeedRead().pulses - startPulses;
+    if (motorLocked) {
+      break;
+    }
     vTaskDelay(1000 / portTICK_PERIOD_MS);
     
     // --- REVERSE ROTATION ---
@@ -1486,42 +4064,53 @@ void motorRotationTest() {
     display.setCursor(0, 1);
     display.print("Reverse Ramp");
     
-    for (int pwm = 20; pwm <= 200; pwm += 5) {
-      analogWrite(CTR_SIG, pwm);
-      vTaskDelay(100 / portTICK_PERIOD_MS);
-      // TODO: Read feedback pulses here
-    }
+    startPulses = drumSpeedRead().pulses;
+    drivenSince = 0;
+    ulTaskNotifyTake(pdTRUE, 0);
+    driveSet(20);
+    driveRamp(200, 0, 3600, motorTestRampDone, xTaskGetCurrentTaskHandle());
+    motorLocked = !motorTestWait(5000, drivenSince, false);
     
-    display.setCursor(0, 1);
-    display.print("Hold 10s...   ");
-    vTaskDelay(10000 / portTICK_PERIOD_MS);
+    if (!motorLocked) {
+      display.setCursor(0, 1);
+      display.print("Hold 10s        ");
+      motorLocked = !motorTestWait(10000, drivenSince, true);
+      peakRpm = max(peakRpm, drumRpm());
+    }
     
-    analogWrite(CTR_SIG, 0);
+    driveSet(0);
+    reversePulses += drumSpeedRead().pulses - startPulses;
     digitalWrite(CO1, OFF);
     digitalWrite(CO2, OFF);
-    vTaskDelay(1000 / portTICK_PERIOD_MS);
+    if (!motorLocked) {
+      cyclesCompleted++;
+      vTaskDelay(1000 / portTICK_PERIOD_MS);
+    }
   }
   
   // ========== SHUTDOWN ==========
+  driveSet(0);
+  digitalWrite(CO1, OFF);
+  digitalWrite(CO2, OFF);
   digitalWrite(INV_PW, OFF);
-  
-  // ========== TODO: feedback check (future implementation) ==========
-  // motorLocked = (feedbackPulses < 10); // Threshold to be tuned
+  uint32_t totalPulses = drumSpeedRead().pulses - testStartPulses;
   
   // ========== GENERATE REPORT ==========
   String report = "⚙️ *MOTOR ROTATION TEST REPORT*\n\n";
   report += "🎯 *Test Summary:*\n";
-  report += "Cycles Completed: 2/2\n";
-  report += "Forward Rotations: ✅\n";
-  report += "Reverse Rotations: ✅\n";
+  report += "Cycles Completed: " + String(cyclesCompleted) + "/2\n";
+  report += "Forward Rotations: " + String(forwardPulses > 0 ? "✅" : "❌") + "\n";
+  report += "Reverse Rotations: " + String(reversePulses > 0 ? "✅" : "❌") + "\n";
   report += "PWM Range: 20-200\n\n";
   
   report += "📊 *Feedback Status:*\n";
-  report += "Pulse Count: " + String(feedbackPulses) + " (API ready)\n";
+  report += "Pulse Count: " + String(totalPulses) + " (fwd " + String(forwardPulses) + ", rev " + String(reversePulses) + ")\n";
+  report += "Peak RPM @200: " + String(peakRpm, 0) + "\n";
   report += "Motor Lock Detect: " + String(motorLocked ? "⚠️ YES" : "✅ NO") + "\n\n";
   
   if (motorLocked) {
     report += "⚠️ *Motor Issue Detected*\n";
+    report += "No feedback pulse for " + String(ROTOR_LOCK_MS / 1000) + " s while driven; drive was cut.\n";
     report += "Possible Issues:\n";
     report += "• Motor mechanically locked\n";
     report += "• Drive overload fault\n";
@@ -1533,21 +4122,140 @@ void motorRotationTest() {
     report += "Motor rotates smoothly in both directions.";
   }
   
-  telegram.sendMessage(CHAT_ID, report, "Markdown");
+  outboxSend(report, true);
   
   display.clear();
   display.setCursor(0, 0);
-  display.print("Motor: PASS");
+  display.print(motorLocked ? "Motor: LOCKED" : "Motor: PASS");
   display.setCursor(0, 1);
   display.print("Test Complete");
   vTaskDelay(3000 / portTICK_PERIOD_MS);
   
   displayTestMenu();
 }
-/* ----------------  19. Main Motor Rotation Test Logic (END)  -------------------- */
+/* ----------------  25. Main Motor Rotation Test Logic (END)  -------------------- */
+
+
+/* ----------------  26. Speed Loop Tuning Logic (START)  -------------------- */
+void sendSpeedTuning() {
+  String menu = "🎚️ *SPEED LOOP TUNING*\n\n";
+  menu += "Kp: " + String(speedPid.gains.kp, 3) + "\n";
+  menu += "Ki: " + String(speedPid.gains.ki, 3) + "\n";
+  menu += "Kd: " + String(speedPid.gains.kd, 3) + "\n";
+  menu += "Step: " + String(tuneRpm) + " rpm from " + String(tuneDuty) + " PWM\n\n";
+  menu += "Commands:\n";
+  menu += "kp/ki/kd <value> - set a gain\n";
+  menu += "rpm <value> - step test target\n";
+  menu += "duty <value> - step test feedforward\n";
+  menu += "run - " + String(SPEED_STEP_TEST_MS / 1000) + " s step test (drum turns!)\n";
+  menu += "save - keep gains across reboots\n";
+  menu += "back - main menu";
+  
+  outboxSend(menu, true);
+}
+
+void speedStepTest() {
+  display.clear();
+  display.setCursor(0, 0);
+  display.print("Speed Step Test");
+  
+  digitalWrite(INV_PW, ON);
+  vTaskDelay(200 / portTICK_PERIOD_MS);
+  
+  uint32_t start = millis();
+  driveSet(tuneDuty, tuneRpm);
+  
+  // Rise time to 90 %, overshoot, then error and duty over the last 3 s
+  uint32_t riseMs = 0;
+  float peakRpm = 0;
+  float absError = 0;
+  float dutySum = 0;
+  int settledSamples = 0;
+  bool motorLocked = false;
+  while (millis() - start < SPEED_STEP_TEST_MS) {
+    vTaskDelay(100 / portTICK_PERIOD_MS);
+    float rpm = drumRpm();
+    uint32_t t = millis() - start;
+    peakRpm = max(peakRpm, rpm);
+    if (riseMs == 0 && rpm >= tuneRpm * 0.9f) {
+      riseMs = t;
+    }
+    if (t >= SPEED_STEP_TEST_MS - 3000) {
+      absError += fabsf(tuneRpm - rpm);
+      dutySum += drive.duty;
+      settledSamples++;
+    }
+    display.setCursor(0, 1);
+    display.printf("%4drpm PWM %3d ", (int)rpm, drive.duty);
+    if (drumStalled(start)) {
+      motorLocked = true;
+      break;
+    }
+  }
+  
+  driveSet(0);
+  digitalWrite(INV_PW, OFF);
+  
+  String report = "🎚️ *STEP RESPONSE*\n\n";
+  report += "Target: " + String(tuneRpm) + " rpm from " + String(tuneDuty) + " PWM\n";
+  report += "Gains: Kp " + String(speedPid.gains.kp, 3) + ", Ki " + String(speedPid.gains.ki, 3) + ", Kd " + String(speedPid.gains.kd, 3) + "\n\n";
+  if (motorLocked) {
+    report += "⚠️ No feedback pulses: locked rotor or FB_SIG disconnected. Drive cut.";
+  } else {
+    report += "Rise (90%): " + (riseMs ? String(riseMs) + " ms" : String("not reached")) + "\n";
+    report += "Overshoot: " + String(peakRpm > tuneRpm ? (peakRpm - tuneRpm) * 100 / tuneRpm : 0, 1) + " %\n";
+    report += "Mean |Error| (last 3 s): " + String(settledSamples ? absError / settledSamples : 0, 1) + " rpm\n";
+    report += "Mean PWM (last 3 s): " + String(settledSamples ? dutySum / settledSamples : 0, 0) + "\n";
+  }
+  outboxSend(report, true);
+  displayTestMenu();
+}
+
+void handleSpeedTuning(String cmd) {
+  cmd.trim();
+  int space = cmd.indexOf(' ');
+  String name = space > 0 ? cmd.substring(0, space) : cmd;
+  float value = space > 0 ? cmd.substring(space + 1).toFloat() : 0;
+  
+  if (name == "kp" && space > 0) {
+    speedPid.gains.kp = value;
+  }
+  else if (name == "ki" && space > 0) {
+    speedPid.gains.ki = value;
+  }
+  else if (name == "kd" && space > 0) {
+    speedPid.gains.kd = value;
+  }
+  else if (name == "rpm" && space > 0) {
+    tuneRpm = constrain((int)value, 0, 2000);
+  }
+  else if (name == "duty" && space > 0) {
+    tuneDuty = constrain((int)value, 0, 255);
+  }
+  else if (name == "run") {
+    speedStepTest();
+    return;
+  }
+  else if (name == "save") {
+    speedSaveGains();
+    outboxSend("✅ Speed loop gains saved.");
+    return;
+  }
+  else if (name == "back") {
+    testMenuOption = 0;
+    sendMenu();
+    return;
+  }
+  else {
+    outboxSend("❓ Invalid option. Send kp/ki/kd/rpm/duty <value>, run, save or back.");
+    return;
+  }
+  sendSpeedTuning();
+}
+/* ----------------  26. Speed Loop Tuning Logic (END)  -------------------- */
 
 
-/* ----------------  20. LED Test Logic (START)  -------------------- */
+/* ----------------  27. LED Test Logic (START)  -------------------- */
 void ledTest() {
 
   if (ledtask_handle != NULL) 
@@ -1566,7 +4274,7 @@ void ledTest() {
   msg += "• LCD Backlight\n\n";
   msg += "Running 2 cycles...";
   
-  int statusMsgID = telegram.sendMessage(CHAT_ID, msg, "Markdown");
+  int statusMsgID = outboxSendProgress(msg, true);
   
   display.clear();
   display.setCursor(0, 0);
@@ -1598,7 +4306,7 @@ void ledTest() {
       // Update Telegram message
       String update = "💡 *LED TEST*\n\nCycle " + String(cycle) + "/2\n";
       update += "Current: " + ledNames[i] + " LED ✅\n";
-      telegram.sendMessage(CHAT_ID, update, "Markdown", statusMsgID);
+      outboxEdit(statusMsgID, update, true);
       
       vTaskDelay(500 / portTICK_PERIOD_MS);
       
@@ -1630,7 +4338,7 @@ void ledTest() {
   report += "✅ LCD Backlight: OK\n\n";
   report += "💡 *Result:* All LEDs functional";
   
-  telegram.sendMessage(CHAT_ID, report, "Markdown");
+  outboxSend(report, true);
   
   display.clear();
   display.setCursor(0, 0);
@@ -1646,10 +4354,10 @@ void ledTest() {
   
   displayTestMenu();
 }
-/* ----------------  20. LED Test Logic (END)  -------------------- */
+/* ----------------  27. LED Test Logic (END)  -------------------- */
 
 
-/* ----------------  21. MCU Self Test Logic (START)  -------------------- */
+/* ----------------  28. MCU Self Test Logic (START)  -------------------- */
 void mcuSelfTest() {
   // ========== SEND INITIAL INFO ==========
   String msg = "🖥️ *MCU SELF-TEST*\n\n";
@@ -1659,7 +4367,7 @@ void mcuSelfTest() {
   msg += "• Flash parameters\n";
   msg += "• WiFi RSSI\n\n";
   msg += "⚡ Starting...";
-  telegram.sendMessage(CHAT_ID, msg, "Markdown");
+  outboxSend(msg, true);
   
   display.clear();
   display.setCursor(0, 0);
@@ -1735,7 +4443,7 @@ void mcuSelfTest() {
     report += "MCU is functioning correctly.";
   }
   
-  telegram.sendMessage(CHAT_ID, report, "Markdown");
+  outboxSend(report, true);
   
   display.clear();
   display.setCursor(0, 0);
@@ -1746,10 +4454,10 @@ void mcuSelfTest() {
   
   displayTestMenu();
 }
-/* ----------------  21. MCU Self Test Logic (END)  -------------------- */
+/* ----------------  28. MCU Self Test Logic (END)  -------------------- */
 
 
-/* ----------------  22. All Buttons Test Logic (START)  -------------------- */
+/* ----------------  29. All Buttons Test Logic (START)  -------------------- */
 void allButtonsTest() {
   // ========== SEND INITIAL INFO ==========
   String msg = "🎛️ *ALL BUTTONS TEST*\n\n";
@@ -1761,14 +4469,13 @@ void allButtonsTest() {
   msg += "• HALT\n\n";
   msg += "Waiting for button press...";
   
-  int statusMsgID = telegram.sendMessage(CHAT_ID, msg, "Markdown");
+  int statusMsgID = outboxSendProgress(msg, true);
   
   // ========== BUTTON TEST ARRAY ==========
-  int buttons[] = {WASH_BTN, RINSE_BTN, SPIN_BTN, COMP_BTN, HALT_BTN};
-  String buttonNames[] = {"WASH", "RINSE", "SPIN", "COMP", "PAUSE"};
-  unsigned long debounceTime[5] = {0};
-  bool buttonTested[5] = {false, false, false, false, false};
-  int numButtons = 5;
+  uint32_t bounces[BUTTON_COUNT] = {0};
+  bool passed[BUTTON_COUNT] = {false};
+  int numButtons = BUTTON_COUNT;
+  int passCount = 0;
   
   // ========== TEST LOOP ==========
   for (int i = 0; i < numButtons; i++) {
@@ -1779,65 +4486,80 @@ void allButtonsTest() {
     display.print(buttonNames[i]);
     display.print(" Button");
     
-    String update = "🎛️ *BUTTON TEST*\n\nPress: *" + buttonNames[i] + "* button\n\nWaiting...";
-    telegram.sendMessage(CHAT_ID, update, "Markdown", statusMsgID);
+    String update = "🎛️ *BUTTON TEST*\n\nPress: *" + String(buttonNames[i]) + "* button\n\nWaiting...";
+    outboxEdit(statusMsgID, update, true);
     
-    // Wait for button press
-    unsigned long pressStart = 0;
-    while (!buttonTested[i]) {
-      if (digitalRead(buttons[i]) == LOW) { // Button pressed
-        if (pressStart == 0) {
-          pressStart = millis();
-        } else if (millis() - pressStart > 50) { // Debounce 50ms
-          debounceTime[i] = millis() - pressStart;
-          buttonTested[i] = true;
-          
-          display.clear();
-          display.setCursor(0, 0);
-          display.print(buttonNames[i]);
-          display.print(": OK");
-          display.setCursor(0, 1);
-          display.print("Debounce:");
-          display.print(debounceTime[i]);
-          display.print("ms");
-          
-          vTaskDelay(1000 / portTICK_PERIOD_MS);
-        }
-      } else {
-        pressStart = 0; // Reset if button released
+    // Wait for the debounced press and release of this button; a button
+    // that never reports in BUTTON_TEST_TIMEOUT_MS fails and the test moves on
+    xQueueReset(inputQueue);
+    uint32_t bouncesBefore = buttonStates[i].bounces;
+    uint32_t startTime = millis();
+    InputEvent event;
+    while (!passed[i]) {
+      uint32_t elapsed = millis() - startTime;
+      if (elapsed >= BUTTON_TEST_TIMEOUT_MS ||
+          xQueueReceive(inputQueue, &event, pdMS_TO_TICKS(BUTTON_TEST_TIMEOUT_MS - elapsed)) != pdTRUE) {
+        break;
       }
-      vTaskDelay(10 / portTICK_PERIOD_MS);
+      passed[i] = event.type == INPUT_RELEASE && event.button == i;
     }
+    bounces[i] = buttonStates[i].bounces - bouncesBefore;
+    if (passed[i]) {
+      passCount++;
+    }
+    
+    display.clear();
+    display.setCursor(0, 0);
+    display.print(buttonNames[i]);
+    display.print(passed[i] ? ": OK" : ": FAIL");
+    display.setCursor(0, 1);
+    if (passed[i]) {
+      display.print("Bounces: ");
+      display.print(bounces[i]);
+    } else {
+      display.print("No Press");
+    }
+    
+    vTaskDelay(1000 / portTICK_PERIOD_MS);
   }
   
   // ========== GENERATE REPORT ==========
   String report = "🎛️ *ALL BUTTONS TEST REPORT*\n\n";
   report += "🎯 *Test Summary:*\n";
-  report += "Buttons Tested: 5/5\n\n";
+  report += "Buttons Passed: " + String(passCount) + "/" + String(numButtons) + "\n\n";
   
   for (int i = 0; i < numButtons; i++) {
-    report += "✅ " + buttonNames[i] + " Button: OK\n";
-    report += "   Debounce Time: " + String(debounceTime[i]) + " ms\n";
+    if (passed[i]) {
+      report += "✅ " + String(buttonNames[i]) + " Button: OK\n";
+      report += "   Bounces: " + String(bounces[i]) + "\n";
+    } else {
+      report += "❌ " + String(buttonNames[i]) + " Button: FAILED\n";
+      report += "   No press within " + String(BUTTON_TEST_TIMEOUT_MS / 1000) + " s\n";
+    }
   }
   
-  report += "\n💡 *Result:* All buttons functional\n";
-  report += "Debounce times within normal range.";
+  if (passCount == numButtons) {
+    report += "\n💡 *Result:* All buttons functional\n";
+  } else {
+    report += "\n⚠️ *Result:* " + String(numButtons - passCount) + " button(s) not responding - check wiring and switches\n";
+  }
+  report += "Bounce counts are edges beyond one per press/release, absorbed by the " + String(BUTTON_DEBOUNCE_MS) + " ms debounce.";
   
-  telegram.sendMessage(CHAT_ID, report, "Markdown");
+  outboxSend(report, true);
   
   display.clear();
   display.setCursor(0, 0);
   display.print("Button Test");
   display.setCursor(0, 1);
-  display.print("All PASS");
+  display.print(passCount == numButtons ? "All PASS" : "FAIL");
   vTaskDelay(3000 / portTICK_PERIOD_MS);
   
   displayTestMenu();
 }
-/* ----------------  22. All Buttons Test Logic (END)  -------------------- */
+/* ----------------  29. All Buttons Test Logic (END)  -------------------- */
 
 
-/* ----------------  23. Connectivity Test Logic (START)  -------------------- */
+/* ----------------  30. Connectivity Test Logic (START)  -------------------- */
 void connectivityTest() {
   String msg = "🌐 *CONNECTIVITY TEST*\n\n";
   
@@ -1865,12 +4587,12 @@ void connectivityTest() {
   msg += "\n🌍 Web Server: ";
   msg += wifiConnected ? "Running ✅" : "Offline ❌";
   
-  telegram.sendMessage(CHAT_ID, msg, "Markdown");
+  outboxSend(msg, true);
 }
-/* ----------------  23. Connectivity Test Logic (END)  -------------------- */
+/* ----------------  30. Connectivity Test Logic (END)  -------------------- */
 
 
-/* ----------------  24. Calibration Test Logic (START)  -------------------- */
+/* ----------------  31. Calibration Test Logic (START)  -------------------- */
 void calibrationTest() {
   String msg = "⚖️ *WATER LEVEL CALIBRATION*\n\n";
   msg += "Current Settings:\n";
@@ -1881,14 +4603,14 @@ void calibrationTest() {
   msg += "1. Empty the tank completely\n";
   msg += "2. Modify multiplier/offset in code\n";
   msg += "3. Upload new firmware\n\n";
-  msg += "Raw sensor value: " + String(level.get_units(), 2);
+  msg += "Raw sensor value: " + String(levelUnits(), 2);
   
-  telegram.sendMessage(CHAT_ID, msg, "Markdown");
+  outboxSend(msg, true);
 }
-/* ----------------  24. Calibration Test Logic (END)  -------------------- */
+/* ----------------  31. Calibration Test Logic (END)  -------------------- */
 
 
-/* ----------------  25. System Info Test Logic (START)  -------------------- */
+/* ----------------  32. System Info Test Logic (START)  -------------------- */
 void sendSystemInfo() {
   String msg = "ℹ️ *SYSTEM INFORMATION*\n\n";
   
@@ -1919,6 +4641,126 @@ void sendSystemInfo() {
   msg += "🔄 Program Running: " + String(programRunning ? "YES" : "NO") + "\n";
   msg += "🎯 Selected Mode: " + String(selectedMode) + "\n";
   msg += "🔬 Simulation: " + String(isSimulation ? "ON" : "OFF") + "\n\n";
+
+  // Water level sampler
+  msg += "💧 *Level Sampler:*\n";
+  msg += "Rate: " + String(levelStats.rateHz, 1) + " Hz\n";
+  msg += "Samples: " + String(levelStats.samples) + "\n";
+  msg += "Dropped: " + String(levelStats.dropped) + "\n";
+  msg += "Not Ready: " + String(levelStats.notReady) + "\n\n";
+
+  // Predictive fill cutoff
+  msg += "🚰 *Fill Cutoff:*\n";
+  msg += "Lag: " + String(fillLearning.lagMs) + " ms (" + String(fillLearning.fills) + " fills)\n";
+  msg += "Last Overshoot: " + String(fillStats.lastOvershoot, 2) + " L\n";
+  msg += "Avg |Overshoot|: " + String(fillStats.fills ? fillStats.totalAbsOvershoot / fillStats.fills : 0, 2) + " L\n";
+  msg += "Agitate While Filling: " + String(isFillAgitate ? "On" : "Off") + ", " + String(fillStats.agitatedFills) +
+         " fills, " + String(fillStats.overlapMs / 60000.0, 1) + " min overlapped\n";
+  msg += "Fill Faults: " + String(fillStats.faults) + "\n";
+  for (int i = STAGE_SOAK; i <= STAGE_SPIN; i++)
+  {
+    if (stageTimes[i].lastMs != 0)
+    {
+      msg += String(stageNames[i]) + ": " + String(stageTimes[i].lastMs / 60000.0, 1) + " min (" +
+             String(stageTimes[i].lastOverlapMs / 60000.0, 1) + " overlapped)\n";
+    }
+  }
+  msg += "\n";
+
+  // Drum speed (FB_SIG via PCNT)
+  DrumSpeed speed = drumSpeedRead();
+  msg += "🌀 *Drum Speed:*\n";
+  msg += "RPM: " + String(speed.rpm, 0) + " (max " + String(speed.maxRpm, 0) + ")\n";
+  msg += "Pulses: " + String(speed.pulses) + " @ " + String(DRUM_PULSES_PER_REV) + "/rev\n";
+  msg += "Updates: " + String(speed.samples) + " @ " + String(RPM_SAMPLE_MS) + " ms\n\n";
+
+  // Spin balancing
+  msg += "⚖️ *Spin Balance:*\n";
+  msg += "Spins: " + String(balanceStats.runs) + ", Asked User: " + String(balanceStats.manual) + "\n";
+  msg += "Measurements: " + String(balanceStats.measurements) + ", Redistributions: " + String(balanceStats.redistributions) + "\n";
+  msg += "Last Ripple: " + String(balanceStats.lastRipplePct, 1) + " %\n\n";
+
+  // Drain completion
+  msg += "🚿 *Drain:*\n";
+  msg += "Drains: " + String(drainStats.drains) + ", Pump Faults: " + String(drainStats.faults) + "\n";
+  if (drainStats.drains > 0)
+  {
+    msg += "Last: " + String(drainStats.lastMs / 1000.0, 1) + " s, tail " + String(drainStats.lastTailMs / 1000.0, 1) + " s\n";
+    msg += "Tail Avg/Max: " + String(drainStats.totalTailMs / drainStats.drains / 1000.0, 1) + " / " +
+           String(drainStats.maxTailMs / 1000.0, 1) + " s (fixed pad was " + String(DRAIN_PAD_MS / 1000) + " s)\n";
+  }
+  msg += "\n";
+
+  // Spin profile
+  msg += "🌀 *Spin Profile:*\n";
+  msg += "Spins: " + String(spinStats.runs) + ", Ended Early: " + String(spinStats.extracted) + "\n";
+  if (spinStats.runs > 0)
+  {
+    msg += "Last: " + String(spinStats.lastMs / 1000) + " s, " +
+           (spinStats.lastEnd == SPIN_END_EXTRACTED ? "extraction finished" : "time limit") + "\n";
+  }
+  msg += "\n";
+
+  // Agitation reversals
+  msg += "🔄 *Reversals:*\n";
+  msg += "Count: " + String(reversalStats.reversals) + ", Interlock Blocks: " + String(reversalStats.blocked) + "\n";
+  msg += "Coast: " + String(reversalStats.learnedCoastMs) + " ms learned\n";
+  msg += "Stops: " + String(reversalStats.feedbackStops) + " FB, " + String(reversalStats.modelStops) + " model, " + String(reversalStats.timedStops) + " timed, " + String(reversalStats.timeouts) + " timeout\n";
+  msg += "Agitation Duty: " + String(reversalStats.totalMs ? reversalStats.runMs * 100.0f / reversalStats.totalMs : 0, 1) + " %\n\n";
+
+  // Drum speed loop
+  msg += "🎚️ *Speed Loop:*\n";
+  msg += "Target: " + String(drive.targetRpm) + " rpm, PWM: " + String(drive.duty) + " (table " + String(drive.feedforward) + ")\n";
+  msg += "Gains: Kp " + String(speedPid.gains.kp, 3) + ", Ki " + String(speedPid.gains.ki, 3) + ", Kd " + String(speedPid.gains.kd, 3) + "\n";
+  uint32_t loopAvgUs = speedStats.iterations ? (uint32_t)(speedStats.totalUs / speedStats.iterations) : 0;
+  msg += "Cost: " + String(loopAvgUs) + " us avg, " + String(speedStats.maxUs) + " us max (" + String(loopAvgUs * 100.0f / (RPM_SAMPLE_MS * 1000), 3) + "% of a core)\n";
+  msg += "Saturated: " + String(speedStats.saturated) + ", No Feedback: " + String(speedStats.noFeedback) + "\n";
+  msg += "Profiles: " + String(speedStats.profiles) + " done, " + String(speedStats.cancelled) + " cancelled" + String(driveBusy() ? " (running)" : "") + "\n\n";
+
+  // Telegram outbox
+  msg += "📨 *Telegram Outbox:*\n";
+  msg += "Sent: " + String(outboxStats.sent) + ", Edits: " + String(outboxStats.edits) + "\n";
+  msg += "Coalesced: " + String(outboxStats.coalesced) + "\n";
+  msg += "Retries: " + String(outboxStats.retries) + ", Dropped: " + String(outboxStats.dropped) + "\n\n";
+
+  // Telegram receiver
+  msg += "📥 *Telegram Receiver:*\n";
+  msg += "Polls: " + String(rxStats.polls) + ", Reconnects: " + String(rxStats.reconnects) + "\n";
+  msg += "Commands: " + String(rxStats.commands) + ", Failures: " + String(rxStats.failures) + "\n\n";
+
+  // Telegram TLS sessions (tx = CommsTask, rx = RxTask)
+  msg += "🔐 *TLS:*\n";
+  const TlsClientStats *tlsStats[2] = {&secured_client.stats, &rx_client.stats};
+  for (int i = 0; i < 2; i++) {
+    const TlsClientStats &t = *tlsStats[i];
+    msg += String(i == 0 ? "TX" : "RX") + " Handshakes: " + String(t.handshakes) + " (ticket offered: " + String(t.resumeOffered) + ", failed: " + String(t.failures) + ")\n";
+    msg += String(i == 0 ? "TX" : "RX") + " Avg Handshake: " + String(t.handshakes ? t.handshakeMs / t.handshakes : 0) + " ms\n";
+    msg += String(i == 0 ? "TX" : "RX") + " Bytes: " + String((unsigned long)t.bytesSent) + " out, " + String((unsigned long)t.bytesReceived) + " in\n";
+  }
+  msg += "\n";
+
+  // LCD render task
+  msg += "🖥️ *Display:*\n";
+  msg += "Frames: " + String(displayStats.frames) + ", Cells Sent: " + String(displayStats.cells) + "\n\n";
+
+  // Button input latency
+  uint32_t cyclesPerUs = ESP.getCpuFreqMHz();
+  msg += "🔘 *Buttons:*\n";
+  msg += "Events: " + String(inputStats.events) + ", Dropped: " + String(inputStats.dropped) + "\n";
+  msg += "Latency Avg: " + String((unsigned long)(inputStats.totalLatencyCycles / (inputStats.events ? inputStats.events : 1) / cyclesPerUs)) + " us\n";
+  msg += "Latency Max: " + String(inputStats.maxLatencyCycles / cyclesPerUs) + " us\n";
+  msg += "Bounces:";
+  for (int i = 0; i < BUTTON_COUNT; i++) {
+    msg += " " + String(buttonNames[i]) + "=" + String(buttonStates[i].bounces);
+  }
+  msg += "\n\n";
+
+  // Cycle executor timing
+  msg += "⏲️ *Cycle Executor:*\n";
+  msg += "Ticks: " + String(tickStats.ticks) + " @ " + String(CYCLE_TICK_MS) + " ms\n";
+  msg += "Drift Avg: " + String((long)(tickStats.totalDriftUs / (tickStats.ticks ? tickStats.ticks : 1))) + " us\n";
+  msg += "Drift Max: " + String((long)tickStats.maxDriftUs) + " us\n";
+  msg += "Overruns: " + String(tickStats.overruns) + "\n\n";
   
   // Last water usage
   msg += "💧 *Last Water Usage:*\n";
@@ -1926,12 +4768,12 @@ void sendSystemInfo() {
   msg += "Rinse: " + String(rinseWaterUsed, 1) + " L\n";
   msg += "Total: " + String(totalWaterUsed, 1) + " L\n";
   
-  telegram.sendMessage(CHAT_ID, msg, "Markdown");
+  outboxSend(msg, true);
 }
-/* ----------------  25. System Info Test Logic (END)  -------------------- */
+/* ----------------  32. System Info Test Logic (END)  -------------------- */
 
 
-/* ----------------  26. Engineering Mode Menu Logic (START)  -------------------- */
+/* ----------------  33. Engineering Mode Menu Logic (START)  -------------------- */
 void sendMenu() {
   String menu = "🔧 *ENGINEERING MODE ACTIVATED*\n\n";
   menu += "Main Menu - Select an option:\n";
@@ -1940,15 +4782,16 @@ void sendMenu() {
   menu += "3️⃣ Calibration\n";
   menu += "4️⃣ System Info\n";
   menu += "5️⃣ System Reboot\n";
-  menu += "6️⃣ Exit Test Mode\n\n";
-  menu += "Send the number (1-6) to select";
+  menu += "6️⃣ Exit Test Mode\n";
+  menu += "7️⃣ Speed Loop Tuning\n\n";
+  menu += "Send the number (1-7) to select";
   
-  telegram.sendMessage(CHAT_ID, menu, "Markdown");
+  outboxSend(menu, true);
 }
-/* ----------------  26. Engineering Mode Menu Logic (END)  -------------------- */
+/* ----------------  33. Engineering Mode Menu Logic (END)  -------------------- */
 
 
-/* ----------------  27. Component Test Submenu Logic (START)  -------------------- */
+/* ----------------  34. Component Test Submenu Logic (START)  -------------------- */
 void sendSubMenu() {
   String menu = "🔧 *COMPONENT TEST MENU*\n\n";
   menu += "Select component to test:\n";
@@ -1963,15 +4806,15 @@ void sendSubMenu() {
   menu += "9️⃣ Back to Main Menu\n\n";
   menu += "Send number (1-9):";
   
-  telegram.sendMessage(CHAT_ID, menu, "Markdown");
+  outboxSend(menu, true);
 }
-/* ----------------  27. Component Test Submenu Logic (END)  -------------------- */
+/* ----------------  34. Component Test Submenu Logic (END)  -------------------- */
 
 
-/* ----------------  28. Engineering Mode Control Functions (START)  -------------------- */
+/* ----------------  35. Engineering Mode Control Functions (START)  -------------------- */
 void enterEngineeringMode() {
   if (programRunning) {
-    telegram.sendMessage(CHAT_ID, "❌ Cannot enter TEST MODE: Program is currently running!", "");
+    outboxSend("❌ Cannot enter TEST MODE: Program is currently running!");
     return;
   }
   
@@ -1997,13 +4840,13 @@ void exitEngineeringMode() {
   digitalWrite(IV, OFF);
   digitalWrite(CO1, OFF);
   digitalWrite(CO2, OFF);
-  analogWrite(CTR_SIG, 0);
+  driveSet(0);
   
   // Update hardware display
   display.clear();
   displayPrint();
   
-  telegram.sendMessage(CHAT_ID, "✅ Exited TEST MODE. Back to normal operation.", "");
+  outboxSend("✅ Exited TEST MODE. Back to normal operation.");
   Serial.println("Engineering Mode Exited");
 }
 
@@ -2023,7 +4866,7 @@ void handleSubMenu(String cmd) {
     drainMotorSpinStageTest();
   }
   else if (cmd == "5") {
-   // motorRotationTest();
+    motorRotationTest();
   }
   else if (cmd == "6") {
    // ledTest();
@@ -2032,7 +4875,7 @@ void handleSubMenu(String cmd) {
     // mcuSelfTest();
   }
   else if (cmd == "8") {
-    // allButtonsTest();
+    allButtonsTest();
   }
   else if (cmd == "9" || cmd == "back") {
     // Return to main menu
@@ -2040,7 +4883,7 @@ void handleSubMenu(String cmd) {
     sendMenu();
   }
   else {
-    telegram.sendMessage(CHAT_ID, "❓ Invalid option. Send 1-9 for component tests.", "");
+    outboxSend("❓ Invalid option. Send 1-9 for component tests.");
   }
 }
 
@@ -2054,6 +4897,12 @@ void handleMenu(String cmd) {
     return;
   }
   
+  // ========== SPEED LOOP TUNING HANDLER ==========
+  if (testMenuOption == 200) {
+    handleSpeedTuning(cmd);
+    return;
+  }
+  
   // ========== MAIN MENU HANDLER ==========
   if (cmd == "1") {
     // Component Test - Enter submenu
@@ -2075,34 +4924,31 @@ void handleMenu(String cmd) {
   else if (cmd == "6" || cmd == "exit") {
     exitEngineeringMode();
   }
+  else if (cmd == "7") {
+    // Speed Loop Tuning - Enter tuning mode
+    testMenuOption = 200;
+    sendSpeedTuning();
+  }
   else if (cmd == "menu" || cmd == "/menu") {
     sendMenu();
   }
   else {
-    telegram.sendMessage(CHAT_ID, "❓ Invalid option. Send 1-6 or 'menu' for main menu.", "");
+    outboxSend("❓ Invalid option. Send 1-7 or 'menu' for main menu.");
   }
 }
 
-/* ----------------  28. Engineering Mode Control Functions (END)  -------------------- */
+/* ----------------  35. Engineering Mode Control Functions (END)  -------------------- */
 
 
-/* ----------------  29. Mode State Control Function (START)  -------------------- */
+/* ----------------  36. Mode State Control Function (START)  -------------------- */
 void handleTelegramMessages() {
-  int numNewMessages = telegram.getUpdates(telegram.last_message_received + 1);
-  
-  for (int i = 0; i < numNewMessages; i++) {
-    String chat_id = String(telegram.messages[i].chat_id);
-    String text = telegram.messages[i].text;
-    
-    // Only respond to authorized chat ID
-    if (chat_id != CHAT_ID) {
-      continue;
-    }
+  TelegramCommand command;
+  while (xQueueReceive(commandQueue, &command, 0) == pdTRUE) {
+    String text = command.text;
     
     text.trim();
     text.toLowerCase();
     Serial.println(text);
-    delay(1000);
     
     // Enter Engineering Mode
     if ((text == ENGINEERING_COMMAND || text == "/engineering") && !isTestMode) {
@@ -2123,9 +4969,60 @@ void handleTelegramMessages() {
     }
   }
 }
-/* ----------------  29. Mode State Control Function (END)  -------------------- */
+// Program selection from the front panel. A program button opens the
+// confirmation window; any button during the window cancels it.
+void handleInputEvent(const InputEvent &event)
+{
+  if (event.type != INPUT_PRESS)
+  {
+    // Long presses and chords are reported but not bound to an action yet
+    if (event.type != INPUT_RELEASE)
+    {
+      Serial.printf("Button %s: %s%s%s\n", event.type == INPUT_CHORD ? "chord" : "long press",
+                    buttonNames[event.button], event.type == INPUT_CHORD ? "+" : "",
+                    event.type == INPUT_CHORD ? buttonNames[event.other] : "");
+    }
+    return;
+  }
+
+  uint32_t latency = ESP.getCycleCount() - event.cycles;
+  inputStats.events++;
+  inputStats.totalLatencyCycles += latency;
+  if (latency > inputStats.maxLatencyCycles)
+  {
+    inputStats.maxLatencyCycles = latency;
+  }
+
+  if (event.button == INPUT_HALT)
+  {
+    selectedMode = 0;
+    return;
+  }
+  if (programRunning)
+  {
+    return;
+  }
+  if (pendingMode != 0)
+  {
+    selectedMode = 0;
+    return;
+  }
+
+  const int buttonModes[] = {1, 2, 3, 4}; // INPUT_WASH, INPUT_RINSE, INPUT_SPIN, INPUT_COMP
+  selectedMode = buttonModes[event.button];
+  const CycleProgram &program = cyclePrograms[selectedMode];
+  pendingMode = selectedMode;
+  ledSet(LED_STAGE_MASK, program.confirmLeds, 0);
+  display.clear();
+  display.setCursor(2, 0);
+  display.print(program.title);
+  display.setCursor(2, 1);
+  display.print(program.duration);
+  startWaitTime = millis();
+}
+/* ----------------  36. Mode State Control Function (END)  -------------------- */
 
-/* ----------------  30. Main Setup Function (START)  -------------------- */
+/* ----------------  37. Main Setup Function (START)  -------------------- */
 void setup()
 {
   Serial.begin(115200);
@@ -2167,9 +5064,34 @@ void setup()
   Serial.println("Post-Init WLS Reading:");
   Serial.println(level.get_units(), 2);
   Serial.println("WLS Initialised.............");
+  fillLoadLearning();
+  speedLoadGains();
+  driveBegin();
+  if (!drumSpeedBegin())
+  {
+    Serial.println("FB_SIG pulse counter unavailable");
+  }
+  xTaskCreatePinnedToCore(
+      levelSamplerTask,  // Task Function
+      "LevelTask",       // Task Name
+      3072,              // Stack Size (bytes)
+      NULL,              // Task parameter
+      3,                 // Task Priority
+      &leveltask_handle, // Task handle
+      0                  // Core to run the task
+  );
   Serial.println("POST Complete...............");
   display.init();
   display.backlight();
+  xTaskCreatePinnedToCore(
+      displaytask,         // Task Function
+      "DisplayTask",       // Task Name
+      2048,                // Stack Size (bytes)
+      NULL,                // Task parameter
+      1,                   // Task Priority
+      &displaytask_handle, // Task handle
+      0                    // Core to run the task
+  );
   display.setCursor(0, 0);
   display.print(" IntelliVerter ");
   display.setCursor(0, 1);
@@ -2183,17 +5105,22 @@ void setup()
   digitalWrite(RINSE_LED, OFF);
   digitalWrite(SPIN_LED, OFF);
   digitalWrite(SOAK_LED, OFF);
-  attachInterrupt(digitalPinToInterrupt(WASH_BTN), washButtonISR, FALLING);
-  attachInterrupt(digitalPinToInterrupt(RINSE_BTN), rinseButtonISR, FALLING);
-  attachInterrupt(digitalPinToInterrupt(SPIN_BTN), spinButtonISR, FALLING);
-  attachInterrupt(digitalPinToInterrupt(COMP_BTN), compButtonISR, FALLING);
-  attachInterrupt(digitalPinToInterrupt(HALT_BTN), haltButtonISR, FALLING);
+  inputQueue = xQueueCreate(INPUT_QUEUE_DEPTH, sizeof(InputEvent));
+  const esp_timer_create_args_t samplerArgs = {buttonSampleCallback, NULL, ESP_TIMER_TASK, "button_debounce", true};
+  esp_timer_create(&samplerArgs, &buttonSampler);
+  esp_timer_start_periodic(buttonSampler, BUTTON_SAMPLE_MS * 1000);
+  attachInterrupt(digitalPinToInterrupt(WASH_BTN), washButtonISR, CHANGE);
+  attachInterrupt(digitalPinToInterrupt(RINSE_BTN), rinseButtonISR, CHANGE);
+  attachInterrupt(digitalPinToInterrupt(SPIN_BTN), spinButtonISR, CHANGE);
+  attachInterrupt(digitalPinToInterrupt(COMP_BTN), compButtonISR, CHANGE);
+  attachInterrupt(digitalPinToInterrupt(HALT_BTN), haltButtonISR, CHANGE);
 
   wifiConnected = connectWifi();
 
   if (wifiConnected)
   {
     secured_client.setCACert(TELEGRAM_CERTIFICATE_ROOT);
+    rx_client.setCACert(TELEGRAM_CERTIFICATE_ROOT);
     server.on("/", []()
               { server.send(200, "text/plain", "Hello From ATSystems Washing Machine!"); });
 
@@ -2216,6 +5143,43 @@ void setup()
   }
   
 
+  outboxQueue = xQueueCreate(OUTBOX_DEPTH, sizeof(OutboxMessage));
+  telegramMutex = xSemaphoreCreateMutex();
+  xTaskCreatePinnedToCore(
+      commstask,         // Task Function
+      "CommsTask",       // Task Name
+      8192,              // Stack Size (bytes, TLS handshake)
+      NULL,              // Task parameter
+      1,                 // Task Priority
+      &commstask_handle, // Task handle
+      0                  // Core to run the task (with the WiFi stack)
+  );
+
+  commandQueue = xQueueCreate(COMMAND_QUEUE_DEPTH, sizeof(TelegramCommand));
+  if (wifiConnected)
+  {
+    xTaskCreatePinnedToCore(
+        rxtask,         // Task Function
+        "RxTask",       // Task Name
+        8192,           // Stack Size (bytes, TLS handshake)
+        NULL,           // Task parameter
+        1,              // Task Priority
+        &rxtask_handle, // Task handle
+        0               // Core to run the task (with the WiFi stack)
+    );
+  }
+
+  cycleEventQueue = xQueueCreate(10, sizeof(CycleEvent));
+  xTaskCreatePinnedToCore(
+      cycletask,         // Task Function
+      "CycleTask",       // Task Name
+      4096,              // Stack Size (bytes)
+      NULL,              // Task parameter
+      2,                 // Task Priority (above loop() so ticks stay on schedule)
+      &cycletask_handle, // Task handle
+      1                  // Core to run the task (same core as loop())
+  );
+
   xTaskCreatePinnedToCore(
       ledtask,         // Task Function
       "LEDTask",       // Task Name
@@ -2227,240 +5191,62 @@ void setup()
   );
   displayPrint();
 }
-/* ----------------  30. Main Setup Function (END)  -------------------- */
+/* ----------------  37. Main Setup Function (END)  -------------------- */
 
 
-/* ----------------  31. Main Loop Function (START)  -------------------- */
+/* ----------------  38. Main Loop Function (START)  -------------------- */
 void loop()
 {
-  digitalWrite(WIFI_LED, wifiConnected ? ON : OFF);
+  if (!isAwaitingBalance)
+  {
+    ledSet(LED_BIT_WIFI, wifiConnected ? LED_BIT_WIFI : 0, 0);
+  }
   server.handleClient();
   ElegantOTA.loop();
 
-  if (wifiConnected && (millis() - lastTelegramCheck > telegramCheckDelay)) {
+  if (wifiConnected) {
     handleTelegramMessages();
-    lastTelegramCheck = millis();
   }
-  
+
+  handleCycleEvents();
+  actuatorTraceFlush();
  
   if (isTestMode) {
     display.setCursor(1, 0);
     display.print("  TEST MODE  ");
     display.setCursor(1, 1);
     display.print(" Engineering ");
+    // Buttons belong to the component tests here, not to program selection
+    xQueueReset(inputQueue);
     delay(100);
     return; 
   }
 
-  if (buttonPressed)
+  // Sleep until a button event arrives (or the idle period passes)
+  InputEvent event;
+  if (xQueueReceive(inputQueue, &event, pdMS_TO_TICKS(LOOP_IDLE_MS)) == pdTRUE)
   {
-    buttonPressed = false;
-    switch (selectedMode)
+    handleInputEvent(event);
+  }
+
+  if (pendingMode != 0 && (selectedMode != pendingMode || millis() - startWaitTime >= waitTime))
+  {
+    int mode = pendingMode;
+    pendingMode = 0;
+    if (selectedMode == mode)
+    {
+      // Confirmation window elapsed untouched: hand the program to the executor
+      outboxSend(cyclePrograms[mode].startMessage);
+      cycleStart(mode);
+    }
+    else
     {
-    case 1:
-      digitalWrite(WASH_LED, ON);
-      display.clear();
-      display.setCursor(2, 0);
-      display.print("Wash Only");
-      display.setCursor(2, 1);
-      display.print("Time: 30 Min");
-      startWaitTime = millis();
-      vTaskDelay(10 / portTICK_PERIOD_MS);
-      while (millis() - startWaitTime < waitTime)
-      {
-        if (buttonPressed)
-        {
-          selectedMode = 0;
-          break;
-        }
-      }
-      vTaskDelay(100 / portTICK_PERIOD_MS);
-      if (selectedMode == 1)
-      {
-        telegram.sendMessage(CHAT_ID, "Wash Only Started", "");
-        startTime = millis();
-        isWashing = true;
-        washLogic();
-        isWashing = false;
-        telegram.sendMessage(CHAT_ID, "Washing Complete", "");
-        digitalWrite(WASH_LED, ON);
-        isSpinning = true;
-        spinLogic();
-        isSpinning = false;
-        vTaskDelay(10 / portTICK_PERIOD_MS);
-        String message0 = "Total Water Used:" + String(washWaterUsed) + " L";
-        telegram.sendMessage(CHAT_ID, message0, "");
-        vTaskDelay(10 / portTICK_PERIOD_MS);
-        runTime = millis() - startTime;
-        String message1 = "Program Complete. Total Runtime:  " + String(runTime / 60000) + " Minutes";
-        telegram.sendMessage(CHAT_ID, message1, "");
-      }
-      selectedMode = 0;
-      buttonPressed = false;
-      digitalWrite(WASH_LED, OFF);
-      digitalWrite(RINSE_LED, OFF);
-      digitalWrite(SPIN_LED, OFF);
-      display.clear();
-      displayPrint();
-      delay(1000);
-      break;
-    case 2:
-      digitalWrite(RINSE_LED, ON);
-      display.clear();
-      display.setCursor(2, 0);
-      display.print("Rinse Only");
-      display.setCursor(2, 1);
-      display.print("Time: 30 Min");
-      startWaitTime = millis();
-      vTaskDelay(10 / portTICK_PERIOD_MS);
-      while (millis() - startWaitTime < waitTime)
-      {
-        if (buttonPressed)
-        {
-          selectedMode = 0;
-          break;
-        }
-      }
-      vTaskDelay(100 / portTICK_PERIOD_MS);
-      if (selectedMode == 2)
-      {
-        telegram.sendMessage(CHAT_ID, "Rinse Only Started", "");
-        startTime = millis();
-        isRinsing = true;
-        rinseLogic();
-        isRinsing = false;
-        telegram.sendMessage(CHAT_ID, "Rinsing Complete", "");
-        digitalWrite(RINSE_LED, ON);
-        isSpinning = true;
-        spinLogic();
-        isSpinning = false;
-        vTaskDelay(10 / portTICK_PERIOD_MS);
-        String message2 = "Total Water Used:" + String(rinseWaterUsed) + " L";
-        telegram.sendMessage(CHAT_ID, message2, "");
-        vTaskDelay(10 / portTICK_PERIOD_MS);
-        runTime = millis() - startTime;
-        String message3 = "Program Complete. Total Runtime:  " + String(runTime / 60000) + " Minutes";
-        telegram.sendMessage(CHAT_ID, message3, "");
-        vTaskDelay(10 / portTICK_PERIOD_MS);
-      }
-      selectedMode = 0;
-      buttonPressed = false;
-      digitalWrite(WASH_LED, OFF);
-      digitalWrite(RINSE_LED, OFF);
-      digitalWrite(SPIN_LED, OFF);
-      display.clear();
-      displayPrint();
-      delay(1000);
-      break;
-    case 3:
-      digitalWrite(SPIN_LED, ON);
-      display.clear();
-      display.setCursor(2, 0);
-      display.print("Spin Only");
-      display.setCursor(2, 1);
-      display.print("Time: 10 Min");
-      vTaskDelay(10 / portTICK_PERIOD_MS);
-      while (millis() - startWaitTime < waitTime)
-      {
-        if (buttonPressed)
-        {
-          selectedMode = 0;
-          break;
-        }
-      }
-      vTaskDelay(100 / portTICK_PERIOD_MS);
-      if (selectedMode == 3)
-      {
-        telegram.sendMessage(CHAT_ID, "Spin Only Started", "");
-        startTime = millis();
-        isSpinning = true;
-        spinLogic();
-        isSpinning = false;
-        vTaskDelay(10 / portTICK_PERIOD_MS);
-        telegram.sendMessage(CHAT_ID, "Spinning Complete", "");
-        vTaskDelay(10 / portTICK_PERIOD_MS);
-        runTime = millis() - startTime;
-        String message4 = "Program Complete. Total Runtime:  " + String(runTime / 60000) + " Minutes";
-        telegram.sendMessage(CHAT_ID, message4, "");
-      }
-      selectedMode = 0;
-      buttonPressed = false;
-      digitalWrite(WASH_LED, OFF);
-      digitalWrite(RINSE_LED, OFF);
-      digitalWrite(SPIN_LED, OFF);
-      display.clear();
-      displayPrint();
-      delay(1000);
-      break;
-    case 4:
-      digitalWrite(WASH_LED, ON);
-      digitalWrite(RINSE_LED, ON);
-      digitalWrite(SPIN_LED, ON);
-      display.clear();
-      display.setCursor(2, 0);
-      display.print("Complete Wash");
-      display.setCursor(2, 1);
-      display.print("Time: 45 Min");
-      startWaitTime = millis();
-      vTaskDelay(10 / portTICK_PERIOD_MS);
-      while (millis() - startWaitTime < waitTime)
-      {
-        if (buttonPressed)
-        {
-          selectedMode = 0;
-          break;
-        }
-      }
-      vTaskDelay(100 / portTICK_PERIOD_MS);
-      if (selectedMode == 4)
-      {
-        telegram.sendMessage(CHAT_ID, "Complete Wash Started", "");
-        startTime = millis();
-        isCompleteProgramWash = true;
-        isCompleteProgramRinse = false;
-        isCompleteProgramSpin = false;
-        washLogic();
-        telegram.sendMessage(CHAT_ID, "Washing Complete", "");
-        spinLogic();
-        isCompleteProgramWash = false;
-        isCompleteProgramRinse = true;
-        isCompleteProgramSpin = false;
-        rinseLogic();
-        isCompleteProgramWash = false;
-        isCompleteProgramRinse = false;
-        isCompleteProgramSpin = true;
-        telegram.sendMessage(CHAT_ID, "Rinsing Complete", "");
-        spinLogic();
-        isCompleteProgramWash = false;
-        isCompleteProgramRinse = false;
-        isCompleteProgramSpin = false;
-        telegram.sendMessage(CHAT_ID, "Spinning Complete", "");
-        totalWaterUsed = washWaterUsed + rinseWaterUsed;
-        vTaskDelay(10 / portTICK_PERIOD_MS);
-        String message4 = "Total Water Used:" + String(totalWaterUsed) + " L";
-        telegram.sendMessage(CHAT_ID, message4, "");
-        vTaskDelay(10 / portTICK_PERIOD_MS);
-        runTime = millis() - startTime;
-        String message5 = "Program Complete. Total Runtime:  " + String(runTime / 60000) + " Minutes";
-        telegram.sendMessage(CHAT_ID, message5, "");
-      }
       selectedMode = 0;
-      buttonPressed = false;
-      digitalWrite(WASH_LED, OFF);
-      digitalWrite(RINSE_LED, OFF);
-      digitalWrite(SPIN_LED, OFF);
+      ledShow(LED_SCENE_IDLE);
       display.clear();
       displayPrint();
-      delay(1000);
-      break;
-    default:
-      selectedMode = 0;
-      buttonPressed = false;
-      digitalWrite(WASH_LED, OFF);
-      digitalWrite(RINSE_LED, OFF);
-      digitalWrite(SPIN_LED, OFF);
     }
   }
 }
-/* ----------------  31. Main Loop Function (END)  -------------------- */
+/* ----------------  38. Main Loop Function (END)  -------------------- */
 
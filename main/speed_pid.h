@@ -0,0 +1,68 @@
+/* --------------------  Drum Speed PID (START)  ----------------------
+Closed-loop trim for the inverter duty on CTR_SIG. The stage tables keep
+their open-loop duty as feedforward, and the controller adds a correction
+that holds the drum at the table's target rpm whatever the load:
+
+  duty = feedforward + Kp * e + I + Kd * d(-rpm)/dt,   e = target - rpm
+
+  - derivative on the measurement, so a new target does not kick the output
+  - the integral is kept in duty units, so retuning Ki does not bump it
+  - anti-windup by conditional integration: while the output is clamped the
+    integral only moves back towards the allowed range
+
+On the host it runs only as part of program.cpp in washsim, holding the
+machine model's drum at the table speeds; the engineering menu's step
+test (speedStepTest) is the way to check a set of gains on the machine.
+-------------------------------------------------------------------------- */
+#pragma once
+#include <stdint.h>
+
+struct SpeedPidGains {
+  float kp;                         // Duty per rpm of error
+  float ki;                         // Duty per rpm of error per second
+  float kd;                         // Duty per rpm/s of deceleration
+};
+
+struct SpeedPid {
+  SpeedPidGains gains;
+  float integral;                   // Accumulated Ki term (duty)
+  float lastRpm;                    // Measurement at the previous update
+  bool primed;                      // lastRpm holds a value
+};
+
+inline void speedPidReset(SpeedPid &pid)
+{
+  pid.integral = 0;
+  pid.primed = false;
+}
+
+// One fixed-rate update; returns the duty clamped to outMin..outMax
+inline float speedPidUpdate(SpeedPid &pid, float target, float rpm, float feedforward,
+                            float outMin, float outMax, float dtS)
+{
+  float error = target - rpm;
+  float derivative = pid.primed ? (pid.lastRpm - rpm) / dtS : 0;
+  pid.lastRpm = rpm;
+  pid.primed = true;
+
+  float integral = pid.integral + pid.gains.ki * error * dtS;
+  float out = feedforward + pid.gains.kp * error + integral + pid.gains.kd * derivative;
+  if (out > outMax)
+  {
+    out = outMax;
+    if (error < 0)
+      pid.integral = integral;
+  }
+  else if (out < outMin)
+  {
+    out = outMin;
+    if (error > 0)
+      pid.integral = integral;
+  }
+  else
+  {
+    pid.integral = integral;
+  }
+  return out;
+}
+/* --------------------  Drum Speed PID (END)  ---------------------- */
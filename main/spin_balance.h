@@ -0,0 +1,70 @@
+/* --------------------  Spin Balance Meter (START)  ----------------------
+Load imbalance from FB_SIG speed ripple. At distribution speed an uneven
+load makes the drum slow down climbing its heavy side and speed up falling
+from it. FB_SIG gives two pulses per revolution, so the meter pairs the
+periods into revolutions and compares the two halves of each: a once-per-
+revolution swing of u (fraction of speed) makes them differ by 4u/pi of
+their mean. Averaged over the revolutions measured:
+
+  ripple % = 100 * pi/2 * mean(|first - second| / (first + second))
+
+Speed-loop hunting and drift are slow against one revolution and mostly
+cancel within a pair, and single-edge jitter averages out. The revolution
+periods also give the drum speed, so the caller can wait for the speed
+loop to settle before it trusts the figure. A balanced load stays within a
+few percent; the spin stage compares the figure with its table threshold.
+On the host it runs only as part of program.cpp in washsim: --unbalance F
+sets the machine model's ripple and the BALANCE serial row (--serial)
+shows the figure measured for it.
+-------------------------------------------------------------------------- */
+#pragma once
+#include <stdint.h>
+#include <math.h>
+
+struct RippleMeter {
+  uint16_t count;                   // Revolutions measured
+  uint32_t halfUs;                  // First half of the revolution in progress (0 = none)
+  uint32_t revUs;                   // Period of the last whole revolution
+  float sum;                        // Sum of per-revolution |first - second| / (first + second)
+};
+
+inline void rippleReset(RippleMeter &m)
+{
+  m.count = 0;
+  m.halfUs = 0;
+  m.revUs = 0;
+  m.sum = 0;
+}
+
+// One FB_SIG period; every second one completes a revolution
+inline void rippleAdd(RippleMeter &m, uint32_t periodUs)
+{
+  if (m.halfUs == 0)
+  {
+    m.halfUs = periodUs;
+    return;
+  }
+  m.revUs = m.halfUs + periodUs;
+  float diff = m.halfUs > periodUs ? m.halfUs - periodUs : periodUs - m.halfUs;
+  m.halfUs = 0;
+  if (m.count < UINT16_MAX)
+  {
+    m.count++;
+    m.sum += diff / m.revUs;
+  }
+}
+
+// Ripple in percent, 0 until a revolution has been seen
+inline float ripplePercent(const RippleMeter &m)
+{
+  if (m.count == 0)
+    return 0;
+  return 100.0f * (float)M_PI / 2 * m.sum / m.count;
+}
+
+// Drum speed over the last whole revolution, 0 until one has been seen
+inline float rippleRpm(const RippleMeter &m)
+{
+  return m.revUs != 0 ? 60e6f / m.revUs : 0;
+}
+/* --------------------  Spin Balance Meter (END)  ---------------------- */
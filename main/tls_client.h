@@ -0,0 +1,186 @@
+/* --------------------  TLS Client (START)  ----------------------
+Arduino Client on top of ESP-IDF esp_tls, used in place of WiFiClientSecure
+for the Telegram bots. WiFiClientSecure does a full handshake on every
+connect and has no way to hand mbedTLS a saved session; this client:
+  - keeps the TLS session open between requests (the bot library only
+    reconnects when connected() turns false), so HTTP/1.1 keep-alive works
+  - remembers the session ticket from the last handshake and offers it on
+    the next connect, turning the reconnect into an abbreviated handshake
+    (needs CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS=y in sdkconfig, otherwise
+    every handshake is a full one)
+  - counts handshakes, time spent in them and bytes moved
+-------------------------------------------------------------------------- */
+#pragma once
+#include <Arduino.h>
+#include <Client.h>
+#include <fcntl.h>
+#include "esp_tls.h"
+
+#define TLS_CONNECT_TIMEOUT_MS 10000  // TCP connect + handshake budget
+#define TLS_RX_BUFFER 512             // Decrypted bytes buffered for read()/peek()
+
+struct TlsClientStats {
+  uint32_t handshakes;              // Completed handshakes (full or resumed)
+  uint32_t resumeOffered;           // Handshakes that offered a cached session ticket
+  uint32_t failures;                // Connects that failed
+  uint32_t handshakeMs;             // Total time spent connecting and handshaking
+  uint64_t bytesSent;               // Application bytes written
+  uint64_t bytesReceived;           // Application bytes read
+};
+
+class TlsClient : public Client
+{
+public:
+  TlsClientStats stats = {};
+
+  void setCACert(const char *cert) { caCert = cert; }
+
+  int connect(IPAddress ip, uint16_t port) override { return connect(ip.toString().c_str(), port); }
+
+  int connect(const char *host, uint16_t port) override
+  {
+    stop();
+    esp_tls_cfg_t cfg = {};
+    cfg.cacert_buf = (const unsigned char *)caCert;
+    cfg.cacert_bytes = caCert ? strlen(caCert) + 1 : 0;
+    cfg.timeout_ms = TLS_CONNECT_TIMEOUT_MS;
+#ifdef CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+    cfg.client_session = session;
+    if (session != NULL)
+      stats.resumeOffered++;
+#endif
+
+    unsigned long start = millis();
+    tls = esp_tls_init();
+    if (tls == NULL || esp_tls_conn_new_sync(host, strlen(host), port, &cfg, tls) != 1)
+    {
+      stats.failures++;
+      stop();
+#ifdef CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+      // Do not keep offering a ticket the server may have rejected
+      esp_tls_free_client_session(session);
+      session = NULL;
+#endif
+      return 0;
+    }
+    stats.handshakes++;
+    stats.handshakeMs += millis() - start;
+
+#ifdef CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+    esp_tls_client_session_t *fresh = esp_tls_get_client_session(tls);
+    if (fresh != NULL)
+    {
+      esp_tls_free_client_session(session);
+      session = fresh;
+    }
+#endif
+
+    // Non-blocking from here on, so available()/connected() never stall
+    int fd = -1;
+    if (esp_tls_get_conn_sockfd(tls, &fd) == ESP_OK)
+      fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+    return 1;
+  }
+
+  size_t write(uint8_t b) override { return write(&b, 1); }
+
+  size_t write(const uint8_t *buf, size_t size) override
+  {
+    size_t done = 0;
+    unsigned long start = millis();
+    while (tls != NULL && done < size)
+    {
+      ssize_t n = esp_tls_conn_write(tls, buf + done, size - done);
+      if (n > 0)
+      {
+        done += n;
+      }
+      else if ((n == ESP_TLS_ERR_SSL_WANT_WRITE || n == ESP_TLS_ERR_SSL_WANT_READ) && millis() - start < getTimeout())
+      {
+        vTaskDelay(1);
+      }
+      else
+      {
+        stop();
+      }
+    }
+    stats.bytesSent += done;
+    return done;
+  }
+
+  int available() override
+  {
+    if (!fill())
+      return 0;
+    return rxLen - rxPos + (tls != NULL ? esp_tls_get_bytes_avail(tls) : 0);
+  }
+
+  int read() override { return fill() ? rxBuf[rxPos++] : -1; }
+
+  int read(uint8_t *buf, size_t size) override
+  {
+    size_t n = 0;
+    while (n < size && fill())
+    {
+      size_t chunk = min(size - n, (size_t)(rxLen - rxPos));
+      memcpy(buf + n, rxBuf + rxPos, chunk);
+      rxPos += chunk;
+      n += chunk;
+    }
+    return n ? (int)n : -1;
+  }
+
+  int peek() override { return fill() ? rxBuf[rxPos] : -1; }
+
+  void flush() override {}
+
+  void stop() override
+  {
+    if (tls != NULL)
+    {
+      esp_tls_conn_destroy(tls);
+      tls = NULL;
+    }
+    rxPos = rxLen = 0;
+  }
+
+  // Still open, or closed with unread data (a polled read notices a peer close)
+  uint8_t connected() override
+  {
+    fill();
+    return tls != NULL || rxPos < rxLen;
+  }
+
+  operator bool() override { return connected(); }
+
+private:
+  const char *caCert = NULL;
+  esp_tls_t *tls = NULL;
+#ifdef CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+  esp_tls_client_session_t *session = NULL; // Ticket from the last handshake
+#endif
+  uint8_t rxBuf[TLS_RX_BUFFER];
+  uint16_t rxPos = 0;
+  uint16_t rxLen = 0;
+
+  // Tops up rxBuf without blocking; false if nothing is buffered
+  bool fill()
+  {
+    if (rxPos < rxLen)
+      return true;
+    if (tls == NULL)
+      return false;
+    ssize_t n = esp_tls_conn_read(tls, rxBuf, sizeof(rxBuf));
+    if (n > 0)
+    {
+      rxPos = 0;
+      rxLen = n;
+      stats.bytesReceived += n;
+      return true;
+    }
+    if (n != ESP_TLS_ERR_SSL_WANT_READ && n != ESP_TLS_ERR_SSL_WANT_WRITE)
+      stop(); // 0: closed by the server, < 0: connection error
+    return false;
+  }
+};
+/* --------------------  TLS Client (END)  ---------------------- */